@@ -0,0 +1,910 @@
+#ifndef ART_H
+#define ART_H
+
+#include <string>
+#include <string_view>
+#include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <assert.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ART_SSE2
+#endif
+
+//Adaptive radix tree dictionary for string keys (Leis et al., "The Adaptive Radix Tree").
+//A lookup walks the key one byte per level and never compares whole keys, apart from the one leaf it ends at,
+//so long keys sharing prefixes cost no more than their distinguishing bytes. Inner nodes come in four sizes,
+//for up to 4, 16, 48 and 256 children, and grow and shrink with their fan-out. Runs of bytes shared by a whole
+//subtree are kept once, as the prefix of its inner node (path compression), and a key that is alone in its subtree
+//is stored as a leaf directly below the point where it branches off (lazy expansion).
+//Keys are ordered bytewise, as std::string compares them, and may be of any length, including empty or holding zero bytes.
+template<typename I>
+class ART
+{
+public:
+	using Key = std::string;
+	using Item = I;
+
+
+	void insert(std::string_view, Item);
+	void remove(std::string_view);
+	Item* lookup(std::string_view);
+
+	//Constructs the item from args only if the key is absent, returns the item and whether it was inserted
+	template<typename... Args>
+	std::pair<Item*, bool> try_emplace(std::string_view, Args&&...);
+	//Inserts, or assigns to the existing item
+	template<typename ItemArg>
+	std::pair<Item*, bool> insert_or_assign(std::string_view, ItemArg &&);
+
+	void clear();
+	size_t size() const { return entries; }
+	bool empty() const { return entries == 0; }
+
+	//Calls function(key, item) for every entry in key order, the key is a std::string_view
+	template<typename Function>
+	void forEach(Function);
+	template<typename Function>
+	void forEach(Function) const;
+	//Calls function(key, item) in key order for the entries whose keys start with the given prefix.
+	//The descent stops where the prefix ends, the subtree below it holds exactly the matching keys
+	template<typename Function>
+	void forEachWithPrefix(std::string_view, Function);
+	template<typename Function>
+	void forEachWithPrefix(std::string_view, Function) const;
+
+	void printEntries() const;
+	void printTree() const;
+
+	//Walks the whole tree checking the key order, the child counts and that every inner node branches
+	bool checkInvariants() const;
+
+	template<typename IT>
+	friend std::ostream & operator<<(std::ostream &, const ART<IT> &);
+
+
+
+	ART() = default;
+	ART(const ART &) = delete;
+	ART &operator=(const ART &) = delete;
+	~ART();
+
+private:
+	enum NodeType : uint8_t { LeafType, Node4Type, Node16Type, Node48Type, Node256Type };
+
+	struct Node
+	{
+		NodeType type;
+
+		explicit Node(NodeType _type) : type(_type) {}
+	};
+
+	//Holds the whole key, which lazy expansion needs to tell keys apart once they share a subtree
+	struct Leaf : Node
+	{
+		Key key;
+		Item item;
+
+		template<typename... Args>
+		Leaf(std::string_view _key, Args&&... args) : Node(LeafType), key(_key), item(std::forward<Args>(args)...) {}
+	};
+
+	struct Inner : Node
+	{
+		uint16_t count = 0;
+		//Bytes shared by every key below, after the byte that led here
+		std::string prefix;
+		//The entry whose key ends at this node, a key that is a prefix of others
+		Leaf* terminal = nullptr;
+
+		explicit Inner(NodeType _type) : Node(_type) {}
+	};
+
+	//Up to 16 children in sorted key bytes, searched linearly or with one SIMD comparison
+	struct Node4 : Inner
+	{
+		uint8_t keys[4];
+		Node* children[4];
+
+		Node4() : Inner(Node4Type) {}
+	};
+
+	struct Node16 : Inner
+	{
+		uint8_t keys[16];
+		Node* children[16];
+
+		Node16() : Inner(Node16Type) {}
+	};
+
+	//childIndex maps a key byte to its slot plus one, 0 when there is no such child. The slots are kept dense
+	struct Node48 : Inner
+	{
+		uint8_t childIndex[256];
+		Node* children[48];
+
+		Node48() : Inner(Node48Type) { memset(childIndex, 0, sizeof(childIndex)); }
+	};
+
+	struct Node256 : Inner
+	{
+		Node* children[256];
+
+		Node256() : Inner(Node256Type) { memset(children, 0, sizeof(children)); }
+	};
+
+	//Node16 and Node256 shrink below these counts, short of their smaller neighbour's capacity so that a node
+	//on the boundary does not change size on every insertion and removal
+	static const uint16_t shrink16 = 3;
+	static const uint16_t shrink48 = 12;
+	static const uint16_t shrink256 = 40;
+
+	static Node** findChild(Inner*, uint8_t);
+	static Inner* addChild(Inner*, uint8_t, Node*);
+	static Inner* removeChild(Inner*, uint8_t);
+	static Node* collapse(Inner*);
+	static void place(Inner* &, Leaf*, size_t);
+	template<size_t N>
+	static void insertSorted(uint8_t (&)[N], Node* (&)[N], uint16_t &, uint8_t, Node*);
+	static void moveHeader(Inner*, Inner*);
+	//Calls function(byte, child) for every child in byte order
+	template<typename Function>
+	static void forEachChild(const Inner*, Function);
+	template<typename Function>
+	static void forEachRec(Node*, Function &);
+
+	bool removeRec(Node* &, std::string_view, size_t);
+	static void freeNode(Node*);
+	static void deleteRec(Node*);
+	static void printTreeRec(const Node*, int);
+	static bool checkInvariantsRec(const Node*, std::string &, size_t &);
+
+	Node* root = nullptr;
+	size_t entries = 0;
+};
+
+template<typename I>
+ART<I>::~ART()
+{
+	deleteRec(root);
+}
+
+template<typename I>
+void ART<I>::clear()
+{
+	deleteRec(root);
+	root = nullptr;
+	entries = 0;
+}
+
+//Deletes a single node as its actual type, the children are left alone
+template<typename I>
+void ART<I>::freeNode(Node* node)
+{
+	switch (node->type)
+	{
+	case LeafType: delete static_cast<Leaf*>(node); break;
+	case Node4Type: delete static_cast<Node4*>(node); break;
+	case Node16Type: delete static_cast<Node16*>(node); break;
+	case Node48Type: delete static_cast<Node48*>(node); break;
+	case Node256Type: delete static_cast<Node256*>(node); break;
+	}
+}
+
+template<typename I>
+void ART<I>::deleteRec(Node* node)
+{
+	if (node == nullptr)
+		return;
+
+	if (node->type != LeafType)
+	{
+		Inner* inner = static_cast<Inner*>(node);
+		if (inner->terminal != nullptr)
+			freeNode(inner->terminal);
+		forEachChild(inner, [](uint8_t, Node* child) { deleteRec(child); });
+	}
+	freeNode(node);
+}
+
+template<typename I>
+typename ART<I>::Node** ART<I>::findChild(Inner* node, uint8_t byte)
+{
+	switch (node->type)
+	{
+	case Node4Type:
+	{
+		Node4* small = static_cast<Node4*>(node);
+		for (uint16_t i = 0; i < small->count; i++)
+		{
+			if (small->keys[i] == byte)
+				return &small->children[i];
+		}
+		return nullptr;
+	}
+	case Node16Type:
+	{
+		Node16* medium = static_cast<Node16*>(node);
+#ifdef ART_SSE2
+		__m128i matches = _mm_cmpeq_epi8(_mm_set1_epi8(static_cast<char>(byte)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(medium->keys)));
+		unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(matches)) & ((1u << medium->count) - 1);
+		if (mask == 0)
+			return nullptr;
+		unsigned int position = 0;
+		while ((mask & 1) == 0)
+		{
+			mask >>= 1;
+			position++;
+		}
+		return &medium->children[position];
+#else
+		for (uint16_t i = 0; i < medium->count; i++)
+		{
+			if (medium->keys[i] == byte)
+				return &medium->children[i];
+		}
+		return nullptr;
+#endif
+	}
+	case Node48Type:
+	{
+		Node48* large = static_cast<Node48*>(node);
+		uint8_t slot = large->childIndex[byte];
+		return (slot == 0) ? nullptr : &large->children[slot - 1];
+	}
+	case Node256Type:
+	{
+		Node256* full = static_cast<Node256*>(node);
+		return (full->children[byte] == nullptr) ? nullptr : &full->children[byte];
+	}
+	default:
+		return nullptr;
+	}
+}
+
+template<typename I>
+template<size_t N>
+void ART<I>::insertSorted(uint8_t (&keys)[N], Node* (&children)[N], uint16_t &count, uint8_t byte, Node* child)
+{
+	assert(count < N);
+	uint16_t position = 0;
+	while (position < count && keys[position] < byte)
+		position++;
+
+	for (uint16_t i = count; i > position; i--)
+	{
+		keys[i] = keys[i - 1];
+		children[i] = children[i - 1];
+	}
+	keys[position] = byte;
+	children[position] = child;
+	count++;
+}
+
+template<typename I>
+void ART<I>::moveHeader(Inner* from, Inner* to)
+{
+	to->prefix = std::move(from->prefix);
+	to->terminal = from->terminal;
+}
+
+//Adds a child under a byte not present yet. A full node is replaced by one of the next size,
+//the node to link in its place is returned
+template<typename I>
+typename ART<I>::Inner* ART<I>::addChild(Inner* node, uint8_t byte, Node* child)
+{
+	switch (node->type)
+	{
+	case Node4Type:
+	{
+		Node4* small = static_cast<Node4*>(node);
+		if (small->count < 4)
+		{
+			insertSorted(small->keys, small->children, small->count, byte, child);
+			return small;
+		}
+
+		Node16* grown = new Node16();
+		moveHeader(small, grown);
+		std::copy(small->keys, small->keys + 4, grown->keys);
+		std::copy(small->children, small->children + 4, grown->children);
+		grown->count = 4;
+		delete small;
+		insertSorted(grown->keys, grown->children, grown->count, byte, child);
+		return grown;
+	}
+	case Node16Type:
+	{
+		Node16* medium = static_cast<Node16*>(node);
+		if (medium->count < 16)
+		{
+			insertSorted(medium->keys, medium->children, medium->count, byte, child);
+			return medium;
+		}
+
+		Node48* grown = new Node48();
+		moveHeader(medium, grown);
+		for (uint16_t i = 0; i < 16; i++)
+		{
+			grown->children[i] = medium->children[i];
+			grown->childIndex[medium->keys[i]] = static_cast<uint8_t>(i + 1);
+		}
+		grown->count = 16;
+		delete medium;
+		return addChild(grown, byte, child);
+	}
+	case Node48Type:
+	{
+		Node48* large = static_cast<Node48*>(node);
+		if (large->count < 48)
+		{
+			large->children[large->count] = child;
+			large->childIndex[byte] = static_cast<uint8_t>(++large->count);
+			return large;
+		}
+
+		Node256* grown = new Node256();
+		moveHeader(large, grown);
+		for (unsigned int b = 0; b < 256; b++)
+		{
+			if (large->childIndex[b] != 0)
+				grown->children[b] = large->children[large->childIndex[b] - 1];
+		}
+		grown->count = 48;
+		delete large;
+		return addChild(grown, byte, child);
+	}
+	default:
+	{
+		Node256* full = static_cast<Node256*>(node);
+		full->children[byte] = child;
+		full->count++;
+		return full;
+	}
+	}
+}
+
+//Removes the child under a byte, replacing an underfull node by one of the next smaller size
+template<typename I>
+typename ART<I>::Inner* ART<I>::removeChild(Inner* node, uint8_t byte)
+{
+	switch (node->type)
+	{
+	case Node4Type:
+	{
+		Node4* small = static_cast<Node4*>(node);
+		uint16_t position = 0;
+		while (small->keys[position] != byte)
+			position++;
+		for (uint16_t i = position + 1; i < small->count; i++)
+		{
+			small->keys[i - 1] = small->keys[i];
+			small->children[i - 1] = small->children[i];
+		}
+		small->count--;
+		return small;
+	}
+	case Node16Type:
+	{
+		Node16* medium = static_cast<Node16*>(node);
+		uint16_t position = 0;
+		while (medium->keys[position] != byte)
+			position++;
+		for (uint16_t i = position + 1; i < medium->count; i++)
+		{
+			medium->keys[i - 1] = medium->keys[i];
+			medium->children[i - 1] = medium->children[i];
+		}
+		medium->count--;
+		if (medium->count > shrink16)
+			return medium;
+
+		Node4* shrunk = new Node4();
+		moveHeader(medium, shrunk);
+		std::copy(medium->keys, medium->keys + medium->count, shrunk->keys);
+		std::copy(medium->children, medium->children + medium->count, shrunk->children);
+		shrunk->count = medium->count;
+		delete medium;
+		return shrunk;
+	}
+	case Node48Type:
+	{
+		Node48* large = static_cast<Node48*>(node);
+		uint8_t slot = large->childIndex[byte] - 1;
+		large->childIndex[byte] = 0;
+
+		//The last slot moves into the hole, whoever points at it is found through the index
+		uint8_t last = static_cast<uint8_t>(large->count - 1);
+		if (slot != last)
+		{
+			large->children[slot] = large->children[last];
+			for (unsigned int b = 0; b < 256; b++)
+			{
+				if (large->childIndex[b] == last + 1)
+				{
+					large->childIndex[b] = slot + 1;
+					break;
+				}
+			}
+		}
+		large->count--;
+		if (large->count > shrink48)
+			return large;
+
+		Node16* shrunk = new Node16();
+		moveHeader(large, shrunk);
+		for (unsigned int b = 0; b < 256; b++)
+		{
+			if (large->childIndex[b] != 0)
+			{
+				shrunk->keys[shrunk->count] = static_cast<uint8_t>(b);
+				shrunk->children[shrunk->count++] = large->children[large->childIndex[b] - 1];
+			}
+		}
+		delete large;
+		return shrunk;
+	}
+	default:
+	{
+		Node256* full = static_cast<Node256*>(node);
+		full->children[byte] = nullptr;
+		full->count--;
+		if (full->count > shrink256)
+			return full;
+
+		Node48* shrunk = new Node48();
+		moveHeader(full, shrunk);
+		for (unsigned int b = 0; b < 256; b++)
+		{
+			if (full->children[b] != nullptr)
+			{
+				shrunk->children[shrunk->count] = full->children[b];
+				shrunk->childIndex[b] = static_cast<uint8_t>(++shrunk->count);
+			}
+		}
+		delete full;
+		return shrunk;
+	}
+	}
+}
+
+//An inner node left with a single entry is replaced by it: a lone child absorbs the node's prefix and
+//the byte leading to it, a lone terminal leaf needs nothing as leaves hold their whole key
+template<typename I>
+typename ART<I>::Node* ART<I>::collapse(Inner* node)
+{
+	if (node->count == 0)
+	{
+		Leaf* terminal = node->terminal;
+		node->terminal = nullptr;
+		freeNode(node);
+		return terminal;
+	}
+	if (node->count > 1 || node->terminal != nullptr)
+		return node;
+
+	uint8_t byte = 0;
+	Node* child = nullptr;
+	forEachChild(node, [&byte, &child](uint8_t b, Node* c) { byte = b; child = c; });
+	if (child->type != LeafType)
+	{
+		Inner* inner = static_cast<Inner*>(child);
+		inner->prefix = node->prefix + static_cast<char>(byte) + inner->prefix;
+	}
+	freeNode(node);
+	return child;
+}
+
+//Puts a leaf into an inner node whose path ends at depth: as the terminal when its key ends there, as a child otherwise
+template<typename I>
+void ART<I>::place(Inner* &node, Leaf* leaf, size_t depth)
+{
+	if (leaf->key.size() == depth)
+		node->terminal = leaf;
+	else
+		node = addChild(node, static_cast<uint8_t>(leaf->key[depth]), leaf);
+}
+
+template<typename I>
+template<typename Function>
+void ART<I>::forEachChild(const Inner* node, Function function)
+{
+	switch (node->type)
+	{
+	case Node4Type:
+	{
+		const Node4* small = static_cast<const Node4*>(node);
+		for (uint16_t i = 0; i < small->count; i++)
+			function(small->keys[i], small->children[i]);
+		break;
+	}
+	case Node16Type:
+	{
+		const Node16* medium = static_cast<const Node16*>(node);
+		for (uint16_t i = 0; i < medium->count; i++)
+			function(medium->keys[i], medium->children[i]);
+		break;
+	}
+	case Node48Type:
+	{
+		const Node48* large = static_cast<const Node48*>(node);
+		for (unsigned int b = 0; b < 256; b++)
+		{
+			if (large->childIndex[b] != 0)
+				function(static_cast<uint8_t>(b), large->children[large->childIndex[b] - 1]);
+		}
+		break;
+	}
+	case Node256Type:
+	{
+		const Node256* full = static_cast<const Node256*>(node);
+		for (unsigned int b = 0; b < 256; b++)
+		{
+			if (full->children[b] != nullptr)
+				function(static_cast<uint8_t>(b), full->children[b]);
+		}
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+template<typename I>
+typename ART<I>::Item* ART<I>::lookup(std::string_view _key)
+{
+	Node* current = root;
+	size_t depth = 0;
+	while (current != nullptr)
+	{
+		//Every byte before depth has been matched on the way down, the leaf only has to agree on the rest
+		if (current->type == LeafType)
+		{
+			Leaf* leaf = static_cast<Leaf*>(current);
+			bool equal = leaf->key.size() == _key.size() &&
+				memcmp(leaf->key.data() + depth, _key.data() + depth, _key.size() - depth) == 0;
+			return equal ? &leaf->item : nullptr;
+		}
+
+		Inner* inner = static_cast<Inner*>(current);
+		const std::string &prefix = inner->prefix;
+		if (_key.size() - depth < prefix.size() || memcmp(prefix.data(), _key.data() + depth, prefix.size()) != 0)
+			return nullptr;
+		depth += prefix.size();
+
+		if (depth == _key.size())
+			return (inner->terminal != nullptr) ? &inner->terminal->item : nullptr;
+
+		Node** child = findChild(inner, static_cast<uint8_t>(_key[depth]));
+		if (child == nullptr)
+			return nullptr;
+		current = *child;
+		depth++;
+	}
+	return nullptr;
+}
+
+template<typename I>
+void ART<I>::insert(std::string_view _key, Item _item)
+{
+	insert_or_assign(_key, std::move(_item));
+}
+
+template<typename I>
+template<typename ItemArg>
+std::pair<typename ART<I>::Item*, bool> ART<I>::insert_or_assign(std::string_view _key, ItemArg &&_item)
+{
+	std::pair<Item*, bool> result = try_emplace(_key, std::forward<ItemArg>(_item));
+	if (!result.second)
+		*result.first = std::forward<ItemArg>(_item);
+	return result;
+}
+
+//Iterative insertion following the link to rewrite: a node may be replaced by a grown copy
+//or by a new inner node where the key branches off a leaf or a compressed path
+template<typename I>
+template<typename... Args>
+std::pair<typename ART<I>::Item*, bool> ART<I>::try_emplace(std::string_view _key, Args&&... args)
+{
+	Node** link = &root;
+	size_t depth = 0;
+	while (true)
+	{
+		Node* current = *link;
+		if (current == nullptr)
+		{
+			Leaf* leaf = new Leaf(_key, std::forward<Args>(args)...);
+			*link = leaf;
+			entries++;
+			return { &leaf->item, true };
+		}
+
+		if (current->type == LeafType)
+		{
+			Leaf* existing = static_cast<Leaf*>(current);
+			if (existing->key == _key)
+				return { &existing->item, false };
+
+			//Lazy expansion ends: an inner node takes the bytes both keys share as its prefix
+			Leaf* leaf = new Leaf(_key, std::forward<Args>(args)...);
+			size_t common = depth;
+			size_t limit = std::min(existing->key.size(), _key.size());
+			while (common < limit && existing->key[common] == _key[common])
+				common++;
+
+			Inner* inner = new Node4();
+			inner->prefix.assign(_key.data() + depth, common - depth);
+			place(inner, existing, common);
+			place(inner, leaf, common);
+			*link = inner;
+			entries++;
+			return { &leaf->item, true };
+		}
+
+		Inner* inner = static_cast<Inner*>(current);
+		const std::string &prefix = inner->prefix;
+		size_t matched = 0;
+		while (matched < prefix.size() && depth + matched < _key.size() && prefix[matched] == _key[depth + matched])
+			matched++;
+
+		if (matched < prefix.size())
+		{
+			//The key leaves the compressed path: a new node takes the matched part, the old one keeps the rest
+			Leaf* leaf = new Leaf(_key, std::forward<Args>(args)...);
+			Inner* parent = new Node4();
+			parent->prefix.assign(prefix, 0, matched);
+			uint8_t byte = static_cast<uint8_t>(prefix[matched]);
+			inner->prefix.erase(0, matched + 1);
+			parent = addChild(parent, byte, inner);
+			place(parent, leaf, depth + matched);
+			*link = parent;
+			entries++;
+			return { &leaf->item, true };
+		}
+		depth += prefix.size();
+
+		if (depth == _key.size())
+		{
+			if (inner->terminal != nullptr)
+				return { &inner->terminal->item, false };
+			inner->terminal = new Leaf(_key, std::forward<Args>(args)...);
+			entries++;
+			return { &inner->terminal->item, true };
+		}
+
+		Node** child = findChild(inner, static_cast<uint8_t>(_key[depth]));
+		if (child == nullptr)
+		{
+			Leaf* leaf = new Leaf(_key, std::forward<Args>(args)...);
+			*link = addChild(inner, static_cast<uint8_t>(_key[depth]), leaf);
+			entries++;
+			return { &leaf->item, true };
+		}
+
+		link = child;
+		depth++;
+	}
+}
+
+template<typename I>
+void ART<I>::remove(std::string_view _key)
+{
+	if (removeRec(root, _key, 0))
+		entries--;
+}
+
+//Returns whether the key was found. On the way back up, nodes that lost a child shrink
+//and nodes left with a single entry are collapsed into it
+template<typename I>
+bool ART<I>::removeRec(Node* &link, std::string_view _key, size_t depth)
+{
+	Node* current = link;
+	if (current == nullptr)
+		return false;
+
+	if (current->type == LeafType)
+	{
+		Leaf* leaf = static_cast<Leaf*>(current);
+		if (leaf->key != _key)
+			return false;
+		freeNode(leaf);
+		link = nullptr;
+		return true;
+	}
+
+	Inner* inner = static_cast<Inner*>(current);
+	const std::string &prefix = inner->prefix;
+	if (_key.size() - depth < prefix.size() || memcmp(prefix.data(), _key.data() + depth, prefix.size()) != 0)
+		return false;
+	depth += prefix.size();
+
+	if (depth == _key.size())
+	{
+		if (inner->terminal == nullptr)
+			return false;
+		freeNode(inner->terminal);
+		inner->terminal = nullptr;
+	}
+	else
+	{
+		uint8_t byte = static_cast<uint8_t>(_key[depth]);
+		Node** child = findChild(inner, byte);
+		if (child == nullptr || !removeRec(*child, _key, depth + 1))
+			return false;
+		if (*child == nullptr)
+			inner = removeChild(inner, byte);
+	}
+
+	link = collapse(inner);
+	return true;
+}
+
+template<typename I>
+template<typename Function>
+void ART<I>::forEachRec(Node* current, Function &function)
+{
+	if (current == nullptr)
+		return;
+
+	if (current->type == LeafType)
+	{
+		Leaf* leaf = static_cast<Leaf*>(current);
+		function(std::string_view(leaf->key), leaf->item);
+		return;
+	}
+
+	//A key ending here is a prefix of every key below, so it comes first
+	Inner* inner = static_cast<Inner*>(current);
+	if (inner->terminal != nullptr)
+		function(std::string_view(inner->terminal->key), inner->terminal->item);
+	forEachChild(inner, [&function](uint8_t, Node* child) { forEachRec(child, function); });
+}
+
+template<typename I>
+template<typename Function>
+void ART<I>::forEach(Function function)
+{
+	forEachRec(root, function);
+}
+
+template<typename I>
+template<typename Function>
+void ART<I>::forEach(Function function) const
+{
+	auto constFunction = [&function](std::string_view key, const Item &item) { function(key, item); };
+	forEachRec(root, constFunction);
+}
+
+template<typename I>
+template<typename Function>
+void ART<I>::forEachWithPrefix(std::string_view keyPrefix, Function function)
+{
+	Node* current = root;
+	size_t depth = 0;
+	while (current != nullptr)
+	{
+		if (current->type == LeafType)
+		{
+			Leaf* leaf = static_cast<Leaf*>(current);
+			if (leaf->key.size() >= keyPrefix.size() && memcmp(leaf->key.data(), keyPrefix.data(), keyPrefix.size()) == 0)
+				function(std::string_view(leaf->key), leaf->item);
+			return;
+		}
+
+		Inner* inner = static_cast<Inner*>(current);
+		const std::string &prefix = inner->prefix;
+		size_t remaining = keyPrefix.size() - depth;
+		if (memcmp(prefix.data(), keyPrefix.data() + depth, std::min(remaining, prefix.size())) != 0)
+			return;
+
+		//The searched prefix ends within this node's path, everything below matches
+		if (remaining <= prefix.size())
+		{
+			forEachRec(current, function);
+			return;
+		}
+		depth += prefix.size();
+
+		Node** child = findChild(inner, static_cast<uint8_t>(keyPrefix[depth]));
+		if (child == nullptr)
+			return;
+		current = *child;
+		depth++;
+	}
+}
+
+template<typename I>
+template<typename Function>
+void ART<I>::forEachWithPrefix(std::string_view keyPrefix, Function function) const
+{
+	auto constFunction = [&function](std::string_view key, const Item &item) { function(key, item); };
+	const_cast<ART*>(this)->forEachWithPrefix(keyPrefix, constFunction);
+}
+
+template<typename I>
+bool ART<I>::checkInvariants() const
+{
+	std::string previous;
+	size_t visited = 0;
+	return checkInvariantsRec(root, previous, visited) && visited == entries;
+}
+
+//Keys have to come out of the walk in increasing order, which also proves every leaf sits on its own path,
+//and inner nodes need at least two entries with a count matching their children
+template<typename I>
+bool ART<I>::checkInvariantsRec(const Node* current, std::string &previous, size_t &visited)
+{
+	if (current == nullptr)
+		return true;
+
+	auto visit = [&previous, &visited](const Leaf* leaf)
+	{
+		if (visited > 0 && !(previous < leaf->key))
+			return false;
+		previous = leaf->key;
+		visited++;
+		return true;
+	};
+
+	if (current->type == LeafType)
+		return visit(static_cast<const Leaf*>(current));
+
+	const Inner* inner = static_cast<const Inner*>(current);
+	if (inner->terminal != nullptr && !visit(inner->terminal))
+		return false;
+
+	size_t children = 0;
+	bool valid = true;
+	forEachChild(inner, [&](uint8_t, Node* child)
+	{
+		children++;
+		valid = valid && child != nullptr && checkInvariantsRec(child, previous, visited);
+	});
+	return valid && children == inner->count && children + (inner->terminal != nullptr ? 1 : 0) >= 2;
+}
+
+template<typename I>
+void ART<I>::printEntries() const
+{
+	std::cout << *this;
+}
+
+template<typename I>
+void ART<I>::printTree() const
+{
+	printTreeRec(root, 0);
+}
+
+template<typename I>
+void ART<I>::printTreeRec(const Node* current, int indent)
+{
+	if (current == nullptr)
+		return;
+
+	if (current->type == LeafType)
+	{
+		const Leaf* leaf = static_cast<const Leaf*>(current);
+		std::cout << std::string(indent, '\t') << leaf->key << " *" << leaf->item << std::endl;
+		return;
+	}
+
+	static const char* names[] = { "leaf", "node4", "node16", "node48", "node256" };
+	const Inner* inner = static_cast<const Inner*>(current);
+	std::cout << std::string(indent, '\t') << names[inner->type] << " \"" << inner->prefix << "\"" << std::endl;
+	if (inner->terminal != nullptr)
+		printTreeRec(inner->terminal, indent + 1);
+	forEachChild(inner, [indent](uint8_t, Node* child) { printTreeRec(child, indent + 1); });
+}
+
+template<typename I>
+std::ostream & operator<<(std::ostream &os, const ART<I> &tree)
+{
+	tree.forEach([&os](std::string_view key, const I &item) { os << key << " " << item << std::endl; });
+	return os;
+}
+
+#endif // !ART_H
@@ -4,184 +4,661 @@
 #include <string>
 #include <iostream>
 #include <algorithm>
+#include <functional>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
 #include <assert.h>
 
+#include "NodePool.h"
+#include "TreeIterator.h"
+#include "TreeBatch.h"
+#include "KeyTraits.h"
+#include "FlatSnapshot.h"
+#include "StaticSearchTree.h"
+#include "ContainerStats.h"
 
-template<typename K, typename I>
+
+template<typename K, typename I, template<typename> class Allocator = NodePool, typename C = std::less<K>>
 class AVL
 {
 public:
 	using Key = K;
 	using Item = I;
+	using Compare = C;
 
 
 	void insert(Key, Item);
-	void remove(Key);
-	Item* lookup(Key);
+	void remove(const Key &);
+	Item* lookup(const Key &);
+
+	//Heterogeneous overloads for types comparable with Key, e.g. std::string_view for std::string keys
+	template<typename KeyLike, typename = EnableIfOrderedKey<K, KeyLike, Compare>>
+	void remove(const KeyLike &);
+	template<typename KeyLike, typename = EnableIfOrderedKey<K, KeyLike, Compare>>
+	Item* lookup(const KeyLike &);
+
+	//Looks up count keys at once, storing the item of each, or null, in results.
+	//The descents are interleaved so that their cache misses overlap, see TreeBatch.h
+	void lookupBatch(const Key*, size_t, Item**);
+	//Inserts items[i] under keys[i], or assigns it when the key is present, for every i < count.
+	//Present keys are found in interleaved groups, the absent ones are inserted along paths that are cached by then
+	void insertBatch(const Key*, const Item*, size_t);
+
+	//Constructs the item from args only if the key is absent, returns the item and whether it was inserted
+	template<typename... Args>
+	std::pair<Item*, bool> try_emplace(const Key &, Args&&...);
+	template<typename... Args>
+	std::pair<Item*, bool> try_emplace(Key &&, Args&&...);
+	//Like try_emplace, the key is passed on its own and only the item is built from args
+	template<typename... Args>
+	std::pair<Item*, bool> emplace(const Key &, Args&&...);
+	template<typename... Args>
+	std::pair<Item*, bool> emplace(Key &&, Args&&...);
+
+	//Inserts, or assigns to the existing item
+	template<typename ItemArg>
+	std::pair<Item*, bool> insert_or_assign(const Key &, ItemArg &&);
+	template<typename ItemArg>
+	std::pair<Item*, bool> insert_or_assign(Key &&, ItemArg &&);
+
+	void clear();
+
+	//Replaces the contents with the (key, item) pairs in [first, last), building a perfectly balanced tree.
+	//Sorted input is built in linear time, anything else is sorted first. For repeated keys the last item wins.
+	template<typename InputIterator>
+	void assign(InputIterator, InputIterator);
+
+	//Join based bulk operations: trees are cut and reassembled along O(log n) paths instead of entry by entry,
+	//and the independent halves of large set operations run on separate threads.
+	//The other tree, which has to use an equivalent comparator, is left empty and its nodes are taken over
+
+	//Moves the entries with keys not less than the given key into greater, replacing its contents. The tree is cut
+	//in O(log n), with a pooling allocator the moved entries are then copied into nodes of greater's pool
+	void split(const Key &, AVL &greater);
+	//Appends the entries of greater in O(log n) when its keys all come after the keys here, otherwise merges them as unionWith
+	void join(AVL &greater);
+	//Adds the entries of other, for keys present in both the item of other replaces the one here, as insert does.
+	//O(m log(n / m + 1)) for trees of sizes m <= n, against O(m log n) for inserting one by one
+	void unionWith(AVL &other);
+	//Keeps only the entries whose keys are in other as well
+	void intersectWith(AVL &other);
+	//Removes the entries whose keys are in other
+	void difference(AVL &other);
+
+	//Writes the entries to a sorted, versioned and checksummed flat file, see FlatSnapshot.h.
+	//Key and Item must be trivially copyable. Returns false if the file could not be written
+	bool saveSnapshot(const std::string &) const;
+	//Replaces the contents with a file written by saveSnapshot. The file is mapped and lookups binary search it in place,
+	//the tree is only built on the first write, clear or non-const traversal, const members read the mapped file.
+	//Returns false, leaving the contents unchanged, if the file cannot be read, has another format or, with verify set,
+	//is corrupt. Verifying checks the checksum and key order in a pass over the whole file, O(n), reading every page
+	//the lazy mapping would skip. Without it only the header is checked, lookups on a corrupt file go wrong silently
+	//and building the tree throws std::runtime_error if the keys turn out to be out of order
+	bool loadSnapshot(const std::string &, bool verify = true);
+
+	//Copies the entries into an immutable, pointer free StaticSearchTree for read only use, see StaticSearchTree.h
+	StaticSearchTree<Key, Item, Compare> freeze() const;
 
 	void printEntries();
 	void printTree();
 
+	//Height of the tree, derived from the balance factors in O(log n)
+	int height() const;
+
+	//Order statistics in O(log n), every node counts the entries of its subtree
+	size_t size() const;
+	//Number of keys less than the given key
+	size_t rank(const Key &) const;
+	//Number of keys with lo <= key <= hi
+	size_t countInRange(const Key &, const Key &) const;
+	//Walks the whole tree checking key order, balance factors, subtree sizes and the AVL height invariant
+	bool checkInvariants() const;
+
+#ifdef CONTAINERS_ENABLE_STATS
+	//Counters since construction, with the current height, node count and allocator footprint
+	ContainerStats stats() const;
+#endif
 
-	friend std::ostream & operator<<(std::ostream &, const AVL &);
+
+	template<typename KT, typename IT, template<typename> class AT, typename CT>
+	friend std::ostream & operator<<(std::ostream &, const AVL<KT, IT, AT, CT> &);
 
 
 
 	AVL() = default;
+	explicit AVL(const Compare &);
+	template<typename InputIterator>
+	AVL(InputIterator, InputIterator, const Compare & = Compare());
+	AVL(const AVL &) = delete;
+	AVL &operator=(const AVL &) = delete;
 	~AVL();
 
 private:
 	struct Node;
-	static Item* lookupRec(Key, Node*);
-	static void insertRec(Key, Item, Node*&);
+	using NodeAllocator = Allocator<Node>;
+
+	//A link on the descent path and the side (-1 left, +1 right) taken below it
+	struct PathEntry
+	{
+		Node** link;
+		short int direction;
+	};
+
+	//An AVL tree of height 92 holds more than 2^64 nodes, so the path stack never overflows
+	static const int maxDepth = 96;
+
+	template<typename T>
+	using Path = FixedStack<T, maxDepth>;
+
+	//The join algorithms need subtree heights, which the balance factors only give relative to the parent
+	struct Subtree
+	{
+		Node* root;
+		int height;
+	};
+
+	//A subtree cut at a key: the entries ordered before and after it, and the detached node holding the key, if any
+	struct SplitResult
+	{
+		Subtree less;
+		Node* found;
+		Subtree greater;
+	};
+
+	//Set operations on fewer entries than this are not worth a thread
+	static const size_t parallelCutoff = 1 << 15;
+
+	template<typename KeyLike>
+	Item* lookupNode(const KeyLike &, Node*);
+	template<typename KeyArg, typename... Args>
+	std::pair<Node*, bool> insertNode(Node*&, KeyArg &&, Args&&...);
+	template<typename KeyLike>
+	void removeNode(const KeyLike &, Node*&);
+	Node* buildBalancedRec(std::pair<Key, Item>*, size_t);
+	Node* buildFromSnapshotRec(const Key*, const Item*, size_t);
+	void materialize();
+	//One three way comparison per node, see ThreeWayCompare in KeyTraits.h
+	template<typename Left, typename Right>
+	int compareKeys(const Left &a, const Right &b) const { return ThreeWayCompare<Compare>::compare(keyLess, a, b); }
+	//In key order, from the loaded snapshot if there is one, without building the tree
+	template<typename Function>
+	void forEachEntry(Function) const;
 	static void printEntriesRec(std::ostream &, Node*);
+	static void printSnapshotRec(std::ostream &, const Key*, const Item*, size_t);
 	static void printTreeRec(Node*, int);
-	static void removeRec(Key, Node*&);
-	static Node* detachMinimumNode(Node*&);
+	int checkInvariantsRec(const Node*, const Key*, const Key*) const;
+	void deepDelete(Node*);
+	static int heightOfSize(size_t);
 	static void rebalance(Node*&);
+#ifdef CONTAINERS_ENABLE_STATS
+	static int rotationsNeeded(const Node*);
+#endif
 
 	static void rotateRight(Node* &);
 	static void rotateLeft(Node* &);
+	static int subtreeHeight(const Node*);
+	static Subtree leftOf(Subtree);
+	static Subtree rightOf(Subtree);
+	static Subtree joinTrees(Subtree, Node*, Subtree);
+	static Subtree joinRight(Subtree, Node*, Subtree);
+	static Subtree joinLeft(Subtree, Node*, Subtree);
+	static Subtree joinTrees(Subtree, Subtree);
+	static Subtree splitLast(Subtree, Node* &);
+	SplitResult splitAt(Subtree, const Key &) const;
+	Subtree unionRec(Subtree, Subtree, std::vector<Node*> &, int) const;
+	Subtree intersectRec(Subtree, Subtree, std::vector<Node*> &, int) const;
+	Subtree differenceRec(Subtree, Subtree, std::vector<Node*> &, int) const;
+	template<typename Left, typename Right>
+	static void runBoth(bool, Left, Right);
+	static int forkDepth();
+	Node* adoptRec(Node*, AVL &);
+	void recycle(Node*);
+	static size_t sizeOf(const Node*);
+	static void updateSize(Node*);
+	size_t rankOf(const Key &, bool) const;
 
 	Node* root = nullptr;
+	NodeAllocator nodes;
+	Compare keyLess;
+	//Set while the contents are served from a loaded snapshot, root is null then
+	std::unique_ptr<FlatSnapshot<Key, Item, Compare>> mapped;
+#ifdef CONTAINERS_ENABLE_STATS
+	ContainerStats statistics;
+#endif
+
+public:
+	//In-order iterators, no recursion involved. Entries expose key and item, the key must not be modified.
+	//Non-const iteration builds the tree from a loaded snapshot, const iteration reads the mapped file and
+	//returns entries by value, see EntryIterator in TreeIterator.h
+	using iterator = TreeIterator<Node, Path>;
+	using const_iterator = EntryIterator<Node, Path, Key, Item>;
+
+	iterator begin();
+	iterator end();
+	const_iterator begin() const;
+	const_iterator end() const;
+
+	//First entry whose key is not less than the given key
+	iterator lower_bound(const Key &);
+	const_iterator lower_bound(const Key &) const;
+	//First entry whose key is greater than the given key
+	iterator upper_bound(const Key &);
+	const_iterator upper_bound(const Key &) const;
+	//Entry with the given position in key order, counting from 0, or end() past the last one. O(log n)
+	iterator select(size_t);
+	const_iterator select(size_t) const;
+
+	//Calls function(key, item) for every entry with lo <= key <= hi in key order, in O(log n + k)
+	template<typename Function>
+	void forEachInRange(const Key &, const Key &, Function);
+	template<typename Function>
+	void forEachInRange(const Key &, const Key &, Function) const;
 };
 
-template<typename K, typename I>
-struct AVL<K, I>::Node
+template<typename K, typename I, template<typename> class A, typename C>
+struct AVL<K, I, A, C>::Node
 {
-	Key key;
+	const Key key;
 	Item item;
 	short int balance = 0;
+	size_t subtreeSize = 1;
 
 	Node* leftChild;
 	Node* rightChild;
 
-	Node(Key _key, Item _item)
+	template<typename KeyArg, typename... Args>
+	Node(KeyArg &&_key, Args&&... args) : key(std::forward<KeyArg>(_key)), item(std::forward<Args>(args)...)
 	{
-		key = _key;
-		item = _item;
 		leftChild = nullptr;
 		rightChild = nullptr;
 	}
 };
 
-template<typename K, typename I>
-AVL<K, I>::~AVL()
+template<typename K, typename I, template<typename> class A, typename C>
+AVL<K, I, A, C>::~AVL()
 {
+	deepDelete(root);
+	nodes.release();
 }
 
-template<typename K, typename I>
-typename AVL<K, I>::Item* AVL<K, I>::lookupRec(Key _key, Node* current)
+template<typename K, typename I, template<typename> class A, typename C>
+template<typename InputIterator>
+AVL<K, I, A, C>::AVL(InputIterator first, InputIterator last, const Compare &_keyLess) : keyLess(_keyLess)
 {
-	if (current == nullptr)
+	assign(first, last);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+AVL<K, I, A, C>::AVL(const Compare &_keyLess) : keyLess(_keyLess)
+{
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+template<typename InputIterator>
+void AVL<K, I, A, C>::assign(InputIterator first, InputIterator last)
+{
+	std::vector<std::pair<Key, Item>> entries(first, last);
+
+	auto keyOrder = [this](const std::pair<Key, Item> &a, const std::pair<Key, Item> &b) { return keyLess(a.first, b.first); };
+	if (!std::is_sorted(entries.begin(), entries.end(), keyOrder))
+		std::stable_sort(entries.begin(), entries.end(), keyOrder);
+
+	//Drop all but the last of every run of equal keys, as repeated inserts would
+	size_t unique = 0;
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		if (i + 1 < entries.size() && !keyLess(entries[i].first, entries[i + 1].first))
+			continue;
+		if (unique != i)
+			entries[unique] = std::move(entries[i]);
+		unique++;
+	}
+
+	clear();
+	root = buildBalancedRec(entries.data(), unique);
+	CONTAINERS_STATS(statistics.nodes = unique);
+}
+
+//Builds a subtree from sorted, unique entries by taking the middle entry as the root.
+//The left half is never smaller than the right one, so the balance is 0 or -1 everywhere
+template<typename K, typename I, template<typename> class A, typename C>
+typename AVL<K, I, A, C>::Node* AVL<K, I, A, C>::buildBalancedRec(std::pair<Key, Item>* entries, size_t count)
+{
+	if (count == 0)
 		return nullptr;
 
-	if (current->key == _key)
-		return &current->item;
-	else if (current->key < _key)
-		return lookupRec(_key, current->rightChild);
-	else
-		return lookupRec(_key, current->leftChild);
+	size_t middle = count / 2;
+	Node* localRoot = nodes.create(std::move(entries[middle].first), std::move(entries[middle].second));
+	localRoot->leftChild = buildBalancedRec(entries, middle);
+	localRoot->rightChild = buildBalancedRec(entries + middle + 1, count - middle - 1);
+	localRoot->balance = heightOfSize(count - middle - 1) - heightOfSize(middle);
+	localRoot->subtreeSize = count;
+	return localRoot;
 }
 
-//Return bool indicating whether 
-template<typename K, typename I>
-void AVL<K, I>::insertRec(Key _key, Item _item, Node* &current)
+//Height of the subtrees built by buildBalancedRec, which are complete except for the last level
+template<typename K, typename I, template<typename> class A, typename C>
+int AVL<K, I, A, C>::heightOfSize(size_t count)
 {
-	if (current == nullptr)
-		current = new Node(_key, _item);
-	else if (current->key == _key)
-		current->item = _item;
-	else if (current->key < _key)
-		insertRec(_key, _item, current->rightChild);
-	else
-		insertRec(_key, _item, current->leftChild);
+	int subtreeHeight = 0;
+	for (; count != 0; count >>= 1)
+		subtreeHeight++;
+	return subtreeHeight;
 }
 
-template<typename K, typename I>
-void AVL<K, I>::removeRec(Key _key, Node* &current)
+//Same shape as buildBalancedRec, copying out of the snapshot
+template<typename K, typename I, template<typename> class A, typename C>
+typename AVL<K, I, A, C>::Node* AVL<K, I, A, C>::buildFromSnapshotRec(const Key* keys, const Item* items, size_t count)
 {
-	if (current == nullptr)
+	if (count == 0)
+		return nullptr;
+
+	size_t middle = count / 2;
+	Node* localRoot = nodes.create(keys[middle], items[middle]);
+	localRoot->leftChild = buildFromSnapshotRec(keys, items, middle);
+	localRoot->rightChild = buildFromSnapshotRec(keys + middle + 1, items + middle + 1, count - middle - 1);
+	localRoot->balance = heightOfSize(count - middle - 1) - heightOfSize(middle);
+	localRoot->subtreeSize = count;
+	return localRoot;
+}
+
+//Replaces a loaded snapshot by the tree it describes and unmaps it. Const members read the snapshot instead,
+//so that concurrent readers never write
+template<typename K, typename I, template<typename> class A, typename C>
+void AVL<K, I, A, C>::materialize()
+{
+	if (mapped == nullptr)
 		return;
-	else if (current->key == _key)
+
+	//Only snapshots of trivially copyable entries can be loaded, this keeps other types, e.g. move-only items, compiling
+	if constexpr (std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Item>::value)
 	{
-		if (current->leftChild == nullptr && current->rightChild == nullptr)
-		{
-			delete current;
-			current = nullptr;
-		}
-		else if (current->leftChild == nullptr || current->rightChild == nullptr)
-		{
-			Node* nonLeaf = (current->leftChild == nullptr) ?
-				current->rightChild : current->leftChild;
+		//Keys out of order would make a tree that silently loses entries, the contents stay mapped when this throws
+		if (!mapped->verified() && !mapped->keysInOrder())
+			throw std::runtime_error("Snapshot keys are out of order, the file is corrupt");
 
-			delete current;
-			current = nonLeaf;
-		}
-		else
-		{
-			Node* bestFit = detachMinimumNode(current->rightChild);
+		std::unique_ptr<FlatSnapshot<Key, Item, Compare>> snapshot = std::move(mapped);
+		root = buildFromSnapshotRec(snapshot->keys(), snapshot->items(), snapshot->size());
+		CONTAINERS_STATS(statistics.nodes = snapshot->size());
+	}
+}
 
-			bestFit->leftChild = current->leftChild;
-			bestFit->rightChild = current->rightChild;
+template<typename K, typename I, template<typename> class A, typename C>
+bool AVL<K, I, A, C>::saveSnapshot(const std::string &path) const
+{
+	return FlatSnapshot<Key, Item, Compare>::save(path, [this](auto function) { forEachEntry(function); });
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+StaticSearchTree<typename AVL<K, I, A, C>::Key, typename AVL<K, I, A, C>::Item, C> AVL<K, I, A, C>::freeze() const
+{
+	size_t count = 0;
+	forEachEntry([&count](const Key &, const Item &) { count++; });
+	return StaticSearchTree<Key, Item, Compare>(count, [this](auto function) { forEachEntry(function); }, keyLess);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+template<typename Function>
+void AVL<K, I, A, C>::forEachEntry(Function function) const
+{
+	if (mapped != nullptr)
+	{
+		mapped->forEach(function);
+		return;
+	}
 
-			current = bestFit;
+	using NodeIterator = typename const_iterator::NodeIterator;
+	NodeIterator last = NodeIterator::end(root);
+	for (NodeIterator current = NodeIterator::first(root); current != last; ++current)
+		function(current->key, current->item);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+bool AVL<K, I, A, C>::loadSnapshot(const std::string &path, bool verify)
+{
+	std::unique_ptr<FlatSnapshot<Key, Item, Compare>> snapshot = FlatSnapshot<Key, Item, Compare>::open(path, verify, keyLess);
+	if (snapshot == nullptr)
+		return false;
+
+	clear();
+	mapped = std::move(snapshot);
+	return true;
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+void AVL<K, I, A, C>::clear()
+{
+	mapped.reset();
+	deepDelete(root);
+	nodes.release();
+	root = nullptr;
+	CONTAINERS_STATS(statistics.nodes = 0);
+}
+
+//Frees the nodes, the caller releases the allocator afterwards
+template<typename K, typename I, template<typename> class A, typename C>
+void AVL<K, I, A, C>::deepDelete(Node* current)
+{
+	//A pool frees its chunks wholesale, so nodes without destructors need no walk
+	if (current == nullptr || (NodeAllocator::releasesInBulk && std::is_trivially_destructible<Node>::value))
+		return;
+
+	deepDelete(current->leftChild);
+	deepDelete(current->rightChild);
+	nodes.destroy(current);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+template<typename KeyLike>
+typename AVL<K, I, A, C>::Item* AVL<K, I, A, C>::lookupNode(const KeyLike &_key, Node* current)
+{
+	CONTAINERS_STATS(size_t depth = 0);
+	while (current != nullptr)
+	{
+		CONTAINERS_STATS(depth++);
+		int order = compareKeys(current->key, _key);
+		if (order == 0)
+		{
+			CONTAINERS_STATS(statistics.recordLookup(depth));
+			return &current->item;
 		}
+		current = (order < 0) ? current->rightChild : current->leftChild;
 	}
-	else if (current->key < _key)
-		removeRec(_key, current->rightChild);
-	else
-		removeRec(_key, current->leftChild);
+
+	CONTAINERS_STATS(statistics.recordLookup(depth));
+	return nullptr;
 }
 
-template<typename K, typename I>
-typename AVL<K, I>::Node* AVL<K, I>::detachMinimumNode(Node* &current)
+//Iterative insertion: the descent is recorded on an explicit path stack,
+//balance factors are then updated bottom-up until the subtree height stops growing.
+//Returns the node holding the key and whether it was created; args are only used when it is
+template<typename K, typename I, template<typename> class A, typename C>
+template<typename KeyArg, typename... Args>
+std::pair<typename AVL<K, I, A, C>::Node*, bool> AVL<K, I, A, C>::insertNode(Node* &localRoot, KeyArg &&_key, Args&&... args)
 {
-	if (current->leftChild == nullptr)
+	PathEntry path[maxDepth];
+	int depth = 0;
+
+	Node** link = &localRoot;
+	while (*link != nullptr)
 	{
-		Node* temp = current;
-		current = current->rightChild;
-		return temp;
+		Node* current = *link;
+		int order = compareKeys(current->key, _key);
+		if (order == 0)
+			return { current, false };
+
+		assert(depth < maxDepth);
+		short int direction = (order < 0) ? 1 : -1;
+		path[depth++] = { link, direction };
+		link = (direction == 1) ? &current->rightChild : &current->leftChild;
 	}
 
-	return detachMinimumNode(current->leftChild);
+	Node* created = nodes.create(std::forward<KeyArg>(_key), std::forward<Args>(args)...);
+	*link = created;
+	for (int i = 0; i < depth; i++)
+		(*path[i].link)->subtreeSize++;
+	CONTAINERS_STATS(statistics.inserts++);
+	CONTAINERS_STATS(statistics.nodes++);
+
+	//Retrace: one rotation at most restores the height the subtree had before the insertion
+	while (depth > 0)
+	{
+		PathEntry &entry = path[--depth];
+		Node* &current = *entry.link;
+		current->balance += entry.direction;
+
+		if (current->balance == 0)
+			break;
+		if (current->balance == 2 || current->balance == -2)
+		{
+			CONTAINERS_STATS(statistics.insertRotations += rotationsNeeded(current));
+			rebalance(current);
+			break;
+		}
+	}
 
+	return { created, true };
 }
 
-template<typename K, typename I>
-void AVL<K, I>::rebalance(Node* &localRoot)
+//Iterative removal: a node with two children is replaced by its in-order successor,
+//whose descent is appended to the same path stack before retracing
+template<typename K, typename I, template<typename> class A, typename C>
+template<typename KeyLike>
+void AVL<K, I, A, C>::removeNode(const KeyLike &_key, Node* &localRoot)
 {
-	short int localBalance = localRoot->balance;
-	short int rightChildBalance = localRoot->rightChild->balance;
-	short int leftChildBalance = localRoot->leftChild->balance;
+	PathEntry path[maxDepth];
+	int depth = 0;
 
-	if (localBalance == 2 && rightChildBalance == 1)
-		rotateLeft(localRoot);
+	Node** link = &localRoot;
+	while (*link != nullptr)
+	{
+		Node* current = *link;
+		int order = compareKeys(current->key, _key);
+		if (order == 0)
+			break;
 
-	if (localBalance == 2 && rightChildBalance == 0)
-		rotateLeft(localRoot);
+		assert(depth < maxDepth);
+		short int direction = (order < 0) ? 1 : -1;
+		path[depth++] = { link, direction };
+		link = (direction == 1) ? &current->rightChild : &current->leftChild;
+	}
 
-	if (localBalance == 2 && rightChildBalance == -1)
+	Node* target = *link;
+	if (target == nullptr)
+		return;
+
+	//Every node left on the path loses one entry, apart from a successor moved into the removed node's place
+	int replacedDepth = -1;
+	if (target->leftChild == nullptr || target->rightChild == nullptr)
 	{
-		rotateRight(localRoot->rightChild);
-		rotateLeft(localRoot);
+		*link = (target->leftChild == nullptr) ? target->rightChild : target->leftChild;
 	}
+	else
+	{
+		int targetDepth = depth;
+		path[depth++] = { link, 1 };
 
-	if (localBalance == -2 && leftChildBalance == -1)
-		rotateRight(localRoot);
+		Node** successorLink = &target->rightChild;
+		while ((*successorLink)->leftChild != nullptr)
+		{
+			assert(depth < maxDepth);
+			path[depth++] = { successorLink, -1 };
+			successorLink = &(*successorLink)->leftChild;
+		}
 
-	if (localBalance == -2 && leftChildBalance == 0)
-		rotateRight(localRoot);
+		//Detach the successor and move it into the place of the removed node
+		Node* bestFit = *successorLink;
+		*successorLink = bestFit->rightChild;
 
-	if (localBalance == -2 && leftChildBalance == 1)
+		bestFit->leftChild = target->leftChild;
+		bestFit->rightChild = target->rightChild;
+		bestFit->balance = target->balance;
+		bestFit->subtreeSize = target->subtreeSize - 1;
+		*link = bestFit;
+		replacedDepth = targetDepth;
+
+		//The entry below the replaced node pointed into the removed node
+		if (depth > targetDepth + 1)
+			path[targetDepth + 1].link = &bestFit->rightChild;
+	}
+
+	for (int i = 0; i < depth; i++)
+	{
+		if (i != replacedDepth)
+			(*path[i].link)->subtreeSize--;
+	}
+
+	nodes.destroy(target);
+	CONTAINERS_STATS(statistics.removes++);
+	CONTAINERS_STATS(statistics.nodes--);
+
+	//Retrace: keep going while the subtree height has shrunk
+	while (depth > 0)
 	{
-		rotateLeft(localRoot->leftChild);
+		PathEntry &entry = path[--depth];
+		Node* &current = *entry.link;
+		current->balance -= entry.direction;
+
+		if (current->balance == 1 || current->balance == -1)
+			break;
+		if (current->balance == 2 || current->balance == -2)
+		{
+			CONTAINERS_STATS(statistics.removeRotations += rotationsNeeded(current));
+			rebalance(current);
+			if (current->balance != 0)
+				break;
+		}
+	}
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+void AVL<K, I, A, C>::rebalance(Node* &localRoot)
+{
+	if (localRoot->balance == 2)
+	{
+		if (localRoot->rightChild->balance == -1)
+			rotateRight(localRoot->rightChild);
+		rotateLeft(localRoot);
+	}
+	else if (localRoot->balance == -2)
+	{
+		if (localRoot->leftChild->balance == 1)
+			rotateLeft(localRoot->leftChild);
 		rotateRight(localRoot);
 	}
 }
 
-template<typename K, typename I>
-void AVL<K, I>::rotateRight(Node* &localRoot)
+#ifdef CONTAINERS_ENABLE_STATS
+//Two when rebalance has to straighten a zig-zag first
+template<typename K, typename I, template<typename> class A, typename C>
+int AVL<K, I, A, C>::rotationsNeeded(const Node* localRoot)
+{
+	if (localRoot->balance == 2)
+		return (localRoot->rightChild->balance == -1) ? 2 : 1;
+	return (localRoot->leftChild->balance == 1) ? 2 : 1;
+}
+#endif
+
+template<typename K, typename I, template<typename> class A, typename C>
+size_t AVL<K, I, A, C>::sizeOf(const Node* current)
+{
+	return (current == nullptr) ? 0 : current->subtreeSize;
+}
+
+//Recomputes the size of a node whose children have changed
+template<typename K, typename I, template<typename> class A, typename C>
+void AVL<K, I, A, C>::updateSize(Node* current)
+{
+	current->subtreeSize = sizeOf(current->leftChild) + sizeOf(current->rightChild) + 1;
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+void AVL<K, I, A, C>::rotateRight(Node* &localRoot)
 {
 	//Assertions before dereferencing a pointer
 	Node* b = localRoot;
@@ -194,14 +671,16 @@ void AVL<K, I>::rotateRight(Node* &localRoot)
 	b->leftChild = a->rightChild;
 	a->rightChild = b;
 	localRoot = a;
+	updateSize(b);
+	updateSize(a);
 
 	//Update Node balance
-	b->balance = b->balance + 1 + std::max(-a->balance, 0);
-	a->balance = a->balance + 1 + std::max(b->balance, 0);
+	b->balance = b->balance + 1 + std::max<short int>(-a->balance, 0);
+	a->balance = a->balance + 1 + std::max<short int>(b->balance, 0);
 }
 
-template<typename K, typename I>
-void AVL<K, I>::rotateLeft(Node* &localRoot)
+template<typename K, typename I, template<typename> class A, typename C>
+void AVL<K, I, A, C>::rotateLeft(Node* &localRoot)
 {
 	//Assertions before dereferencing a pointer;
 	Node* a = localRoot;
@@ -213,44 +692,777 @@ void AVL<K, I>::rotateLeft(Node* &localRoot)
 	a->rightChild = b->leftChild;
 	b->leftChild = a;
 	localRoot = b;
+	updateSize(a);
+	updateSize(b);
 
 	//Update Node balance
-	a->balance = a->balance - 1 - max(b->balance, 0);
-	b->balance = b->balance - 1 - max(-a->balance, 0);
+	a->balance = a->balance - 1 - std::max<short int>(b->balance, 0);
+	b->balance = b->balance - 1 - std::max<short int>(-a->balance, 0);
+}
+
+//Height from the root along the taller side, O(log n)
+template<typename K, typename I, template<typename> class A, typename C>
+int AVL<K, I, A, C>::subtreeHeight(const Node* current)
+{
+	int treeHeight = 0;
+	for (; current != nullptr; ++treeHeight)
+		current = (current->balance > 0) ? current->rightChild : current->leftChild;
+
+	return treeHeight;
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+typename AVL<K, I, A, C>::Subtree AVL<K, I, A, C>::leftOf(Subtree tree)
+{
+	return { tree.root->leftChild, tree.height - (tree.root->balance <= 0 ? 1 : 2) };
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+typename AVL<K, I, A, C>::Subtree AVL<K, I, A, C>::rightOf(Subtree tree)
+{
+	return { tree.root->rightChild, tree.height - (tree.root->balance >= 0 ? 1 : 2) };
 }
 
-template<typename K, typename I>
-void AVL<K, I>::insert(Key _key, Item _item)
+//Joins two subtrees, all keys of left before those of right, with middle between them.
+//When the heights differ by more than one, middle is hung into the spine of the taller tree at the height
+//of the shorter one and the rotations of an insertion repair the balance on the way up. O(difference in height)
+template<typename K, typename I, template<typename> class A, typename C>
+typename AVL<K, I, A, C>::Subtree AVL<K, I, A, C>::joinTrees(Subtree left, Node* middle, Subtree right)
 {
-	insertRec(_key, _item, root);
+	if (left.height > right.height + 1)
+		return joinRight(left, middle, right);
+	if (right.height > left.height + 1)
+		return joinLeft(left, middle, right);
+
+	middle->leftChild = left.root;
+	middle->rightChild = right.root;
+	middle->balance = right.height - left.height;
+	updateSize(middle);
+	return { middle, std::max(left.height, right.height) + 1 };
 }
 
-template<typename K, typename I>
-void AVL<K, I>::remove(Key _key)
+//Left is the taller tree, the join descends its right spine
+template<typename K, typename I, template<typename> class A, typename C>
+typename AVL<K, I, A, C>::Subtree AVL<K, I, A, C>::joinRight(Subtree left, Node* middle, Subtree right)
 {
-	removeRec(_key, root);
+	Node* current = left.root;
+	int leftHeight = leftOf(left).height;
+	Subtree joined = joinTrees(rightOf(left), middle, right);
+
+	current->rightChild = joined.root;
+	current->balance = joined.height - leftHeight;
+	updateSize(current);
+	if (current->balance <= 1)
+		return { current, std::max(leftHeight, joined.height) + 1 };
+
+	//A single rotation over a balanced child leaves the subtree one level taller than that child, otherwise as tall
+	int rebalancedHeight = (joined.root->balance == 0) ? joined.height + 1 : joined.height;
+	rebalance(current);
+	return { current, rebalancedHeight };
 }
 
-template<typename K, typename I>
-typename AVL<K, I>::Item* AVL<K, I>::lookup(Key _key)
+template<typename K, typename I, template<typename> class A, typename C>
+typename AVL<K, I, A, C>::Subtree AVL<K, I, A, C>::joinLeft(Subtree left, Node* middle, Subtree right)
 {
-	return lookupRec(_key, root);
+	Node* current = right.root;
+	int rightHeight = rightOf(right).height;
+	Subtree joined = joinTrees(left, middle, leftOf(right));
+
+	current->leftChild = joined.root;
+	current->balance = rightHeight - joined.height;
+	updateSize(current);
+	if (current->balance >= -1)
+		return { current, std::max(rightHeight, joined.height) + 1 };
+
+	int rebalancedHeight = (joined.root->balance == 0) ? joined.height + 1 : joined.height;
+	rebalance(current);
+	return { current, rebalancedHeight };
 }
 
-template<typename K, typename I>
-void AVL<K, I>::printEntries()
+//Joins two subtrees without a middle node, the last node of left takes its place
+template<typename K, typename I, template<typename> class A, typename C>
+typename AVL<K, I, A, C>::Subtree AVL<K, I, A, C>::joinTrees(Subtree left, Subtree right)
 {
+	if (left.root == nullptr)
+		return right;
+	if (right.root == nullptr)
+		return left;
+
+	Node* last;
+	Subtree rest = splitLast(left, last);
+	return joinTrees(rest, last, right);
+}
+
+//Detaches the node with the greatest key, returning the rest of the subtree
+template<typename K, typename I, template<typename> class A, typename C>
+typename AVL<K, I, A, C>::Subtree AVL<K, I, A, C>::splitLast(Subtree tree, Node* &last)
+{
+	Node* current = tree.root;
+	if (current->rightChild == nullptr)
+	{
+		last = current;
+		return leftOf(tree);
+	}
+
+	Subtree rest = splitLast(rightOf(tree), last);
+	return joinTrees(leftOf(tree), current, rest);
+}
+
+//Cuts a subtree at a key: every node on the search path is joined back onto the side it belongs to
+template<typename K, typename I, template<typename> class A, typename C>
+typename AVL<K, I, A, C>::SplitResult AVL<K, I, A, C>::splitAt(Subtree tree, const Key &_key) const
+{
+	if (tree.root == nullptr)
+		return { { nullptr, 0 }, nullptr, { nullptr, 0 } };
+
+	Node* current = tree.root;
+	Subtree left = leftOf(tree);
+	Subtree right = rightOf(tree);
+	int order = compareKeys(current->key, _key);
+	if (order == 0)
+	{
+		current->leftChild = nullptr;
+		current->rightChild = nullptr;
+		current->balance = 0;
+		current->subtreeSize = 1;
+		return { left, current, right };
+	}
+
+	if (order > 0)
+	{
+		SplitResult parts = splitAt(left, _key);
+		parts.greater = joinTrees(parts.greater, current, right);
+		return parts;
+	}
+
+	SplitResult parts = splitAt(right, _key);
+	parts.less = joinTrees(left, current, parts.less);
+	return parts;
+}
+
+//Runs left on a new thread and right on this one when parallel is set, one after the other otherwise
+template<typename K, typename I, template<typename> class A, typename C>
+template<typename Left, typename Right>
+void AVL<K, I, A, C>::runBoth(bool parallel, Left left, Right right)
+{
+	if (!parallel)
+	{
+		left();
+		right();
+		return;
+	}
+
+	std::future<void> leftDone = std::async(std::launch::async, left);
+	right();
+	leftDone.get();
+}
+
+//Levels of the recursion that may fork, for up to twice as many threads as cores as the halves are rarely even
+template<typename K, typename I, template<typename> class A, typename C>
+int AVL<K, I, A, C>::forkDepth()
+{
+	unsigned int cores = std::thread::hardware_concurrency();
+	if (cores <= 1)
+		return 0;
+
+	int depth = 1;
+	for (; cores > 1; cores = (cores + 1) / 2)
+		depth++;
+	return depth;
+}
+
+//The set operations take the root of one tree as the pivot, split the other tree at its key and recurse into the
+//two pairs of halves, which share no nodes and can run concurrently. The results are joined around the pivot.
+//Nodes that drop out are only collected, they are destroyed afterwards by the calling thread, as the allocator is not shared
+template<typename K, typename I, template<typename> class A, typename C>
+typename AVL<K, I, A, C>::Subtree AVL<K, I, A, C>::unionRec(Subtree tree, Subtree other, std::vector<Node*> &dropped, int forks) const
+{
+	if (tree.root == nullptr)
+		return other;
+	if (other.root == nullptr)
+		return tree;
+
+	bool parallel = forks > 0 && sizeOf(tree.root) + sizeOf(other.root) >= parallelCutoff;
+	Node* pivot = other.root;
+	Subtree otherLeft = leftOf(other);
+	Subtree otherRight = rightOf(other);
+	SplitResult parts = splitAt(tree, pivot->key);
+	if (parts.found != nullptr)
+		dropped.push_back(parts.found);
+
+	Subtree left, right;
+	std::vector<Node*> leftDropped;
+	std::vector<Node*> &leftTarget = parallel ? leftDropped : dropped;
+	int nextForks = parallel ? forks - 1 : forks;
+	runBoth(parallel,
+		[&] { left = unionRec(parts.less, otherLeft, leftTarget, nextForks); },
+		[&] { right = unionRec(parts.greater, otherRight, dropped, nextForks); });
+	dropped.insert(dropped.end(), leftDropped.begin(), leftDropped.end());
+
+	return joinTrees(left, pivot, right);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+typename AVL<K, I, A, C>::Subtree AVL<K, I, A, C>::intersectRec(Subtree tree, Subtree other, std::vector<Node*> &dropped, int forks) const
+{
+	if (tree.root == nullptr || other.root == nullptr)
+	{
+		if (tree.root != nullptr)
+			dropped.push_back(tree.root);
+		if (other.root != nullptr)
+			dropped.push_back(other.root);
+		return { nullptr, 0 };
+	}
+
+	bool parallel = forks > 0 && sizeOf(tree.root) + sizeOf(other.root) >= parallelCutoff;
+	Node* pivot = tree.root;
+	Subtree treeLeft = leftOf(tree);
+	Subtree treeRight = rightOf(tree);
+	SplitResult parts = splitAt(other, pivot->key);
+
+	Subtree left, right;
+	std::vector<Node*> leftDropped;
+	std::vector<Node*> &leftTarget = parallel ? leftDropped : dropped;
+	int nextForks = parallel ? forks - 1 : forks;
+	runBoth(parallel,
+		[&] { left = intersectRec(treeLeft, parts.less, leftTarget, nextForks); },
+		[&] { right = intersectRec(treeRight, parts.greater, dropped, nextForks); });
+	dropped.insert(dropped.end(), leftDropped.begin(), leftDropped.end());
+
+	if (parts.found != nullptr)
+	{
+		dropped.push_back(parts.found);
+		return joinTrees(left, pivot, right);
+	}
+
+	pivot->leftChild = nullptr;
+	pivot->rightChild = nullptr;
+	dropped.push_back(pivot);
+	return joinTrees(left, right);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+typename AVL<K, I, A, C>::Subtree AVL<K, I, A, C>::differenceRec(Subtree tree, Subtree other, std::vector<Node*> &dropped, int forks) const
+{
+	if (tree.root == nullptr || other.root == nullptr)
+	{
+		if (other.root != nullptr)
+			dropped.push_back(other.root);
+		return tree;
+	}
+
+	bool parallel = forks > 0 && sizeOf(tree.root) + sizeOf(other.root) >= parallelCutoff;
+	Node* pivot = other.root;
+	Subtree otherLeft = leftOf(other);
+	Subtree otherRight = rightOf(other);
+	SplitResult parts = splitAt(tree, pivot->key);
+	if (parts.found != nullptr)
+		dropped.push_back(parts.found);
+	pivot->leftChild = nullptr;
+	pivot->rightChild = nullptr;
+	dropped.push_back(pivot);
+
+	Subtree left, right;
+	std::vector<Node*> leftDropped;
+	std::vector<Node*> &leftTarget = parallel ? leftDropped : dropped;
+	int nextForks = parallel ? forks - 1 : forks;
+	runBoth(parallel,
+		[&] { left = differenceRec(parts.less, otherLeft, leftTarget, nextForks); },
+		[&] { right = differenceRec(parts.greater, otherRight, dropped, nextForks); });
+	dropped.insert(dropped.end(), leftDropped.begin(), leftDropped.end());
+
+	return joinTrees(left, right);
+}
+
+//Copies a subtree of owner's nodes into nodes of this tree with the same shape, moving the items, and frees the originals
+template<typename K, typename I, template<typename> class A, typename C>
+typename AVL<K, I, A, C>::Node* AVL<K, I, A, C>::adoptRec(Node* source, AVL &owner)
+{
+	if (source == nullptr)
+		return nullptr;
+
+	Node* copy = nodes.create(source->key, std::move(source->item));
+	copy->balance = source->balance;
+	copy->subtreeSize = source->subtreeSize;
+	copy->leftChild = adoptRec(source->leftChild, owner);
+	copy->rightChild = adoptRec(source->rightChild, owner);
+	owner.nodes.destroy(source);
+	return copy;
+}
+
+//Destroys a detached subtree, returning its nodes to the allocator for reuse
+template<typename K, typename I, template<typename> class A, typename C>
+void AVL<K, I, A, C>::recycle(Node* current)
+{
+	if (current == nullptr)
+		return;
+
+	recycle(current->leftChild);
+	recycle(current->rightChild);
+	nodes.destroy(current);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+void AVL<K, I, A, C>::split(const Key &_key, AVL &greater)
+{
+	if (&greater == this)
+		return;
+
+	materialize();
+	greater.clear();
+
+	SplitResult parts = splitAt({ root, subtreeHeight(root) }, _key);
+	Subtree upper = parts.greater;
+	if (parts.found != nullptr)
+		upper = joinTrees({ nullptr, 0 }, parts.found, upper);
+	root = parts.less.root;
+
+	//Separately allocated nodes simply change owner, pooled ones live in chunks that stay with this tree
+	if constexpr (NodeAllocator::releasesInBulk)
+		greater.root = greater.adoptRec(upper.root, *this);
+	else
+		greater.root = upper.root;
+
+	CONTAINERS_STATS(statistics.nodes = sizeOf(root));
+	CONTAINERS_STATS(greater.statistics.nodes = sizeOf(greater.root));
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+void AVL<K, I, A, C>::join(AVL &greater)
+{
+	if (&greater == this)
+		return;
+
+	materialize();
+	greater.materialize();
+
+	const Node* last = root;
+	while (last != nullptr && last->rightChild != nullptr)
+		last = last->rightChild;
+	const Node* first = greater.root;
+	while (first != nullptr && first->leftChild != nullptr)
+		first = first->leftChild;
+	if (last != nullptr && first != nullptr && !keyLess(last->key, first->key))
+	{
+		unionWith(greater);
+		return;
+	}
+
+	nodes.merge(greater.nodes);
+	root = joinTrees({ root, subtreeHeight(root) }, { greater.root, subtreeHeight(greater.root) }).root;
+	greater.root = nullptr;
+
+	CONTAINERS_STATS(statistics.nodes = sizeOf(root));
+	CONTAINERS_STATS(greater.statistics.nodes = 0);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+void AVL<K, I, A, C>::unionWith(AVL &other)
+{
+	if (&other == this)
+		return;
+
+	materialize();
+	other.materialize();
+	nodes.merge(other.nodes);
+
+	std::vector<Node*> dropped;
+	root = unionRec({ root, subtreeHeight(root) }, { other.root, subtreeHeight(other.root) }, dropped, forkDepth()).root;
+	other.root = nullptr;
+	for (Node* node : dropped)
+		recycle(node);
+
+	CONTAINERS_STATS(statistics.nodes = sizeOf(root));
+	CONTAINERS_STATS(other.statistics.nodes = 0);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+void AVL<K, I, A, C>::intersectWith(AVL &other)
+{
+	if (&other == this)
+		return;
+
+	materialize();
+	other.materialize();
+	nodes.merge(other.nodes);
+
+	std::vector<Node*> dropped;
+	root = intersectRec({ root, subtreeHeight(root) }, { other.root, subtreeHeight(other.root) }, dropped, forkDepth()).root;
+	other.root = nullptr;
+	for (Node* node : dropped)
+		recycle(node);
+
+	CONTAINERS_STATS(statistics.nodes = sizeOf(root));
+	CONTAINERS_STATS(other.statistics.nodes = 0);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+void AVL<K, I, A, C>::difference(AVL &other)
+{
+	if (&other == this)
+	{
+		clear();
+		return;
+	}
+
+	materialize();
+	other.materialize();
+	nodes.merge(other.nodes);
+
+	std::vector<Node*> dropped;
+	root = differenceRec({ root, subtreeHeight(root) }, { other.root, subtreeHeight(other.root) }, dropped, forkDepth()).root;
+	other.root = nullptr;
+	for (Node* node : dropped)
+		recycle(node);
+
+	CONTAINERS_STATS(statistics.nodes = sizeOf(root));
+	CONTAINERS_STATS(other.statistics.nodes = 0);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+void AVL<K, I, A, C>::insert(Key _key, Item _item)
+{
+	insert_or_assign(std::move(_key), std::move(_item));
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+template<typename... Args>
+std::pair<typename AVL<K, I, A, C>::Item*, bool> AVL<K, I, A, C>::try_emplace(const Key &_key, Args&&... args)
+{
+	materialize();
+	std::pair<Node*, bool> result = insertNode(root, _key, std::forward<Args>(args)...);
+	return { &result.first->item, result.second };
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+template<typename... Args>
+std::pair<typename AVL<K, I, A, C>::Item*, bool> AVL<K, I, A, C>::try_emplace(Key &&_key, Args&&... args)
+{
+	materialize();
+	std::pair<Node*, bool> result = insertNode(root, std::move(_key), std::forward<Args>(args)...);
+	return { &result.first->item, result.second };
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+template<typename... Args>
+std::pair<typename AVL<K, I, A, C>::Item*, bool> AVL<K, I, A, C>::emplace(const Key &_key, Args&&... args)
+{
+	return try_emplace(_key, std::forward<Args>(args)...);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+template<typename... Args>
+std::pair<typename AVL<K, I, A, C>::Item*, bool> AVL<K, I, A, C>::emplace(Key &&_key, Args&&... args)
+{
+	return try_emplace(std::move(_key), std::forward<Args>(args)...);
+}
+
+//The item argument is only consumed by one of the construction or the assignment
+template<typename K, typename I, template<typename> class A, typename C>
+template<typename ItemArg>
+std::pair<typename AVL<K, I, A, C>::Item*, bool> AVL<K, I, A, C>::insert_or_assign(const Key &_key, ItemArg &&_item)
+{
+	std::pair<Item*, bool> result = try_emplace(_key, std::forward<ItemArg>(_item));
+	if (!result.second)
+		*result.first = std::forward<ItemArg>(_item);
+	return result;
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+template<typename ItemArg>
+std::pair<typename AVL<K, I, A, C>::Item*, bool> AVL<K, I, A, C>::insert_or_assign(Key &&_key, ItemArg &&_item)
+{
+	std::pair<Item*, bool> result = try_emplace(std::move(_key), std::forward<ItemArg>(_item));
+	if (!result.second)
+		*result.first = std::forward<ItemArg>(_item);
+	return result;
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+void AVL<K, I, A, C>::remove(const Key &_key)
+{
+	materialize();
+	removeNode(_key, root);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+template<typename KeyLike, typename>
+void AVL<K, I, A, C>::remove(const KeyLike &_key)
+{
+	materialize();
+	removeNode(_key, root);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+typename AVL<K, I, A, C>::Item* AVL<K, I, A, C>::lookup(const Key &_key)
+{
+	if (mapped != nullptr)
+		return mapped->lookup(_key);
+	return lookupNode(_key, root);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+template<typename KeyLike, typename>
+typename AVL<K, I, A, C>::Item* AVL<K, I, A, C>::lookup(const KeyLike &_key)
+{
+	if (mapped != nullptr)
+		return mapped->lookup(_key);
+	return lookupNode(_key, root);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+int AVL<K, I, A, C>::height() const
+{
+	//The tree built from a snapshot is the one buildFromSnapshotRec would make
+	if (mapped != nullptr)
+		return heightOfSize(mapped->size());
+	return subtreeHeight(root);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+size_t AVL<K, I, A, C>::size() const
+{
+	return (mapped != nullptr) ? mapped->size() : sizeOf(root);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+size_t AVL<K, I, A, C>::rank(const Key &_key) const
+{
+	return rankOf(_key, false);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+size_t AVL<K, I, A, C>::countInRange(const Key &lo, const Key &hi) const
+{
+	if (keyLess(hi, lo))
+		return 0;
+	return rankOf(hi, true) - rankOf(lo, false);
+}
+
+//Number of keys less than the given key, or not greater with inclusive set.
+//Every right turn passes the node and its whole left subtree
+template<typename K, typename I, template<typename> class A, typename C>
+size_t AVL<K, I, A, C>::rankOf(const Key &_key, bool inclusive) const
+{
+	if (mapped != nullptr)
+		return mapped->rank(_key, inclusive);
+
+	size_t result = 0;
+	for (const Node* current = root; current != nullptr; )
+	{
+		bool goRight = inclusive ? !keyLess(_key, current->key) : keyLess(current->key, _key);
+		if (goRight)
+		{
+			result += sizeOf(current->leftChild) + 1;
+			current = current->rightChild;
+		}
+		else
+			current = current->leftChild;
+	}
+	return result;
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+bool AVL<K, I, A, C>::checkInvariants() const
+{
+	//A snapshot only has its key order to check, the tree built from it is balanced by construction
+	if (mapped != nullptr)
+	{
+		const Key* keys = mapped->keys();
+		for (size_t i = 1; i < mapped->size(); i++)
+		{
+			if (!keyLess(keys[i - 1], keys[i]))
+				return false;
+		}
+		return true;
+	}
+	return checkInvariantsRec(root, nullptr, nullptr) >= 0;
+}
+
+//Returns the height of the subtree, or -1 if any node breaks the ordering,
+//has a stale balance factor or subtree size, or is out of balance
+template<typename K, typename I, template<typename> class A, typename C>
+int AVL<K, I, A, C>::checkInvariantsRec(const Node* current, const Key* lowerBound, const Key* upperBound) const
+{
+	if (current == nullptr)
+		return 0;
+
+	if ((lowerBound != nullptr && !keyLess(*lowerBound, current->key)) ||
+		(upperBound != nullptr && !keyLess(current->key, *upperBound)))
+		return -1;
+
+	int leftHeight = checkInvariantsRec(current->leftChild, lowerBound, &current->key);
+	int rightHeight = checkInvariantsRec(current->rightChild, &current->key, upperBound);
+	if (leftHeight < 0 || rightHeight < 0)
+		return -1;
+
+	int balance = rightHeight - leftHeight;
+	if (balance != current->balance || balance < -1 || balance > 1)
+		return -1;
+	if (current->subtreeSize != sizeOf(current->leftChild) + sizeOf(current->rightChild) + 1)
+		return -1;
+
+	return std::max(leftHeight, rightHeight) + 1;
+}
+
+//A loaded snapshot is searched key by key
+template<typename K, typename I, template<typename> class A, typename C>
+void AVL<K, I, A, C>::lookupBatch(const Key* keys, size_t count, Item** results)
+{
+	if (mapped != nullptr)
+	{
+		for (size_t i = 0; i < count; i++)
+			results[i] = mapped->lookup(keys[i]);
+		return;
+	}
+
+	lookupInterleaved(root, keys, count, results, keyLess);
+}
+
+//Nodes never move, so the items found for a group stay valid while its absent keys are inserted
+template<typename K, typename I, template<typename> class A, typename C>
+void AVL<K, I, A, C>::insertBatch(const Key* keys, const Item* items, size_t count)
+{
+	materialize();
+
+	Item* found[treeBatchWidth];
+	for (size_t start = 0; start < count; start += treeBatchWidth)
+	{
+		size_t width = std::min(treeBatchWidth, count - start);
+		lookupInterleaved(root, keys + start, width, found, keyLess);
+		for (size_t i = 0; i < width; i++)
+		{
+			if (found[i] != nullptr)
+				*found[i] = items[start + i];
+			else
+				insert_or_assign(keys[start + i], items[start + i]);
+		}
+	}
+}
+
+#ifdef CONTAINERS_ENABLE_STATS
+//A loaded snapshot is reported with its entries but no tree
+template<typename K, typename I, template<typename> class A, typename C>
+ContainerStats AVL<K, I, A, C>::stats() const
+{
+	ContainerStats result = statistics;
+	result.bytesAllocated = allocatedNodeBytes<Node>(nodes, statistics.nodes);
+	if (mapped == nullptr)
+		result.height = height();
+	else
+		result.nodes = mapped->size();
+	return result;
+}
+#endif
+
+template<typename K, typename I, template<typename> class A, typename C>
+typename AVL<K, I, A, C>::iterator AVL<K, I, A, C>::begin()
+{
+	materialize();
+	return iterator::first(root);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+typename AVL<K, I, A, C>::iterator AVL<K, I, A, C>::end()
+{
+	materialize();
+	return iterator::end(root);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+typename AVL<K, I, A, C>::const_iterator AVL<K, I, A, C>::begin() const
+{
+	if (mapped != nullptr)
+		return const_iterator(mapped->keys(), mapped->items(), 0);
+	return const_iterator::NodeIterator::first(root);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+typename AVL<K, I, A, C>::const_iterator AVL<K, I, A, C>::end() const
+{
+	if (mapped != nullptr)
+		return const_iterator(mapped->keys(), mapped->items(), mapped->size());
+	return const_iterator::NodeIterator::end(root);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+typename AVL<K, I, A, C>::iterator AVL<K, I, A, C>::lower_bound(const Key &_key)
+{
+	materialize();
+	return iterator::bound(root, _key, keyLess, false);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+typename AVL<K, I, A, C>::const_iterator AVL<K, I, A, C>::lower_bound(const Key &_key) const
+{
+	if (mapped != nullptr)
+		return const_iterator(mapped->keys(), mapped->items(), mapped->rank(_key, false));
+	return const_iterator::NodeIterator::bound(root, _key, keyLess, false);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+typename AVL<K, I, A, C>::iterator AVL<K, I, A, C>::upper_bound(const Key &_key)
+{
+	materialize();
+	return iterator::bound(root, _key, keyLess, true);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+typename AVL<K, I, A, C>::const_iterator AVL<K, I, A, C>::upper_bound(const Key &_key) const
+{
+	if (mapped != nullptr)
+		return const_iterator(mapped->keys(), mapped->items(), mapped->rank(_key, true));
+	return const_iterator::NodeIterator::bound(root, _key, keyLess, true);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+typename AVL<K, I, A, C>::iterator AVL<K, I, A, C>::select(size_t index)
+{
+	materialize();
+	return iterator::select(root, index);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+typename AVL<K, I, A, C>::const_iterator AVL<K, I, A, C>::select(size_t index) const
+{
+	if (mapped != nullptr)
+		return const_iterator(mapped->keys(), mapped->items(), std::min(index, mapped->size()));
+	return const_iterator::NodeIterator::select(root, index);
+}
+
+//Only the descent to lo and the k entries in range are visited
+template<typename K, typename I, template<typename> class A, typename C>
+template<typename Function>
+void AVL<K, I, A, C>::forEachInRange(const Key &lo, const Key &hi, Function function)
+{
+	for (iterator current = lower_bound(lo); current != end() && !keyLess(hi, current->key); ++current)
+		function(current->key, current->item);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+template<typename Function>
+void AVL<K, I, A, C>::forEachInRange(const Key &lo, const Key &hi, Function function) const
+{
+	for (const_iterator current = lower_bound(lo); current != end() && !keyLess(hi, current->key); ++current)
+		function(current->key, current->item);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+void AVL<K, I, A, C>::printEntries()
+{
+	materialize();
 	printEntriesRec(std::cout, root);
 }
 
-template<typename K, typename I>
-void AVL<K, I>::printTree()
+template<typename K, typename I, template<typename> class A, typename C>
+void AVL<K, I, A, C>::printTree()
 {
+	materialize();
 	printTreeRec(root, 0);
 }
 
-template<typename K, typename I>
-void AVL<K, I>::printEntriesRec(std::ostream& os, Node* current)
+template<typename K, typename I, template<typename> class A, typename C>
+void AVL<K, I, A, C>::printEntriesRec(std::ostream& os, Node* current)
 {
 	if (current == nullptr)
 		return;
@@ -259,8 +1471,20 @@ void AVL<K, I>::printEntriesRec(std::ostream& os, Node* current)
 	printEntriesRec(os, current->rightChild);
 }
 
-template<typename K, typename I>
-void AVL<K, I>::printTreeRec(Node* current, int indent)
+//Prints the entries with the balance factors of the tree that buildFromSnapshotRec would make
+template<typename K, typename I, template<typename> class A, typename C>
+void AVL<K, I, A, C>::printSnapshotRec(std::ostream& os, const Key* keys, const Item* items, size_t count)
+{
+	if (count == 0)
+		return;
+	size_t middle = count / 2;
+	printSnapshotRec(os, keys, items, middle);
+	os << keys[middle] << " " << items[middle] << " (" << heightOfSize(count - middle - 1) - heightOfSize(middle) << ")" << std::endl;
+	printSnapshotRec(os, keys + middle + 1, items + middle + 1, count - middle - 1);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+void AVL<K, I, A, C>::printTreeRec(Node* current, int indent)
 {
 	if (current == nullptr)
 		return;
@@ -271,10 +1495,13 @@ void AVL<K, I>::printTreeRec(Node* current, int indent)
 	printTreeRec(current->rightChild, indent + 1);
 }
 
-template<typename K, typename I>
-std::ostream & operator<<(std::ostream &os, const AVL<K, I> &AVL)
+template<typename K, typename I, template<typename> class A, typename C>
+std::ostream & operator<<(std::ostream &os, const AVL<K, I, A, C> &avl)
 {
-	AVL<K, I>::printEntriesRec(os, AVL.root);
+	if (avl.mapped != nullptr)
+		AVL<K, I, A, C>::printSnapshotRec(os, avl.mapped->keys(), avl.mapped->items(), avl.mapped->size());
+	else
+		AVL<K, I, A, C>::printEntriesRec(os, avl.root);
 	return os;
 }
 
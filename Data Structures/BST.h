@@ -3,118 +3,427 @@
 
 #include <string>
 #include <iostream>
-
-
-template<typename K, typename I>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <assert.h>
+
+#include "NodePool.h"
+#include "TreeIterator.h"
+#include "TreeBatch.h"
+#include "KeyTraits.h"
+#include "FlatSnapshot.h"
+#include "StaticSearchTree.h"
+#include "ContainerStats.h"
+
+
+template<typename K, typename I, template<typename> class Allocator = NodePool, typename C = std::less<K>>
 class BST
 {
 public:
 	using Key = K;
 	using Item = I;
+	using Compare = C;
 
 
 	void insert(Key, Item);
-	void remove(Key);
-	Item* lookup(Key);
+	void remove(const Key &);
+	Item* lookup(const Key &);
+
+	//Heterogeneous overloads for types comparable with Key, e.g. std::string_view for std::string keys
+	template<typename KeyLike, typename = EnableIfOrderedKey<K, KeyLike, Compare>>
+	void remove(const KeyLike &);
+	template<typename KeyLike, typename = EnableIfOrderedKey<K, KeyLike, Compare>>
+	Item* lookup(const KeyLike &);
+
+	//Looks up count keys at once, storing the item of each, or null, in results.
+	//The descents are interleaved so that their cache misses overlap, see TreeBatch.h
+	void lookupBatch(const Key*, size_t, Item**);
+	//Inserts items[i] under keys[i], or assigns it when the key is present, for every i < count.
+	//Present keys are found in interleaved groups, the absent ones are inserted along paths that are cached by then
+	void insertBatch(const Key*, const Item*, size_t);
+
+	//Constructs the item from args only if the key is absent, returns the item and whether it was inserted
+	template<typename... Args>
+	std::pair<Item*, bool> try_emplace(const Key &, Args&&...);
+	template<typename... Args>
+	std::pair<Item*, bool> try_emplace(Key &&, Args&&...);
+	//Like try_emplace, the key is passed on its own and only the item is built from args
+	template<typename... Args>
+	std::pair<Item*, bool> emplace(const Key &, Args&&...);
+	template<typename... Args>
+	std::pair<Item*, bool> emplace(Key &&, Args&&...);
+
+	//Inserts, or assigns to the existing item
+	template<typename ItemArg>
+	std::pair<Item*, bool> insert_or_assign(const Key &, ItemArg &&);
+	template<typename ItemArg>
+	std::pair<Item*, bool> insert_or_assign(Key &&, ItemArg &&);
+
+	void clear();
+
+	//Replaces the contents with the (key, item) pairs in [first, last), building a perfectly balanced tree.
+	//Sorted input is built in linear time, anything else is sorted first. For repeated keys the last item wins.
+	template<typename InputIterator>
+	void assign(InputIterator, InputIterator);
+
+	//Writes the entries to a sorted, versioned and checksummed flat file, see FlatSnapshot.h.
+	//Key and Item must be trivially copyable. Returns false if the file could not be written
+	bool saveSnapshot(const std::string &) const;
+	//Replaces the contents with a file written by saveSnapshot. The file is mapped and lookups binary search it in place,
+	//the tree is only built on the first write, clear or non-const traversal, const members read the mapped file.
+	//Returns false, leaving the contents unchanged, if the file cannot be read, has another format or, with verify set,
+	//is corrupt. Verifying checks the checksum and key order in a pass over the whole file, O(n), reading every page
+	//the lazy mapping would skip. Without it only the header is checked, lookups on a corrupt file go wrong silently
+	//and building the tree throws std::runtime_error if the keys turn out to be out of order
+	bool loadSnapshot(const std::string &, bool verify = true);
+
+	//Copies the entries into an immutable, pointer free StaticSearchTree for read only use, see StaticSearchTree.h
+	StaticSearchTree<Key, Item, Compare> freeze() const;
 
 	void printEntries();
 	void printTree();
 
+	size_t size() const;
+
+#ifdef CONTAINERS_ENABLE_STATS
+	//Counters since construction, with the current height, node count and allocator footprint
+	ContainerStats stats() const;
+#endif
 
-	friend std::ostream & operator<<(std::ostream &, const BST<K, I> &);
+
+	template<typename KT, typename IT, template<typename> class AT, typename CT>
+	friend std::ostream & operator<<(std::ostream &, const BST<KT, IT, AT, CT> &);
 
 
 	BST() = default;
+	explicit BST(const Compare &);
+	template<typename InputIterator>
+	BST(InputIterator, InputIterator, const Compare & = Compare());
+	BST(const BST &) = delete;
+	BST &operator=(const BST &) = delete;
 	~BST();
 
 private:
 	struct Node;
-	static Item* lookupRec(Key, Node*);
-	static void insertRec(Key, Item, Node*&);
+	using NodeAllocator = Allocator<Node>;
+
+	//An unbalanced tree can be as deep as it is large, so iterators keep their path on the heap
+	template<typename T>
+	using Path = std::vector<T>;
+
+	template<typename KeyLike>
+	Item* lookupNode(const KeyLike &, Node*);
+	template<typename KeyArg, typename... Args>
+	std::pair<Node*, bool> insertRec(Node*&, KeyArg &&, Args&&...);
+	Node* buildBalancedRec(std::pair<Key, Item>*, size_t);
+	Node* buildFromSnapshotRec(const Key*, const Item*, size_t);
+	void materialize();
+	//One three way comparison per node, see ThreeWayCompare in KeyTraits.h
+	template<typename Left, typename Right>
+	int compareKeys(const Left &a, const Right &b) const { return ThreeWayCompare<Compare>::compare(keyLess, a, b); }
+	//In key order, from the loaded snapshot if there is one, without building the tree
+	template<typename Function>
+	void forEachEntry(Function) const;
 	static void printEntriesRec(std::ostream &, Node*);
 	static void printTreeRec(Node*, int);
-	static void removeRec(Key, Node*&);
+	template<typename KeyLike>
+	void removeRec(const KeyLike &, Node*&);
 	static Node* detachMinimumNode(Node*&);
-	static void deepDelete(Node*);
+	void deepDelete(Node*);
 
 	static void rotateRight(Node* &);
 	static void rotateLeft(Node* &);
 
 	Node* root = nullptr;
+	size_t entryCount = 0;
+	NodeAllocator nodes;
+	Compare keyLess;
+	//Set while the contents are served from a loaded snapshot, root is null then
+	std::unique_ptr<FlatSnapshot<Key, Item, Compare>> mapped;
+#ifdef CONTAINERS_ENABLE_STATS
+	ContainerStats statistics;
+	static size_t measureHeight(const Node*);
+#endif
+
+public:
+	//In-order iterators, no recursion involved. Entries expose key and item, the key must not be modified.
+	//Non-const iteration builds the tree from a loaded snapshot, const iteration reads the mapped file and
+	//returns entries by value, see EntryIterator in TreeIterator.h
+	using iterator = TreeIterator<Node, Path>;
+	using const_iterator = EntryIterator<Node, Path, Key, Item>;
+
+	iterator begin();
+	iterator end();
+	const_iterator begin() const;
+	const_iterator end() const;
+
+	//First entry whose key is not less than the given key
+	iterator lower_bound(const Key &);
+	const_iterator lower_bound(const Key &) const;
+	//First entry whose key is greater than the given key
+	iterator upper_bound(const Key &);
+	const_iterator upper_bound(const Key &) const;
+
+	//Calls function(key, item) for every entry with lo <= key <= hi in key order, in O(log n + k)
+	template<typename Function>
+	void forEachInRange(const Key &, const Key &, Function);
+	template<typename Function>
+	void forEachInRange(const Key &, const Key &, Function) const;
 };
 
-template<typename K, typename I>
-struct BST<K, I>::Node
+template<typename K, typename I, template<typename> class A, typename C>
+struct BST<K, I, A, C>::Node
 {
-	Key key;
+	const Key key;
 	Item item;
 
 	Node* leftChild;
 	Node* rightChild;
 
-	Node(Key _key, Item _item)
+	template<typename KeyArg, typename... Args>
+	Node(KeyArg &&_key, Args&&... args) : key(std::forward<KeyArg>(_key)), item(std::forward<Args>(args)...)
 	{
-		key = _key;
-		item = _item;
 		leftChild = nullptr;
 		rightChild = nullptr;
 	}
 };
 
-template<typename K, typename I>
-BST<K, I>::~BST()
+template<typename K, typename I, template<typename> class A, typename C>
+BST<K, I, A, C>::~BST()
 {
 	deepDelete(root);
+	nodes.release();
 }
 
-template<typename K, typename I>
-typename void BST<K, I>::deepDelete(Node* current)
+template<typename K, typename I, template<typename> class A, typename C>
+template<typename InputIterator>
+BST<K, I, A, C>::BST(InputIterator first, InputIterator last, const Compare &_keyLess) : keyLess(_keyLess)
 {
-	if (current == nullptr)
-		return;
+	assign(first, last);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+BST<K, I, A, C>::BST(const Compare &_keyLess) : keyLess(_keyLess)
+{
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+template<typename InputIterator>
+void BST<K, I, A, C>::assign(InputIterator first, InputIterator last)
+{
+	std::vector<std::pair<Key, Item>> entries(first, last);
+
+	auto keyOrder = [this](const std::pair<Key, Item> &a, const std::pair<Key, Item> &b) { return keyLess(a.first, b.first); };
+	if (!std::is_sorted(entries.begin(), entries.end(), keyOrder))
+		std::stable_sort(entries.begin(), entries.end(), keyOrder);
 
-	deepDelete(current->leftChild);
-	deepDelete(current->rightChild);
-	delete current;
+	//Drop all but the last of every run of equal keys, as repeated inserts would
+	size_t unique = 0;
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		if (i + 1 < entries.size() && !keyLess(entries[i].first, entries[i + 1].first))
+			continue;
+		if (unique != i)
+			entries[unique] = std::move(entries[i]);
+		unique++;
+	}
+
+	clear();
+	root = buildBalancedRec(entries.data(), unique);
+	entryCount = unique;
+	CONTAINERS_STATS(statistics.nodes = unique);
 }
 
-template<typename K, typename I>
-typename BST<K, I>::Item* BST<K, I>::lookupRec(Key _key, Node* current)
+//Builds a subtree from sorted, unique entries by taking the middle entry as the root.
+//The left half is never smaller than the right one, so the balance is 0 or -1 everywhere
+template<typename K, typename I, template<typename> class A, typename C>
+typename BST<K, I, A, C>::Node* BST<K, I, A, C>::buildBalancedRec(std::pair<Key, Item>* entries, size_t count)
 {
-	if (current == nullptr)
+	if (count == 0)
 		return nullptr;
 
-	if (current->key == _key)
-		return &current->item;
-	else if (current->key < _key)
-		return lookupRec(_key, current->rightChild);
-	else
-		return lookupRec(_key, current->leftChild);
+	size_t middle = count / 2;
+	Node* localRoot = nodes.create(std::move(entries[middle].first), std::move(entries[middle].second));
+	localRoot->leftChild = buildBalancedRec(entries, middle);
+	localRoot->rightChild = buildBalancedRec(entries + middle + 1, count - middle - 1);
+	return localRoot;
+}
+
+//Same shape as buildBalancedRec, copying out of the snapshot
+template<typename K, typename I, template<typename> class A, typename C>
+typename BST<K, I, A, C>::Node* BST<K, I, A, C>::buildFromSnapshotRec(const Key* keys, const Item* items, size_t count)
+{
+	if (count == 0)
+		return nullptr;
+
+	size_t middle = count / 2;
+	Node* localRoot = nodes.create(keys[middle], items[middle]);
+	localRoot->leftChild = buildFromSnapshotRec(keys, items, middle);
+	localRoot->rightChild = buildFromSnapshotRec(keys + middle + 1, items + middle + 1, count - middle - 1);
+	return localRoot;
+}
+
+//Replaces a loaded snapshot by the tree it describes and unmaps it. Const members read the snapshot instead,
+//so that concurrent readers never write
+template<typename K, typename I, template<typename> class A, typename C>
+void BST<K, I, A, C>::materialize()
+{
+	if (mapped == nullptr)
+		return;
+
+	//Only snapshots of trivially copyable entries can be loaded, this keeps other types, e.g. move-only items, compiling
+	if constexpr (std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Item>::value)
+	{
+		//Keys out of order would make a tree that silently loses entries, the contents stay mapped when this throws
+		if (!mapped->verified() && !mapped->keysInOrder())
+			throw std::runtime_error("Snapshot keys are out of order, the file is corrupt");
+
+		std::unique_ptr<FlatSnapshot<Key, Item, Compare>> snapshot = std::move(mapped);
+		root = buildFromSnapshotRec(snapshot->keys(), snapshot->items(), snapshot->size());
+		entryCount = snapshot->size();
+		CONTAINERS_STATS(statistics.nodes = snapshot->size());
+	}
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+bool BST<K, I, A, C>::saveSnapshot(const std::string &path) const
+{
+	return FlatSnapshot<Key, Item, Compare>::save(path, [this](auto function) { forEachEntry(function); });
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+StaticSearchTree<typename BST<K, I, A, C>::Key, typename BST<K, I, A, C>::Item, C> BST<K, I, A, C>::freeze() const
+{
+	size_t count = 0;
+	forEachEntry([&count](const Key &, const Item &) { count++; });
+	return StaticSearchTree<Key, Item, Compare>(count, [this](auto function) { forEachEntry(function); }, keyLess);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+template<typename Function>
+void BST<K, I, A, C>::forEachEntry(Function function) const
+{
+	if (mapped != nullptr)
+	{
+		mapped->forEach(function);
+		return;
+	}
+
+	using NodeIterator = typename const_iterator::NodeIterator;
+	NodeIterator last = NodeIterator::end(root);
+	for (NodeIterator current = NodeIterator::first(root); current != last; ++current)
+		function(current->key, current->item);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+bool BST<K, I, A, C>::loadSnapshot(const std::string &path, bool verify)
+{
+	std::unique_ptr<FlatSnapshot<Key, Item, Compare>> snapshot = FlatSnapshot<Key, Item, Compare>::open(path, verify, keyLess);
+	if (snapshot == nullptr)
+		return false;
+
+	clear();
+	mapped = std::move(snapshot);
+	return true;
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+void BST<K, I, A, C>::clear()
+{
+	mapped.reset();
+	deepDelete(root);
+	nodes.release();
+	root = nullptr;
+	entryCount = 0;
+	CONTAINERS_STATS(statistics.nodes = 0);
+}
+
+//Frees the nodes without recursion by rotating left subtrees into a right spine,
+//the caller releases the allocator afterwards
+template<typename K, typename I, template<typename> class A, typename C>
+void BST<K, I, A, C>::deepDelete(Node* current)
+{
+	//A pool frees its chunks wholesale, so nodes without destructors need no walk
+	if (NodeAllocator::releasesInBulk && std::is_trivially_destructible<Node>::value)
+		return;
+
+	while (current != nullptr)
+	{
+		if (current->leftChild != nullptr)
+		{
+			rotateRight(current);
+			continue;
+		}
+
+		Node* next = current->rightChild;
+		nodes.destroy(current);
+		current = next;
+	}
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+template<typename KeyLike>
+typename BST<K, I, A, C>::Item* BST<K, I, A, C>::lookupNode(const KeyLike &_key, Node* current)
+{
+	//Iterative, an unbalanced tree can be deeper than the stack
+	CONTAINERS_STATS(size_t depth = 0);
+	while (current != nullptr)
+	{
+		CONTAINERS_STATS(depth++);
+		int order = compareKeys(current->key, _key);
+		if (order == 0)
+		{
+			CONTAINERS_STATS(statistics.recordLookup(depth));
+			return &current->item;
+		}
+		current = (order < 0) ? current->rightChild : current->leftChild;
+	}
+
+	CONTAINERS_STATS(statistics.recordLookup(depth));
+	return nullptr;
 }
 
-template<typename K, typename I>
-void BST<K, I>::insertRec(Key _key, Item _item, Node* &current)
+//Returns the node holding the key and whether it was created; args are only used when it is
+template<typename K, typename I, template<typename> class A, typename C>
+template<typename KeyArg, typename... Args>
+std::pair<typename BST<K, I, A, C>::Node*, bool> BST<K, I, A, C>::insertRec(Node* &current, KeyArg &&_key, Args&&... args)
 {
 	if (current == nullptr)
-		current = new Node(_key, _item);
-	else if (current->key == _key)
-		current->item = _item;
-	else if (current->key < _key)
-		insertRec(_key, _item, current->rightChild);
+	{
+		current = nodes.create(std::forward<KeyArg>(_key), std::forward<Args>(args)...);
+		entryCount++;
+		CONTAINERS_STATS(statistics.inserts++);
+		CONTAINERS_STATS(statistics.nodes++);
+		return { current, true };
+	}
+
+	int order = compareKeys(current->key, _key);
+	if (order == 0)
+		return { current, false };
+	else if (order < 0)
+		return insertRec(current->rightChild, std::forward<KeyArg>(_key), std::forward<Args>(args)...);
 	else
-		insertRec(_key, _item, current->leftChild);
+		return insertRec(current->leftChild, std::forward<KeyArg>(_key), std::forward<Args>(args)...);
 }
 
-template<typename K, typename I>
-void BST<K, I>::removeRec(Key _key, Node * &current)
+template<typename K, typename I, template<typename> class A, typename C>
+template<typename KeyLike>
+void BST<K, I, A, C>::removeRec(const KeyLike &_key, Node * &current)
 {
 	if (current == nullptr)
 		return;
-	else if (current->key == _key)
+
+	int order = compareKeys(current->key, _key);
+	if (order == 0)
 	{
 		if (current->leftChild == nullptr && current->rightChild == nullptr)
 		{
-			delete current;
+			nodes.destroy(current);
 			current = nullptr;
 		}
 		else if (current->leftChild == nullptr || current->rightChild == nullptr)
@@ -122,7 +431,7 @@ void BST<K, I>::removeRec(Key _key, Node * &current)
 			Node* nonLeaf = (current->leftChild == nullptr) ?
 				current->rightChild : current->leftChild;
 
-			delete current;
+			nodes.destroy(current);
 			current = nonLeaf;
 		}
 		else
@@ -132,17 +441,21 @@ void BST<K, I>::removeRec(Key _key, Node * &current)
 			bestFit->leftChild = current->leftChild;
 			bestFit->rightChild = current->rightChild;
 
+			nodes.destroy(current);
 			current = bestFit;
 		}
+		entryCount--;
+		CONTAINERS_STATS(statistics.removes++);
+		CONTAINERS_STATS(statistics.nodes--);
 	}
-	else if (current->key < _key)
+	else if (order < 0)
 		removeRec(_key, current->rightChild);
 	else
 		removeRec(_key, current->leftChild);
 }
 
-template<typename K, typename I>
-typename BST<K, I>::Node* BST<K, I>::detachMinimumNode(Node* &current)
+template<typename K, typename I, template<typename> class A, typename C>
+typename BST<K, I, A, C>::Node* BST<K, I, A, C>::detachMinimumNode(Node* &current)
 {
 	if (current->leftChild == nullptr)
 	{
@@ -155,8 +468,8 @@ typename BST<K, I>::Node* BST<K, I>::detachMinimumNode(Node* &current)
 
 }
 
-template<typename K, typename I>
-void BST<K, I>::rotateRight(Node* &localRoot)
+template<typename K, typename I, template<typename> class A, typename C>
+void BST<K, I, A, C>::rotateRight(Node* &localRoot)
 {
 	//assertions before dereferencing a pointer
 	Node* b = localRoot;
@@ -170,8 +483,8 @@ void BST<K, I>::rotateRight(Node* &localRoot)
 	localRoot = a;
 }
 
-template<typename K, typename I>
-void BST<K, I>::rotateLeft(Node* &localRoot)
+template<typename K, typename I, template<typename> class A, typename C>
+void BST<K, I, A, C>::rotateLeft(Node* &localRoot)
 {
 	//assertions before dereferencing a pointer;
 	Node* a = localRoot;
@@ -185,38 +498,270 @@ void BST<K, I>::rotateLeft(Node* &localRoot)
 	localRoot = b;
 }
 
-template<typename K, typename I>
-void BST<K, I>::insert(Key _key, Item _item)
+template<typename K, typename I, template<typename> class A, typename C>
+void BST<K, I, A, C>::insert(Key _key, Item _item)
+{
+	insert_or_assign(std::move(_key), std::move(_item));
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+template<typename... Args>
+std::pair<typename BST<K, I, A, C>::Item*, bool> BST<K, I, A, C>::try_emplace(const Key &_key, Args&&... args)
+{
+	materialize();
+	std::pair<Node*, bool> result = insertRec(root, _key, std::forward<Args>(args)...);
+	return { &result.first->item, result.second };
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+template<typename... Args>
+std::pair<typename BST<K, I, A, C>::Item*, bool> BST<K, I, A, C>::try_emplace(Key &&_key, Args&&... args)
+{
+	materialize();
+	std::pair<Node*, bool> result = insertRec(root, std::move(_key), std::forward<Args>(args)...);
+	return { &result.first->item, result.second };
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+template<typename... Args>
+std::pair<typename BST<K, I, A, C>::Item*, bool> BST<K, I, A, C>::emplace(const Key &_key, Args&&... args)
+{
+	return try_emplace(_key, std::forward<Args>(args)...);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+template<typename... Args>
+std::pair<typename BST<K, I, A, C>::Item*, bool> BST<K, I, A, C>::emplace(Key &&_key, Args&&... args)
+{
+	return try_emplace(std::move(_key), std::forward<Args>(args)...);
+}
+
+//The item argument is only consumed by one of the construction or the assignment
+template<typename K, typename I, template<typename> class A, typename C>
+template<typename ItemArg>
+std::pair<typename BST<K, I, A, C>::Item*, bool> BST<K, I, A, C>::insert_or_assign(const Key &_key, ItemArg &&_item)
 {
-	insertRec(_key, _item, root);
+	std::pair<Item*, bool> result = try_emplace(_key, std::forward<ItemArg>(_item));
+	if (!result.second)
+		*result.first = std::forward<ItemArg>(_item);
+	return result;
 }
 
-template<typename K, typename I>
-void BST<K, I>::remove(Key _key)
+template<typename K, typename I, template<typename> class A, typename C>
+template<typename ItemArg>
+std::pair<typename BST<K, I, A, C>::Item*, bool> BST<K, I, A, C>::insert_or_assign(Key &&_key, ItemArg &&_item)
 {
+	std::pair<Item*, bool> result = try_emplace(std::move(_key), std::forward<ItemArg>(_item));
+	if (!result.second)
+		*result.first = std::forward<ItemArg>(_item);
+	return result;
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+void BST<K, I, A, C>::remove(const Key &_key)
+{
+	materialize();
+	removeRec(_key, root);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+template<typename KeyLike, typename>
+void BST<K, I, A, C>::remove(const KeyLike &_key)
+{
+	materialize();
 	removeRec(_key, root);
 }
 
-template<typename K, typename I>
-typename BST<K, I>::Item* BST<K, I>::lookup(Key _key)
+template<typename K, typename I, template<typename> class A, typename C>
+typename BST<K, I, A, C>::Item* BST<K, I, A, C>::lookup(const Key &_key)
+{
+	if (mapped != nullptr)
+		return mapped->lookup(_key);
+	return lookupNode(_key, root);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+template<typename KeyLike, typename>
+typename BST<K, I, A, C>::Item* BST<K, I, A, C>::lookup(const KeyLike &_key)
+{
+	if (mapped != nullptr)
+		return mapped->lookup(_key);
+	return lookupNode(_key, root);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+size_t BST<K, I, A, C>::size() const
+{
+	return (mapped != nullptr) ? mapped->size() : entryCount;
+}
+
+//A loaded snapshot is searched key by key
+template<typename K, typename I, template<typename> class A, typename C>
+void BST<K, I, A, C>::lookupBatch(const Key* keys, size_t count, Item** results)
+{
+	if (mapped != nullptr)
+	{
+		for (size_t i = 0; i < count; i++)
+			results[i] = mapped->lookup(keys[i]);
+		return;
+	}
+
+	lookupInterleaved(root, keys, count, results, keyLess);
+}
+
+//Nodes never move, so the items found for a group stay valid while its absent keys are inserted
+template<typename K, typename I, template<typename> class A, typename C>
+void BST<K, I, A, C>::insertBatch(const Key* keys, const Item* items, size_t count)
+{
+	materialize();
+
+	Item* found[treeBatchWidth];
+	for (size_t start = 0; start < count; start += treeBatchWidth)
+	{
+		size_t width = std::min(treeBatchWidth, count - start);
+		lookupInterleaved(root, keys + start, width, found, keyLess);
+		for (size_t i = 0; i < width; i++)
+		{
+			if (found[i] != nullptr)
+				*found[i] = items[start + i];
+			else
+				insert_or_assign(keys[start + i], items[start + i]);
+		}
+	}
+}
+
+#ifdef CONTAINERS_ENABLE_STATS
+//A loaded snapshot is reported with its entries but no tree
+template<typename K, typename I, template<typename> class A, typename C>
+ContainerStats BST<K, I, A, C>::stats() const
+{
+	ContainerStats result = statistics;
+	result.bytesAllocated = allocatedNodeBytes<Node>(nodes, statistics.nodes);
+	if (mapped == nullptr)
+		result.height = measureHeight(root);
+	else
+		result.nodes = mapped->size();
+	return result;
+}
+
+//Breadth first, one level at a time, so a degenerate tree needs no deep recursion
+template<typename K, typename I, template<typename> class A, typename C>
+size_t BST<K, I, A, C>::measureHeight(const Node* localRoot)
+{
+	std::vector<const Node*> level, nextLevel;
+	if (localRoot != nullptr)
+		level.push_back(localRoot);
+
+	size_t treeHeight = 0;
+	for (; !level.empty(); treeHeight++)
+	{
+		nextLevel.clear();
+		for (const Node* current : level)
+		{
+			if (current->leftChild != nullptr)
+				nextLevel.push_back(current->leftChild);
+			if (current->rightChild != nullptr)
+				nextLevel.push_back(current->rightChild);
+		}
+		level.swap(nextLevel);
+	}
+	return treeHeight;
+}
+#endif
+
+template<typename K, typename I, template<typename> class A, typename C>
+typename BST<K, I, A, C>::iterator BST<K, I, A, C>::begin()
+{
+	materialize();
+	return iterator::first(root);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+typename BST<K, I, A, C>::iterator BST<K, I, A, C>::end()
+{
+	materialize();
+	return iterator::end(root);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+typename BST<K, I, A, C>::const_iterator BST<K, I, A, C>::begin() const
+{
+	if (mapped != nullptr)
+		return const_iterator(mapped->keys(), mapped->items(), 0);
+	return const_iterator::NodeIterator::first(root);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+typename BST<K, I, A, C>::const_iterator BST<K, I, A, C>::end() const
+{
+	if (mapped != nullptr)
+		return const_iterator(mapped->keys(), mapped->items(), mapped->size());
+	return const_iterator::NodeIterator::end(root);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+typename BST<K, I, A, C>::iterator BST<K, I, A, C>::lower_bound(const Key &_key)
+{
+	materialize();
+	return iterator::bound(root, _key, keyLess, false);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+typename BST<K, I, A, C>::const_iterator BST<K, I, A, C>::lower_bound(const Key &_key) const
+{
+	if (mapped != nullptr)
+		return const_iterator(mapped->keys(), mapped->items(), mapped->rank(_key, false));
+	return const_iterator::NodeIterator::bound(root, _key, keyLess, false);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+typename BST<K, I, A, C>::iterator BST<K, I, A, C>::upper_bound(const Key &_key)
+{
+	materialize();
+	return iterator::bound(root, _key, keyLess, true);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+typename BST<K, I, A, C>::const_iterator BST<K, I, A, C>::upper_bound(const Key &_key) const
+{
+	if (mapped != nullptr)
+		return const_iterator(mapped->keys(), mapped->items(), mapped->rank(_key, true));
+	return const_iterator::NodeIterator::bound(root, _key, keyLess, true);
+}
+
+//Only the descent to lo and the k entries in range are visited
+template<typename K, typename I, template<typename> class A, typename C>
+template<typename Function>
+void BST<K, I, A, C>::forEachInRange(const Key &lo, const Key &hi, Function function)
+{
+	for (iterator current = lower_bound(lo); current != end() && !keyLess(hi, current->key); ++current)
+		function(current->key, current->item);
+}
+
+template<typename K, typename I, template<typename> class A, typename C>
+template<typename Function>
+void BST<K, I, A, C>::forEachInRange(const Key &lo, const Key &hi, Function function) const
 {
-	return lookupRec(_key, root);
+	for (const_iterator current = lower_bound(lo); current != end() && !keyLess(hi, current->key); ++current)
+		function(current->key, current->item);
 }
 
-template<typename K, typename I>
-void BST<K, I>::printEntries()
+template<typename K, typename I, template<typename> class A, typename C>
+void BST<K, I, A, C>::printEntries()
 {
+	materialize();
 	printEntriesRec(std::cout, root);
 }
 
-template<typename K, typename I>
-void BST<K, I>::printTree()
+template<typename K, typename I, template<typename> class A, typename C>
+void BST<K, I, A, C>::printTree()
 {
+	materialize();
 	printTreeRec(root, 0);
 }
 
-template<typename K, typename I>
-void BST<K, I>::printEntriesRec(std::ostream& os, Node* current)
+template<typename K, typename I, template<typename> class A, typename C>
+void BST<K, I, A, C>::printEntriesRec(std::ostream& os, Node* current)
 {
 	if (current == nullptr)
 		return;
@@ -225,8 +770,8 @@ void BST<K, I>::printEntriesRec(std::ostream& os, Node* current)
 	printEntriesRec(os, current->rightChild);
 }
 
-template<typename K, typename I>
-void BST<K, I>::printTreeRec(Node *current, int indent)
+template<typename K, typename I, template<typename> class A, typename C>
+void BST<K, I, A, C>::printTreeRec(Node *current, int indent)
 {
 	if (current == nullptr)
 		return;
@@ -237,10 +782,10 @@ void BST<K, I>::printTreeRec(Node *current, int indent)
 	printTreeRec(current->rightChild, indent + 1);
 }
 
-template<typename K, typename I>
-std::ostream & operator<<(std::ostream &os, const BST<K, I> &bst)
+template<typename K, typename I, template<typename> class A, typename C>
+std::ostream & operator<<(std::ostream &os, const BST<K, I, A, C> &bst)
 {
-	BST<K, I>::printEntriesRec(os, bst.root);
+	bst.forEachEntry([&os](const K &key, const I &item) { os << key << " " << item << std::endl; });
 	return os;
 }
 
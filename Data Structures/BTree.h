@@ -0,0 +1,539 @@
+#ifndef BTREE_H
+#define BTREE_H
+
+#include <string>
+#include <iostream>
+#include <algorithm>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <assert.h>
+
+#include "NodePool.h"
+
+//Default fanout: keys of a node span roughly four cache lines, between 8 and 64 children
+template<typename K>
+struct BTreeDefaultFanout
+{
+	static const size_t raw = 256 / sizeof(K);
+	static const size_t value = (raw < 8) ? 8 : (raw > 64) ? 64 : raw & ~size_t(1);
+};
+
+template<typename K, typename I, size_t Fanout = BTreeDefaultFanout<K>::value,
+	template<typename> class Allocator = NodePool>
+class BTree
+{
+	static_assert(Fanout >= 4 && Fanout % 2 == 0, "BTree fanout must be an even number of at least 4");
+
+public:
+	using Key = K;
+	using Item = I;
+
+
+	void insert(Key, Item);
+	void remove(Key);
+	Item* lookup(Key);
+
+	void clear();
+	size_t size() const;
+
+	void printEntries();
+	void printTree();
+
+
+	template<typename KT, typename IT, size_t FT, template<typename> class AT>
+	friend std::ostream & operator<<(std::ostream &, const BTree<KT, IT, FT, AT> &);
+
+
+	BTree() = default;
+	BTree(const BTree &) = delete;
+	BTree &operator=(const BTree &) = delete;
+	~BTree();
+
+private:
+	struct Node;
+	struct InnerNode;
+	using LeafAllocator = Allocator<Node>;
+	using InnerAllocator = Allocator<InnerNode>;
+
+	//Minimum degree: every node but the root holds between minDegree - 1 and 2 * minDegree - 1 keys
+	static const size_t minDegree = Fanout / 2;
+	static const size_t maxKeys = Fanout - 1;
+
+	//Small arithmetic keys are scanned linearly, everything else is binary searched
+	static const bool linearSearch = std::is_arithmetic<K>::value;
+	static const size_t linearWindow = 128 / sizeof(K) + 1;
+
+	static size_t searchNode(const Node*, const Key&);
+	static Node* child(Node*, size_t);
+	static void printEntriesRec(std::ostream &, Node*);
+	static void printTreeRec(Node*, int);
+	void deepDelete(Node*);
+
+	void splitChild(InnerNode*, size_t);
+	void mergeChildren(InnerNode*, size_t);
+	static void borrowFromLeft(InnerNode*, size_t);
+	static void borrowFromRight(InnerNode*, size_t);
+	template<typename KeyArg, typename ItemArg>
+	static void insertAt(Node*, size_t, KeyArg &&, ItemArg &&);
+	static void eraseAt(Node*, size_t);
+	void destroyNode(Node*);
+
+	Node* root = nullptr;
+	size_t treeSize = 0;
+	LeafAllocator leaves;
+	InnerAllocator innerNodes;
+};
+
+//Leaf node, keys are kept apart from the items so a node search touches as few cache lines as possible.
+//Keys and items live in raw storage, only the first keyCount slots of each array are constructed
+template<typename K, typename I, size_t F, template<typename> class A>
+struct BTree<K, I, F, A>::Node
+{
+	alignas(Key) unsigned char keyStorage[maxKeys * sizeof(Key)];
+	unsigned short keyCount = 0;
+	bool leaf = true;
+	alignas(Item) unsigned char itemStorage[maxKeys * sizeof(Item)];
+
+	Key* keys() { return std::launder(reinterpret_cast<Key*>(keyStorage)); }
+	const Key* keys() const { return std::launder(reinterpret_cast<const Key*>(keyStorage)); }
+	Item* items() { return std::launder(reinterpret_cast<Item*>(itemStorage)); }
+	const Item* items() const { return std::launder(reinterpret_cast<const Item*>(itemStorage)); }
+};
+
+template<typename K, typename I, size_t F, template<typename> class A>
+struct BTree<K, I, F, A>::InnerNode : Node
+{
+	Node* children[F];
+
+	InnerNode()
+	{
+		this->leaf = false;
+	}
+};
+
+template<typename K, typename I, size_t F, template<typename> class A>
+BTree<K, I, F, A>::~BTree()
+{
+	deepDelete(root);
+	leaves.release();
+	innerNodes.release();
+}
+
+template<typename K, typename I, size_t F, template<typename> class A>
+void BTree<K, I, F, A>::clear()
+{
+	deepDelete(root);
+	leaves.release();
+	innerNodes.release();
+	root = nullptr;
+	treeSize = 0;
+}
+
+template<typename K, typename I, size_t F, template<typename> class A>
+size_t BTree<K, I, F, A>::size() const
+{
+	return treeSize;
+}
+
+//Frees the nodes, the caller releases the allocators afterwards
+template<typename K, typename I, size_t F, template<typename> class A>
+void BTree<K, I, F, A>::deepDelete(Node* current)
+{
+	//Pools free their chunks wholesale, so nodes of trivially destructible entries need no walk
+	if (current == nullptr || (LeafAllocator::releasesInBulk &&
+		std::is_trivially_destructible<Key>::value && std::is_trivially_destructible<Item>::value))
+		return;
+
+	if (!current->leaf)
+	{
+		InnerNode* inner = static_cast<InnerNode*>(current);
+		for (size_t i = 0; i <= inner->keyCount; i++)
+			deepDelete(inner->children[i]);
+	}
+	destroyNode(current);
+}
+
+template<typename K, typename I, size_t F, template<typename> class A>
+void BTree<K, I, F, A>::destroyNode(Node* current)
+{
+	for (size_t i = 0; i < current->keyCount; i++)
+	{
+		current->keys()[i].~Key();
+		current->items()[i].~Item();
+	}
+
+	if (current->leaf)
+		leaves.destroy(current);
+	else
+		innerNodes.destroy(static_cast<InnerNode*>(current));
+}
+
+//Index of the first key that is not less than _key
+template<typename K, typename I, size_t F, template<typename> class A>
+size_t BTree<K, I, F, A>::searchNode(const Node* current, const Key &_key)
+{
+	const Key* keys = current->keys();
+	if (linearSearch)
+	{
+		//Halve the range down to a couple of cache lines, then count the smaller keys without branching
+		size_t low = 0, high = current->keyCount;
+		while (high - low > linearWindow)
+		{
+			size_t middle = (low + high) / 2;
+			if (keys[middle] < _key)
+				low = middle + 1;
+			else
+				high = middle;
+		}
+		size_t position = low;
+		for (size_t i = low; i < high; i++)
+			position += (keys[i] < _key);
+		return position;
+	}
+
+	return std::lower_bound(keys, keys + current->keyCount, _key) - keys;
+}
+
+template<typename K, typename I, size_t F, template<typename> class A>
+typename BTree<K, I, F, A>::Node* BTree<K, I, F, A>::child(Node* current, size_t index)
+{
+	return static_cast<InnerNode*>(current)->children[index];
+}
+
+template<typename K, typename I, size_t F, template<typename> class A>
+typename BTree<K, I, F, A>::Item* BTree<K, I, F, A>::lookup(Key _key)
+{
+	Node* current = root;
+	while (current != nullptr)
+	{
+		size_t i = searchNode(current, _key);
+		if (i < current->keyCount && current->keys()[i] == _key)
+			return &current->items()[i];
+		if (current->leaf)
+			return nullptr;
+		current = child(current, i);
+	}
+
+	return nullptr;
+}
+
+//Splits the full child at index into two half-full nodes, moving its middle key up into parent
+template<typename K, typename I, size_t F, template<typename> class A>
+void BTree<K, I, F, A>::splitChild(InnerNode* parent, size_t index)
+{
+	Node* left = parent->children[index];
+	Node* right = left->leaf ? leaves.create() : static_cast<Node*>(innerNodes.create());
+
+	for (size_t i = minDegree; i < maxKeys; i++)
+		insertAt(right, right->keyCount, std::move(left->keys()[i]), std::move(left->items()[i]));
+	if (!left->leaf)
+	{
+		InnerNode* leftInner = static_cast<InnerNode*>(left);
+		std::copy(leftInner->children + minDegree, leftInner->children + F,
+			static_cast<InnerNode*>(right)->children);
+	}
+
+	std::move_backward(parent->children + index + 1, parent->children + parent->keyCount + 1,
+		parent->children + parent->keyCount + 2);
+	parent->children[index + 1] = right;
+	insertAt(parent, index, std::move(left->keys()[minDegree - 1]), std::move(left->items()[minDegree - 1]));
+
+	//The moved from upper half, middle entry included, is destroyed
+	while (left->keyCount > minDegree - 1)
+		eraseAt(left, left->keyCount - 1);
+}
+
+//Single top-down pass: full nodes are split before descending into them, so no insertion ever backtracks
+template<typename K, typename I, size_t F, template<typename> class A>
+void BTree<K, I, F, A>::insert(Key _key, Item _item)
+{
+	if (root == nullptr)
+		root = leaves.create();
+
+	if (root->keyCount == maxKeys)
+	{
+		InnerNode* newRoot = innerNodes.create();
+		newRoot->children[0] = root;
+		root = newRoot;
+		splitChild(newRoot, 0);
+	}
+
+	Node* current = root;
+	while (true)
+	{
+		size_t i = searchNode(current, _key);
+		if (i < current->keyCount && current->keys()[i] == _key)
+		{
+			current->items()[i] = std::move(_item);
+			return;
+		}
+
+		if (current->leaf)
+		{
+			insertAt(current, i, std::move(_key), std::move(_item));
+			treeSize++;
+			return;
+		}
+
+		InnerNode* inner = static_cast<InnerNode*>(current);
+		if (inner->children[i]->keyCount == maxKeys)
+		{
+			splitChild(inner, i);
+			if (inner->keys()[i] == _key)
+			{
+				inner->items()[i] = std::move(_item);
+				return;
+			}
+			if (inner->keys()[i] < _key)
+				i++;
+		}
+		current = inner->children[i];
+	}
+}
+
+//Shifts the entries from index on up by one and puts the new entry at index. Only the slot past the last entry
+//is constructed, the others are assigned
+template<typename K, typename I, size_t F, template<typename> class A>
+template<typename KeyArg, typename ItemArg>
+void BTree<K, I, F, A>::insertAt(Node* current, size_t index, KeyArg &&_key, ItemArg &&_item)
+{
+	Key* keys = current->keys();
+	Item* items = current->items();
+	size_t last = current->keyCount;
+	if (index == last)
+	{
+		new (&keys[last]) Key(std::forward<KeyArg>(_key));
+		new (&items[last]) Item(std::forward<ItemArg>(_item));
+	}
+	else
+	{
+		new (&keys[last]) Key(std::move(keys[last - 1]));
+		new (&items[last]) Item(std::move(items[last - 1]));
+		std::move_backward(keys + index, keys + last - 1, keys + last);
+		std::move_backward(items + index, items + last - 1, items + last);
+		keys[index] = std::forward<KeyArg>(_key);
+		items[index] = std::forward<ItemArg>(_item);
+	}
+	current->keyCount++;
+}
+
+//Shifts the entries after index down by one and destroys the last slot
+template<typename K, typename I, size_t F, template<typename> class A>
+void BTree<K, I, F, A>::eraseAt(Node* current, size_t index)
+{
+	Key* keys = current->keys();
+	Item* items = current->items();
+	std::move(keys + index + 1, keys + current->keyCount, keys + index);
+	std::move(items + index + 1, items + current->keyCount, items + index);
+	current->keyCount--;
+	keys[current->keyCount].~Key();
+	items[current->keyCount].~Item();
+}
+
+//Merges the child at index + 1 and the separating key into the child at index
+template<typename K, typename I, size_t F, template<typename> class A>
+void BTree<K, I, F, A>::mergeChildren(InnerNode* parent, size_t index)
+{
+	Node* left = parent->children[index];
+	Node* right = parent->children[index + 1];
+
+	if (!left->leaf)
+	{
+		InnerNode* rightInner = static_cast<InnerNode*>(right);
+		std::copy(rightInner->children, rightInner->children + right->keyCount + 1,
+			static_cast<InnerNode*>(left)->children + left->keyCount + 1);
+	}
+	insertAt(left, left->keyCount, std::move(parent->keys()[index]), std::move(parent->items()[index]));
+	for (size_t i = 0; i < right->keyCount; i++)
+		insertAt(left, left->keyCount, std::move(right->keys()[i]), std::move(right->items()[i]));
+
+	eraseAt(parent, index);
+	std::move(parent->children + index + 2, parent->children + parent->keyCount + 2, parent->children + index + 1);
+
+	destroyNode(right);
+}
+
+//Rotates the last key of the left sibling through the parent into the child at index
+template<typename K, typename I, size_t F, template<typename> class A>
+void BTree<K, I, F, A>::borrowFromLeft(InnerNode* parent, size_t index)
+{
+	Node* current = parent->children[index];
+	Node* sibling = parent->children[index - 1];
+
+	if (!current->leaf)
+	{
+		InnerNode* inner = static_cast<InnerNode*>(current);
+		std::move_backward(inner->children, inner->children + current->keyCount + 1, inner->children + current->keyCount + 2);
+		inner->children[0] = static_cast<InnerNode*>(sibling)->children[sibling->keyCount];
+	}
+	insertAt(current, 0, std::move(parent->keys()[index - 1]), std::move(parent->items()[index - 1]));
+
+	parent->keys()[index - 1] = std::move(sibling->keys()[sibling->keyCount - 1]);
+	parent->items()[index - 1] = std::move(sibling->items()[sibling->keyCount - 1]);
+	eraseAt(sibling, sibling->keyCount - 1);
+}
+
+//Rotates the first key of the right sibling through the parent into the child at index
+template<typename K, typename I, size_t F, template<typename> class A>
+void BTree<K, I, F, A>::borrowFromRight(InnerNode* parent, size_t index)
+{
+	Node* current = parent->children[index];
+	Node* sibling = parent->children[index + 1];
+
+	if (!current->leaf)
+	{
+		InnerNode* siblingInner = static_cast<InnerNode*>(sibling);
+		static_cast<InnerNode*>(current)->children[current->keyCount + 1] = siblingInner->children[0];
+		std::move(siblingInner->children + 1, siblingInner->children + sibling->keyCount + 1, siblingInner->children);
+	}
+	insertAt(current, current->keyCount, std::move(parent->keys()[index]), std::move(parent->items()[index]));
+
+	parent->keys()[index] = std::move(sibling->keys()[0]);
+	parent->items()[index] = std::move(sibling->items()[0]);
+	eraseAt(sibling, 0);
+}
+
+//Single top-down pass: every node is topped up to at least minDegree keys before descending into it,
+//so a key can always be taken out of a leaf without backtracking
+template<typename K, typename I, size_t F, template<typename> class A>
+void BTree<K, I, F, A>::remove(Key _key)
+{
+	if (root == nullptr)
+		return;
+
+	Key target = _key;
+	Node* current = root;
+	while (true)
+	{
+		size_t i = searchNode(current, target);
+		bool found = i < current->keyCount && current->keys()[i] == target;
+
+		if (current->leaf)
+		{
+			if (found)
+			{
+				eraseAt(current, i);
+				treeSize--;
+			}
+			break;
+		}
+
+		InnerNode* inner = static_cast<InnerNode*>(current);
+		if (found)
+		{
+			Node* left = inner->children[i];
+			Node* right = inner->children[i + 1];
+			if (left->keyCount >= minDegree)
+			{
+				//Replace the key with its predecessor, then remove the predecessor from the left subtree
+				Node* predecessor = left;
+				while (!predecessor->leaf)
+					predecessor = child(predecessor, predecessor->keyCount);
+				inner->keys()[i] = predecessor->keys()[predecessor->keyCount - 1];
+				inner->items()[i] = std::move(predecessor->items()[predecessor->keyCount - 1]);
+				target = inner->keys()[i];
+				current = left;
+			}
+			else if (right->keyCount >= minDegree)
+			{
+				Node* successor = right;
+				while (!successor->leaf)
+					successor = child(successor, 0);
+				inner->keys()[i] = successor->keys()[0];
+				inner->items()[i] = std::move(successor->items()[0]);
+				target = inner->keys()[i];
+				current = right;
+			}
+			else
+			{
+				mergeChildren(inner, i);
+				current = left;
+			}
+		}
+		else
+		{
+			Node* next = inner->children[i];
+			if (next->keyCount < minDegree)
+			{
+				if (i > 0 && inner->children[i - 1]->keyCount >= minDegree)
+					borrowFromLeft(inner, i);
+				else if (i < inner->keyCount && inner->children[i + 1]->keyCount >= minDegree)
+					borrowFromRight(inner, i);
+				else if (i < inner->keyCount)
+					mergeChildren(inner, i);
+				else
+				{
+					next = inner->children[i - 1];
+					mergeChildren(inner, i - 1);
+				}
+			}
+			current = next;
+		}
+
+		//A merge can drain the root, the tree then shrinks by one level
+		if (root->keyCount == 0 && !root->leaf)
+		{
+			InnerNode* oldRoot = static_cast<InnerNode*>(root);
+			root = oldRoot->children[0];
+			destroyNode(oldRoot);
+		}
+	}
+
+	if (root->keyCount == 0)
+	{
+		destroyNode(root);
+		root = nullptr;
+	}
+}
+
+template<typename K, typename I, size_t F, template<typename> class A>
+void BTree<K, I, F, A>::printEntries()
+{
+	printEntriesRec(std::cout, root);
+}
+
+template<typename K, typename I, size_t F, template<typename> class A>
+void BTree<K, I, F, A>::printTree()
+{
+	printTreeRec(root, 0);
+}
+
+template<typename K, typename I, size_t F, template<typename> class A>
+void BTree<K, I, F, A>::printEntriesRec(std::ostream& os, Node* current)
+{
+	if (current == nullptr)
+		return;
+	for (size_t i = 0; i < current->keyCount; i++)
+	{
+		if (!current->leaf)
+			printEntriesRec(os, child(current, i));
+		os << current->keys()[i] << " " << current->items()[i] << std::endl;
+	}
+	if (!current->leaf)
+		printEntriesRec(os, child(current, current->keyCount));
+}
+
+template<typename K, typename I, size_t F, template<typename> class A>
+void BTree<K, I, F, A>::printTreeRec(Node* current, int indent)
+{
+	if (current == nullptr)
+		return;
+	std::cout << std::string(indent, '\t') << (current->leaf ? "* " : "  ");
+	for (size_t i = 0; i < current->keyCount; i++)
+		std::cout << current->keys()[i] << " ";
+	std::cout << std::endl;
+
+	if (!current->leaf)
+		for (size_t i = 0; i <= current->keyCount; i++)
+			printTreeRec(child(current, i), indent + 1);
+}
+
+template<typename K, typename I, size_t F, template<typename> class A>
+std::ostream & operator<<(std::ostream &os, const BTree<K, I, F, A> &btree)
+{
+	BTree<K, I, F, A>::printEntriesRec(os, btree.root);
+	return os;
+}
+
+#endif // !BTREE_H
@@ -0,0 +1,369 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+//Shared harness of the container benchmarks: options, key sets, timing, process isolation and reporting
+
+namespace Benchmark
+{
+	struct Options
+	{
+		std::vector<size_t> sizes = { 1000, 10000, 100000, 1000000 };
+		std::vector<std::string> distributions = { "sequential", "random", "zipf", "string" };
+		std::vector<std::string> containers;	//Empty runs every container
+		std::vector<std::string> workloads;		//Empty reports every workload
+		std::vector<unsigned> threads = { 1, 2, 4, 8 };
+		//Containers with linear time operations, and BST fed sequential keys, are skipped above this size
+		size_t linearLimit = 20000;
+		unsigned repeat = 1;
+		uint64_t seed = 42;
+		std::string csvFile;
+		std::string jsonFile;
+	};
+
+	//One measured workload of one case, written by the child process into shared memory
+	struct Result
+	{
+		char container[32];
+		char distribution[16];
+		char workload[24];
+		size_t size;
+		unsigned threads;
+		uint64_t operations;
+		double nanoseconds;
+		long peakRssKb;
+		bool valid;	//False when the container returned wrong lookup results
+
+		double nsPerOperation() const { return operations ? nanoseconds / operations : 0.0; }
+		double operationsPerSecond() const { return nanoseconds > 0 ? operations * 1e9 / nanoseconds : 0.0; }
+	};
+
+	inline bool selected(const std::vector<std::string> &list, const std::string &name)
+	{
+		return list.empty() || std::find(list.begin(), list.end(), name) != list.end();
+	}
+
+	//splitmix64 finalizer, a bijection, so distinct inputs give distinct keys
+	inline uint64_t scramble(uint64_t value)
+	{
+		value += 0x9E3779B97F4A7C15ull;
+		value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+		value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+		return value ^ (value >> 31);
+	}
+
+	//Zipfian ranks over [0, items) as in YCSB (Gray et al.), theta 0.99 by default
+	class Zipfian
+	{
+	public:
+		explicit Zipfian(size_t _items, double _theta = 0.99) : items(_items), theta(_theta)
+		{
+			for (size_t i = 1; i <= items; i++)
+				zetan += 1.0 / std::pow(static_cast<double>(i), theta);
+			double zeta2 = 1.0 + 1.0 / std::pow(2.0, theta);
+			alpha = 1.0 / (1.0 - theta);
+			eta = (1.0 - std::pow(2.0 / items, 1.0 - theta)) / (1.0 - zeta2 / zetan);
+		}
+
+		template<typename Random>
+		size_t operator()(Random &random)
+		{
+			double u = std::uniform_real_distribution<double>(0.0, 1.0)(random);
+			double uz = u * zetan;
+			if (uz < 1.0)
+				return 0;
+			if (uz < 1.0 + std::pow(0.5, theta))
+				return 1;
+			size_t rank = static_cast<size_t>(items * std::pow(eta * u - eta + 1.0, alpha));
+			return std::min(rank, items - 1);
+		}
+
+	private:
+		size_t items;
+		double theta;
+		double zetan = 0.0;
+		double alpha;
+		double eta;
+	};
+
+	inline uint64_t makeKey(uint64_t index, const std::string &distribution, uint64_t *)
+	{
+		return distribution == "sequential" ? index : scramble(index);
+	}
+
+	//Longer than the small string buffer, like most real string keys
+	inline std::string makeKey(uint64_t index, const std::string &, std::string *)
+	{
+		char buffer[32];
+		snprintf(buffer, sizeof(buffer), "user:%016llx", static_cast<unsigned long long>(scramble(index)));
+		return buffer;
+	}
+
+	//Keys in insertion order, keys that are never inserted, and the access pattern as indices into keys
+	template<typename Key>
+	struct KeySet
+	{
+		std::vector<Key> keys;
+		std::vector<Key> missing;
+		std::vector<uint32_t> accesses;
+		std::vector<uint32_t> removals;
+
+		KeySet(size_t size, const std::string &distribution, uint64_t seed)
+		{
+			std::mt19937_64 random(seed);
+			keys.reserve(size);
+			missing.reserve(size);
+			for (size_t i = 0; i < size; i++)
+			{
+				keys.push_back(makeKey(i, distribution, static_cast<Key*>(nullptr)));
+				missing.push_back(makeKey(size + i, distribution, static_cast<Key*>(nullptr)));
+			}
+
+			accesses.resize(size);
+			removals.resize(size);
+			for (size_t i = 0; i < size; i++)
+				removals[i] = static_cast<uint32_t>(i);
+
+			if (distribution == "sequential")
+			{
+				accesses = removals;
+				return;
+			}
+
+			std::shuffle(removals.begin(), removals.end(), random);
+			if (distribution == "zipf")
+			{
+				//Popular ranks are scattered so the hot keys are not the first ones inserted
+				Zipfian zipfian(size);
+				for (size_t i = 0; i < size; i++)
+					accesses[i] = static_cast<uint32_t>(scramble(zipfian(random)) % size);
+			}
+			else
+			{
+				std::uniform_int_distribution<uint32_t> uniform(0, static_cast<uint32_t>(size - 1));
+				for (size_t i = 0; i < size; i++)
+					accesses[i] = uniform(random);
+			}
+		}
+	};
+
+	class Timer
+	{
+	public:
+		Timer() : start(std::chrono::steady_clock::now()) {}
+
+		double nanoseconds() const
+		{
+			return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+		}
+
+	private:
+		std::chrono::steady_clock::time_point start;
+	};
+
+	//Results of one case, filled in by the child process
+	class CaseResults
+	{
+	public:
+		void add(const char* workload, unsigned threads, uint64_t operations, double nanoseconds, bool valid)
+		{
+			if (count == capacity)
+				return;
+			Result &result = results[count++];
+			memset(&result, 0, sizeof(result));
+			snprintf(result.workload, sizeof(result.workload), "%s", workload);
+			result.threads = threads;
+			result.operations = operations;
+			result.nanoseconds = nanoseconds;
+			result.valid = valid;
+		}
+
+		static const size_t capacity = 32;
+		size_t count = 0;
+		Result results[capacity];
+	};
+
+	//Runs one case in a forked child so that its peak RSS is measured on its own
+	//and a crashing or exhausted container does not take the whole suite down
+	template<typename Function>
+	std::vector<Result> runIsolated(const char* container, const std::string &distribution, size_t size, Function function)
+	{
+		void* shared = mmap(nullptr, sizeof(CaseResults), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+		if (shared == MAP_FAILED)
+		{
+			perror("mmap");
+			exit(EXIT_FAILURE);
+		}
+		CaseResults* caseResults = new (shared) CaseResults();
+
+		std::cout.flush();
+		pid_t child = fork();
+		if (child == 0)
+		{
+			function(*caseResults);
+			_exit(EXIT_SUCCESS);
+		}
+
+		int status = 0;
+		struct rusage usage;
+		memset(&usage, 0, sizeof(usage));
+		if (child < 0 || wait4(child, &status, 0, &usage) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			std::cerr << "warning: " << container << " / " << distribution << " / " << size << " did not finish" << std::endl;
+
+		std::vector<Result> results(caseResults->results, caseResults->results + caseResults->count);
+		munmap(shared, sizeof(CaseResults));
+
+		for (Result &result : results)
+		{
+			snprintf(result.container, sizeof(result.container), "%s", container);
+			snprintf(result.distribution, sizeof(result.distribution), "%s", distribution.c_str());
+			result.size = size;
+			result.peakRssKb = usage.ru_maxrss;	//Kilobytes on Linux
+		}
+		return results;
+	}
+
+	inline void printTableHeader(std::ostream &os)
+	{
+		os << std::left << std::setw(22) << "container" << std::setw(12) << "keys" << std::right << std::setw(10) << "size"
+			<< "  " << std::left << std::setw(16) << "workload" << std::right << std::setw(8) << "threads"
+			<< std::setw(12) << "ns/op" << std::setw(14) << "Mops/s" << std::setw(14) << "peak RSS KB" << std::endl;
+	}
+
+	inline void printTableRow(std::ostream &os, const Result &result)
+	{
+		os << std::left << std::setw(22) << result.container << std::setw(12) << result.distribution << std::right << std::setw(10) << result.size
+			<< "  " << std::left << std::setw(16) << result.workload << std::right << std::setw(8) << result.threads
+			<< std::fixed << std::setprecision(1) << std::setw(12) << result.nsPerOperation()
+			<< std::setprecision(3) << std::setw(14) << result.operationsPerSecond() / 1e6
+			<< std::setw(14) << result.peakRssKb << (result.valid ? "" : "  WRONG RESULTS") << std::endl;
+	}
+
+	inline void writeCsv(const std::string &fileName, const std::vector<Result> &results)
+	{
+		std::ofstream file(fileName);
+		file << "container,distribution,size,workload,threads,operations,ns_per_op,ops_per_sec,peak_rss_kb,valid\n";
+		for (const Result &result : results)
+			file << result.container << ',' << result.distribution << ',' << result.size << ',' << result.workload << ','
+				<< result.threads << ',' << result.operations << ',' << result.nsPerOperation() << ','
+				<< result.operationsPerSecond() << ',' << result.peakRssKb << ',' << (result.valid ? "true" : "false") << '\n';
+	}
+
+	inline void writeJson(const std::string &fileName, const std::vector<Result> &results)
+	{
+		std::ofstream file(fileName);
+		file << "[\n";
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			const Result &result = results[i];
+			file << "  {\"container\": \"" << result.container << "\", \"distribution\": \"" << result.distribution
+				<< "\", \"size\": " << result.size << ", \"workload\": \"" << result.workload << "\", \"threads\": " << result.threads
+				<< ", \"operations\": " << result.operations << ", \"ns_per_op\": " << result.nsPerOperation()
+				<< ", \"ops_per_sec\": " << result.operationsPerSecond() << ", \"peak_rss_kb\": " << result.peakRssKb
+				<< ", \"valid\": " << (result.valid ? "true" : "false") << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+		}
+		file << "]\n";
+	}
+
+	template<typename T>
+	std::vector<T> parseList(const std::string &text)
+	{
+		std::vector<T> values;
+		std::stringstream stream(text);
+		std::string item;
+		while (std::getline(stream, item, ','))
+		{
+			std::stringstream itemStream(item);
+			T value;
+			if (itemStream >> value)
+				values.push_back(value);
+		}
+		return values;
+	}
+
+	inline void printUsage(const char* program)
+	{
+		std::cout << "Usage: " << program << R"( [options]
+  --sizes N,N,...          number of keys per case (default 1000,10000,100000,1000000)
+  --distributions D,...    sequential, random, zipf, string
+  --containers C,...       containers to run (default all)
+  --workloads W,...        insert, lookup-hit, lookup-batch, lookup-miss, mixed, remove,
+                           parallel-lookup, parallel-mixed
+  --threads T,...          threads for parallel-lookup and parallel-mixed (default 1,2,4,8)
+  --linear-limit N         largest size run for Dictionary and for BST with sequential keys (default 20000)
+  --repeat N               runs per case, the fastest one is reported
+  --seed N                 random seed
+  --csv FILE               also write the results as CSV
+  --json FILE              also write the results as JSON
+)";
+	}
+
+	inline Options parseOptions(int argc, char* argv[])
+	{
+		Options options;
+		for (int i = 1; i < argc; i++)
+		{
+			std::string option = argv[i];
+			if (option == "--help" || option == "-h")
+			{
+				printUsage(argv[0]);
+				exit(EXIT_SUCCESS);
+			}
+			if (i + 1 >= argc)
+			{
+				std::cerr << "missing value for " << option << std::endl;
+				exit(EXIT_FAILURE);
+			}
+
+			std::string value = argv[++i];
+			if (option == "--sizes")
+				options.sizes = parseList<size_t>(value);
+			else if (option == "--distributions")
+				options.distributions = parseList<std::string>(value);
+			else if (option == "--containers")
+				options.containers = parseList<std::string>(value);
+			else if (option == "--workloads")
+				options.workloads = parseList<std::string>(value);
+			else if (option == "--threads")
+				options.threads = parseList<unsigned>(value);
+			else if (option == "--linear-limit")
+				options.linearLimit = std::stoull(value);
+			else if (option == "--repeat")
+				options.repeat = std::max(1, std::stoi(value));
+			else if (option == "--seed")
+				options.seed = std::stoull(value);
+			else if (option == "--csv")
+				options.csvFile = value;
+			else if (option == "--json")
+				options.jsonFile = value;
+			else
+			{
+				printUsage(argv[0]);
+				exit(EXIT_FAILURE);
+			}
+		}
+		return options;
+	}
+}
+
+#endif // !BENCHMARK_H
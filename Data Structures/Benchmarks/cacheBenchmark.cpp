@@ -0,0 +1,178 @@
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "benchmark.h"
+
+#include "LRUCache.h"
+
+using namespace Benchmark;
+
+//Replays Zipfian access traces against the caches: every access is a get, and a miss is followed by a put of the key,
+//as a cache in front of a slower store would be used. Reports the time per access and the hit ratio for each cache size.
+
+struct CacheOptions
+{
+	size_t keys = 1000000;
+	size_t accesses = 4000000;
+	std::vector<double> thetas = { 0.8, 0.99 };
+	//Cache capacities as a percentage of the keys
+	std::vector<double> capacities = { 1, 10 };
+	std::vector<std::string> caches;
+	uint64_t seed = 42;
+};
+
+template<typename Key>
+struct LRUCacheBench
+{
+	static constexpr const char* name = "LRUCache";
+	Containers::LRUCache<Key, uint64_t> cache;
+
+	explicit LRUCacheBench(size_t capacity) : cache(capacity) {}
+	bool get(const Key &key) { return cache.get(key) != nullptr; }
+	void put(const Key &key, uint64_t item) { cache.put(key, item); }
+};
+
+template<typename Key>
+struct LFUCacheBench
+{
+	static constexpr const char* name = "LFUCache";
+	Containers::LFUCache<Key, uint64_t> cache;
+
+	explicit LFUCacheBench(size_t capacity) : cache(capacity) {}
+	bool get(const Key &key) { return cache.get(key) != nullptr; }
+	void put(const Key &key, uint64_t item) { cache.put(key, item); }
+};
+
+//The usual hand written LRU: a std::list in recency order and a std::unordered_map to its nodes
+template<typename Key>
+struct StdListLRUBench
+{
+	static constexpr const char* name = "std::list+unordered_map";
+	using Entries = std::list<std::pair<Key, uint64_t>>;
+	Entries entries;
+	std::unordered_map<Key, typename Entries::iterator> index;
+	size_t capacity;
+
+	explicit StdListLRUBench(size_t _capacity) : capacity(_capacity) {}
+
+	bool get(const Key &key)
+	{
+		auto found = index.find(key);
+		if (found == index.end())
+			return false;
+		entries.splice(entries.begin(), entries, found->second);
+		return true;
+	}
+
+	void put(const Key &key, uint64_t item)
+	{
+		if (entries.size() == capacity)
+		{
+			index.erase(entries.back().first);
+			entries.pop_back();
+		}
+		entries.emplace_front(key, item);
+		index[key] = entries.begin();
+	}
+};
+
+template<template<typename> class Bench>
+void runCache(const CacheOptions &options, const std::vector<uint64_t> &trace, double theta)
+{
+	if (!selected(options.caches, Bench<uint64_t>::name))
+		return;
+
+	for (double percent : options.capacities)
+	{
+		size_t capacity = std::max<size_t>(1, static_cast<size_t>(options.keys * percent / 100));
+		Bench<uint64_t> bench(capacity);
+
+		size_t hits = 0;
+		Timer timer;
+		for (uint64_t key : trace)
+		{
+			if (bench.get(key))
+				hits++;
+			else
+				bench.put(key, key);
+		}
+		double elapsed = timer.nanoseconds();
+
+		std::cout << std::left << std::setw(26) << Bench<uint64_t>::name << std::right << std::fixed
+			<< std::setw(8) << std::setprecision(2) << theta
+			<< std::setw(10) << std::setprecision(1) << percent << "%"
+			<< std::setw(12) << std::setprecision(1) << elapsed / trace.size()
+			<< std::setw(12) << std::setprecision(4) << static_cast<double>(hits) / trace.size() << std::endl;
+	}
+}
+
+inline void printCacheUsage(const char* program)
+{
+	std::cout << "Usage: " << program << R"( [options]
+  --keys N                 distinct keys in the traces (default 1000000)
+  --accesses N             accesses per trace (default 4000000)
+  --thetas T,...           Zipfian skew of the traces (default 0.8,0.99)
+  --capacities P,...       cache sizes in percent of the keys (default 1,10)
+  --caches C,...           caches to run (default all)
+  --seed N                 random seed
+)";
+}
+
+CacheOptions parseCacheOptions(int argc, char* argv[])
+{
+	CacheOptions options;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string option = argv[i];
+		if (option == "--help" || option == "-h" || i + 1 >= argc)
+		{
+			printCacheUsage(argv[0]);
+			exit(option == "--help" || option == "-h" ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+
+		std::string value = argv[++i];
+		if (option == "--keys")
+			options.keys = std::max<size_t>(1, std::stoull(value));
+		else if (option == "--accesses")
+			options.accesses = std::stoull(value);
+		else if (option == "--thetas")
+			options.thetas = parseList<double>(value);
+		else if (option == "--capacities")
+			options.capacities = parseList<double>(value);
+		else if (option == "--caches")
+			options.caches = parseList<std::string>(value);
+		else if (option == "--seed")
+			options.seed = std::stoull(value);
+		else
+		{
+			printCacheUsage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+	return options;
+}
+
+int main(int argc, char* argv[])
+{
+	CacheOptions options = parseCacheOptions(argc, argv);
+
+	std::cout << std::left << std::setw(26) << "cache" << std::right << std::setw(8) << "theta" << std::setw(11) << "capacity"
+		<< std::setw(12) << "ns/op" << std::setw(12) << "hit ratio" << std::endl;
+
+	for (double theta : options.thetas)
+	{
+		//Ranks are scrambled so that the popular keys are spread over the key space
+		std::mt19937_64 random(options.seed);
+		Zipfian zipfian(options.keys, theta);
+		std::vector<uint64_t> trace(options.accesses);
+		for (uint64_t &key : trace)
+			key = scramble(zipfian(random));
+
+		runCache<LRUCacheBench>(options, trace, theta);
+		runCache<LFUCacheBench>(options, trace, theta);
+		runCache<StdListLRUBench>(options, trace, theta);
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,56 @@
+#include "stress.h"
+
+#include "ConcurrentDictionary.h"
+
+using namespace Stress;
+
+//Stress test of ConcurrentDictionary. Few shards are used, so that threads working on different keys
+//still meet on the same locks. Besides the shared checks, every thread runs upsert on one counter,
+//which has to end up with exactly one increment per call.
+int main(int argc, char* argv[])
+{
+	Options options = parseOptions(argc, argv);
+	Failures failures;
+
+	{
+		Containers::ConcurrentDictionary<uint64_t, uint64_t> dictionary(4);
+		disjointKeys(dictionary, options, failures);
+		contendedKeys(dictionary, options, failures);
+	}
+
+	{
+		Containers::ConcurrentDictionary<uint64_t, uint64_t> dictionary(4);
+		sharedKeys(dictionary, options, failures);
+	}
+
+	{
+		Containers::ConcurrentDictionary<uint64_t, uint64_t> dictionary(4);
+		const uint64_t counter = 7;
+		std::vector<std::thread> workers;
+		for (unsigned t = 0; t < options.threads; t++)
+		{
+			workers.emplace_back([&, t]() {
+				for (size_t i = 0; i < options.operations; i++)
+				{
+					dictionary.upsert(counter, [](uint64_t &count) { count++; });
+					//Other keys of the same shards are inserted and removed again meanwhile
+					uint64_t key = 1000 + ((i / 2) % 64) * options.threads + t;
+					if (i % 2 == 0)
+						dictionary.insert(key, i);
+					else
+						dictionary.remove(key);
+				}
+			});
+		}
+		for (std::thread &worker : workers)
+			worker.join();
+
+		uint64_t count = 0;
+		if (!dictionary.lookup(counter, count) || count != options.operations * options.threads)
+			failures.report("upsert counter is " + std::to_string(count) + ", expected " + std::to_string(options.operations * options.threads));
+		if (dictionary.size() != 1)
+			failures.report("size() is " + std::to_string(dictionary.size()) + " after the upsert run, expected 1");
+	}
+
+	return finish("ConcurrentDictionary", failures);
+}
@@ -0,0 +1,541 @@
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "benchmark.h"
+
+#include "ART.h"
+#include "AVL.h"
+#include "BST.h"
+#include "BTree.h"
+#include "CompactAVL.h"
+#include "ConcurrentDictionary.h"
+#include "Dictionary.h"
+#include "HashDictionary.h"
+#include "PersistentAVL.h"
+#include "SkipList.h"
+#include "StaticSearchTree.h"
+#include "UnrolledDictionary.h"
+
+#include <map>
+#include <unordered_map>
+
+using namespace Benchmark;
+
+//Every container is driven through an adapter with insert, lookup (returning whether the key was found) and remove.
+//Adapters of thread safe containers also hand out readers that may be used from several threads at once.
+struct Traits
+{
+	static const bool linearTime = false;		//Operations are O(n)
+	static const bool unbalanced = false;		//Degenerates into a list on sequential keys
+	static const bool concurrentReads = false;
+	static const bool concurrentWrites = false;	//insert, lookup and remove may be called from several threads
+	static const bool batchedLookups = false;	//lookupBatch(keys, count, results) fills in the items found
+	static const bool readOnly = false;			//Built by freeze() from the inserted keys, only the lookups are run
+};
+
+template<typename Key>
+struct DictionaryBench : Traits
+{
+	static constexpr const char* name = "Dictionary";
+	static const bool linearTime = true;
+	Containers::Dictionary<Key, uint64_t> container;
+
+	void insert(const Key &key, uint64_t item) { container.insert(key, item); }
+	bool lookup(const Key &key) { return container.lookup(key) != nullptr; }
+	void remove(const Key &key) { container.remove(key); }
+};
+
+template<typename Key>
+struct UnrolledDictionaryBench : Traits
+{
+	static constexpr const char* name = "UnrolledDictionary";
+	static const bool linearTime = true;
+	Containers::UnrolledDictionary<Key, uint64_t> container;
+
+	void insert(const Key &key, uint64_t item) { container.insert(key, item); }
+	bool lookup(const Key &key) { return container.lookup(key) != nullptr; }
+	void remove(const Key &key) { container.remove(key); }
+};
+
+template<typename Key>
+struct BSTBench : Traits
+{
+	static constexpr const char* name = "BST";
+	static const bool unbalanced = true;
+	static const bool batchedLookups = true;
+	BST<Key, uint64_t> container;
+
+	void insert(const Key &key, uint64_t item) { container.insert(key, item); }
+	bool lookup(const Key &key) { return container.lookup(key) != nullptr; }
+	void lookupBatch(const Key* keys, size_t count, uint64_t** results) { container.lookupBatch(keys, count, results); }
+	void remove(const Key &key) { container.remove(key); }
+};
+
+template<typename Key>
+struct AVLBench : Traits
+{
+	static constexpr const char* name = "AVL";
+	static const bool batchedLookups = true;
+	AVL<Key, uint64_t> container;
+
+	void insert(const Key &key, uint64_t item) { container.insert(key, item); }
+	bool lookup(const Key &key) { return container.lookup(key) != nullptr; }
+	void lookupBatch(const Key* keys, size_t count, uint64_t** results) { container.lookupBatch(keys, count, results); }
+	void remove(const Key &key) { container.remove(key); }
+};
+
+template<typename Key>
+struct CompactAVLBench : Traits
+{
+	static constexpr const char* name = "CompactAVL";
+	CompactAVL<Key, uint64_t> container;
+
+	void insert(const Key &key, uint64_t item) { container.insert(key, item); }
+	bool lookup(const Key &key) { return container.lookup(key) != nullptr; }
+	void remove(const Key &key) { container.remove(key); }
+};
+
+//ART indexes byte strings: integers are stored as their 8 bytes most significant first, which keeps their order
+template<typename Key>
+struct ARTBench : Traits
+{
+	static constexpr const char* name = "ART";
+	ART<uint64_t> container;
+
+	static std::string_view bytes(const std::string &key, char*) { return key; }
+	static std::string_view bytes(uint64_t key, char* buffer)
+	{
+		for (int i = 7; i >= 0; i--, key >>= 8)
+			buffer[i] = static_cast<char>(key & 0xFF);
+		return std::string_view(buffer, 8);
+	}
+
+	void insert(const Key &key, uint64_t item) { char buffer[8]; container.insert(bytes(key, buffer), item); }
+	bool lookup(const Key &key) { char buffer[8]; return container.lookup(bytes(key, buffer)) != nullptr; }
+	void remove(const Key &key) { char buffer[8]; container.remove(bytes(key, buffer)); }
+};
+
+template<typename Key>
+struct StaticSearchTreeBench : Traits
+{
+	static constexpr const char* name = "StaticSearchTree";
+	static const bool readOnly = true;
+	AVL<Key, uint64_t> staging;
+	StaticSearchTree<Key, uint64_t> container;
+
+	void insert(const Key &key, uint64_t item) { staging.insert(key, item); }
+	void freeze() { container = staging.freeze(); staging.clear(); }
+	bool lookup(const Key &key) { return container.lookup(key) != nullptr; }
+	//Never called, read only cases end after the lookups
+	void remove(const Key &) {}
+};
+
+template<typename Key>
+struct BTreeBench : Traits
+{
+	static constexpr const char* name = "BTree";
+	BTree<Key, uint64_t> container;
+
+	void insert(const Key &key, uint64_t item) { container.insert(key, item); }
+	bool lookup(const Key &key) { return container.lookup(key) != nullptr; }
+	void remove(const Key &key) { container.remove(key); }
+};
+
+template<typename Key>
+struct HashDictionaryBench : Traits
+{
+	static constexpr const char* name = "HashDictionary";
+	Containers::HashDictionary<Key, uint64_t> container;
+
+	void insert(const Key &key, uint64_t item) { container.insert(key, item); }
+	bool lookup(const Key &key) { return container.lookup(key) != nullptr; }
+	void remove(const Key &key) { container.remove(key); }
+};
+
+template<typename Key>
+struct ConcurrentDictionaryBench : Traits
+{
+	static constexpr const char* name = "ConcurrentDictionary";
+	static const bool concurrentReads = true;
+	static const bool concurrentWrites = true;
+	Containers::ConcurrentDictionary<Key, uint64_t> container;
+
+	void insert(const Key &key, uint64_t item) { container.insert(key, item); }
+	bool lookup(const Key &key) { return container.contains(key); }
+	void remove(const Key &key) { container.remove(key); }
+
+	auto reader() const { return [this](const Key &key) { return container.contains(key); }; }
+};
+
+template<typename Key>
+struct SkipListBench : Traits
+{
+	static constexpr const char* name = "SkipList";
+	static const bool concurrentReads = true;
+	static const bool concurrentWrites = true;
+	Containers::SkipList<Key, uint64_t> container;
+
+	void insert(const Key &key, uint64_t item) { container.insert(key, item); }
+	bool lookup(const Key &key) { return container.contains(key); }
+	void remove(const Key &key) { container.remove(key); }
+
+	auto reader() const { return [this](const Key &key) { return container.contains(key); }; }
+};
+
+//The baseline for the concurrent ordered containers, an AVL behind a single lock
+template<typename Key>
+struct LockedAVLBench : Traits
+{
+	static constexpr const char* name = "AVL+mutex";
+	static const bool concurrentReads = true;
+	static const bool concurrentWrites = true;
+	AVL<Key, uint64_t> container;
+	mutable std::mutex lock;
+
+	void insert(const Key &key, uint64_t item) { std::lock_guard<std::mutex> guard(lock); container.insert(key, item); }
+	bool lookup(const Key &key) const { std::lock_guard<std::mutex> guard(lock); return const_cast<AVL<Key, uint64_t> &>(container).lookup(key) != nullptr; }
+	void remove(const Key &key) { std::lock_guard<std::mutex> guard(lock); container.remove(key); }
+
+	auto reader() const { return [this](const Key &key) { return lookup(key); }; }
+};
+
+//Single threaded lookups reuse one snapshot until the next write
+template<typename Key>
+struct PersistentAVLBench : Traits
+{
+	static constexpr const char* name = "PersistentAVL";
+	static const bool concurrentReads = true;
+	PersistentAVL<Key, uint64_t> container;
+	typename PersistentAVL<Key, uint64_t>::Snapshot view = container.snapshot();
+	bool stale = false;
+
+	void insert(const Key &key, uint64_t item) { container.insert(key, item); stale = true; }
+	void remove(const Key &key) { container.remove(key); stale = true; }
+	bool lookup(const Key &key)
+	{
+		if (stale)
+		{
+			view = container.snapshot();
+			stale = false;
+		}
+		return view.lookup(key) != nullptr;
+	}
+
+	auto reader() const { return [view = container.snapshot()](const Key &key) { return view.lookup(key) != nullptr; }; }
+};
+
+template<typename Key>
+struct StdMapBench : Traits
+{
+	static constexpr const char* name = "std::map";
+	std::map<Key, uint64_t> container;
+
+	void insert(const Key &key, uint64_t item) { container.insert_or_assign(key, item); }
+	bool lookup(const Key &key) { return container.find(key) != container.end(); }
+	void remove(const Key &key) { container.erase(key); }
+};
+
+template<typename Key>
+struct StdUnorderedMapBench : Traits
+{
+	static constexpr const char* name = "std::unordered_map";
+	std::unordered_map<Key, uint64_t> container;
+
+	void insert(const Key &key, uint64_t item) { container.insert_or_assign(key, item); }
+	bool lookup(const Key &key) { return container.find(key) != container.end(); }
+	void remove(const Key &key) { container.erase(key); }
+};
+
+//Lookups of keys[accesses] from every thread at once, each thread starting at a different offset
+template<typename Bench, typename Key>
+void parallelLookups(const Bench &bench, const KeySet<Key> &set, const Options &options, CaseResults &results)
+{
+	size_t size = set.keys.size();
+	for (unsigned threadCount : options.threads)
+	{
+		std::vector<size_t> found(threadCount, 0);
+		std::vector<std::thread> threads;
+		Timer timer;
+		for (unsigned t = 0; t < threadCount; t++)
+		{
+			threads.emplace_back([&, t]() {
+				auto reader = bench.reader();
+				size_t offset = t * size / threadCount, hits = 0;
+				for (size_t i = 0; i < size; i++)
+					hits += reader(set.keys[set.accesses[(i + offset) % size]]);
+				found[t] = hits;
+			});
+		}
+		for (std::thread &thread : threads)
+			thread.join();
+		double elapsed = timer.nanoseconds();
+
+		bool valid = true;
+		for (size_t hits : found)
+			valid = valid && hits == size;
+		results.add("parallel-lookup", threadCount, static_cast<uint64_t>(size) * threadCount, elapsed, valid);
+	}
+}
+
+//The mixed workload from every thread at once: lookups of present keys, and inserts and removals of absent keys
+//from a slice of the absent keys owned by each thread
+template<typename Bench, typename Key>
+void parallelMixed(Bench &bench, const KeySet<Key> &set, const Options &options, CaseResults &results)
+{
+	size_t size = set.keys.size();
+	for (unsigned threadCount : options.threads)
+	{
+		std::vector<size_t> misses(threadCount, 0);
+		std::vector<std::thread> threads;
+		Timer timer;
+		for (unsigned t = 0; t < threadCount; t++)
+		{
+			threads.emplace_back([&, t]() {
+				size_t offset = t * size / threadCount, sliceEnd = (t + 1) * size / threadCount;
+				size_t inserted = offset, removed = offset, missed = 0;
+				for (size_t i = 0; i < size; i++)
+				{
+					switch (i % 5)
+					{
+					case 3:
+						if (inserted < sliceEnd)
+						{
+							bench.insert(set.missing[inserted], inserted);
+							inserted++;
+						}
+						break;
+					case 4:
+						if (removed < inserted)
+							bench.remove(set.missing[removed++]);
+						break;
+					default:
+						missed += !bench.lookup(set.keys[set.accesses[(i + offset) % size]]);
+					}
+				}
+				while (removed < inserted)
+					bench.remove(set.missing[removed++]);
+				misses[t] = missed;
+			});
+		}
+		for (std::thread &thread : threads)
+			thread.join();
+		double elapsed = timer.nanoseconds();
+
+		bool valid = true;
+		for (size_t missed : misses)
+			valid = valid && missed == 0;
+		results.add("parallel-mixed", threadCount, static_cast<uint64_t>(size) * threadCount, elapsed, valid);
+	}
+}
+
+//The lookup-hit accesses, handed to lookupBatch in groups the size of a request handler's batch.
+//The keys are gathered in access order beforehand, so only the lookups themselves are timed
+template<typename Bench, typename Key>
+void batchedLookups(Bench &bench, const KeySet<Key> &set, CaseResults &results)
+{
+	const size_t batchSize = 256;
+	size_t size = set.keys.size();
+
+	std::vector<Key> accessed(size);
+	for (size_t i = 0; i < size; i++)
+		accessed[i] = set.keys[set.accesses[i]];
+	std::vector<uint64_t*> found(batchSize);
+
+	size_t hits = 0;
+	Timer timer;
+	for (size_t start = 0; start < size; start += batchSize)
+	{
+		size_t count = std::min(batchSize, size - start);
+		bench.lookupBatch(accessed.data() + start, count, found.data());
+		for (size_t i = 0; i < count; i++)
+			hits += found[i] != nullptr;
+	}
+	results.add("lookup-batch", 1, size, timer.nanoseconds(), hits == size);
+}
+
+//The workloads of one case, run in order on the same container:
+//insert every key, look up present and absent keys, a 60/20/20 lookup/insert/remove mix, and remove every key
+template<typename Bench, typename Key>
+void runWorkloads(const KeySet<Key> &set, const Options &options, CaseResults &results)
+{
+	size_t size = set.keys.size();
+	Bench bench;
+
+	{
+		Timer timer;
+		for (size_t i = 0; i < size; i++)
+			bench.insert(set.keys[i], i);
+		double elapsed = timer.nanoseconds();
+		if (selected(options.workloads, "insert") && !Bench::readOnly)
+			results.add("insert", 1, size, elapsed, true);
+	}
+
+	if constexpr (Bench::readOnly)
+		bench.freeze();
+
+	if (selected(options.workloads, "lookup-hit"))
+	{
+		size_t found = 0;
+		Timer timer;
+		for (size_t i = 0; i < size; i++)
+			found += bench.lookup(set.keys[set.accesses[i]]);
+		results.add("lookup-hit", 1, size, timer.nanoseconds(), found == size);
+	}
+
+	if constexpr (Bench::batchedLookups)
+	{
+		if (selected(options.workloads, "lookup-batch"))
+			batchedLookups(bench, set, results);
+	}
+
+	if (selected(options.workloads, "lookup-miss"))
+	{
+		size_t found = 0;
+		Timer timer;
+		for (size_t i = 0; i < size; i++)
+			found += bench.lookup(set.missing[set.accesses[i]]);
+		results.add("lookup-miss", 1, size, timer.nanoseconds(), found == 0);
+	}
+
+	if constexpr (Bench::readOnly)
+		return;
+
+	if (selected(options.workloads, "mixed"))
+	{
+		//Absent keys are inserted and removed again in FIFO order, so the size stays close to n
+		size_t found = 0, lookups = 0, inserted = 0, removed = 0;
+		Timer timer;
+		for (size_t i = 0; i < size; i++)
+		{
+			switch (i % 5)
+			{
+			case 3:
+				bench.insert(set.missing[inserted], inserted);
+				inserted++;
+				break;
+			case 4:
+				bench.remove(set.missing[removed++]);
+				break;
+			default:
+				found += bench.lookup(set.keys[set.accesses[i]]);
+				lookups++;
+			}
+		}
+		results.add("mixed", 1, size, timer.nanoseconds(), found == lookups);
+
+		while (removed < inserted)
+			bench.remove(set.missing[removed++]);
+	}
+
+	if constexpr (Bench::concurrentReads)
+	{
+		if (selected(options.workloads, "parallel-lookup"))
+			parallelLookups(bench, set, options, results);
+	}
+
+	if constexpr (Bench::concurrentWrites)
+	{
+		if (selected(options.workloads, "parallel-mixed"))
+			parallelMixed(bench, set, options, results);
+	}
+
+	{
+		Timer timer;
+		for (size_t i = 0; i < size; i++)
+			bench.remove(set.keys[set.removals[i]]);
+		double elapsed = timer.nanoseconds();
+		if (selected(options.workloads, "remove"))
+			results.add("remove", 1, size, elapsed, !bench.lookup(set.keys[0]));
+	}
+}
+
+template<typename Bench, typename Key>
+std::vector<Result> runCase(const std::string &distribution, size_t size, const Options &options)
+{
+	return runIsolated(Bench::name, distribution, size, [&](CaseResults &results) {
+		KeySet<Key> set(size, distribution, options.seed);
+		runWorkloads<Bench>(set, options, results);
+	});
+}
+
+template<template<typename> class Bench>
+void runContainer(const Options &options, std::vector<Result> &all)
+{
+	using IntegerBench = Bench<uint64_t>;
+	if (!selected(options.containers, IntegerBench::name))
+		return;
+
+	for (size_t size : options.sizes)
+	{
+		for (const std::string &distribution : options.distributions)
+		{
+			if (size > options.linearLimit && (IntegerBench::linearTime || (IntegerBench::unbalanced && distribution == "sequential")))
+			{
+				std::cerr << "skipping " << IntegerBench::name << " / " << distribution << " / " << size << " (over --linear-limit)" << std::endl;
+				continue;
+			}
+
+			//The fastest of the repeated runs is kept for every workload
+			std::vector<Result> best;
+			for (unsigned run = 0; run < options.repeat; run++)
+			{
+				std::vector<Result> results = (distribution == "string") ?
+					runCase<Bench<std::string>, std::string>(distribution, size, options) :
+					runCase<IntegerBench, uint64_t>(distribution, size, options);
+
+				if (best.empty())
+					best = results;
+				for (size_t i = 0; i < results.size() && i < best.size(); i++)
+				{
+					if (results[i].nanoseconds < best[i].nanoseconds)
+						best[i] = results[i];
+					best[i].valid = best[i].valid && results[i].valid;
+				}
+			}
+
+			for (const Result &result : best)
+			{
+				printTableRow(std::cout, result);
+				all.push_back(result);
+			}
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	Options options = parseOptions(argc, argv);
+	std::vector<Result> all;
+
+	printTableHeader(std::cout);
+	runContainer<DictionaryBench>(options, all);
+	runContainer<UnrolledDictionaryBench>(options, all);
+	runContainer<BSTBench>(options, all);
+	runContainer<AVLBench>(options, all);
+	runContainer<CompactAVLBench>(options, all);
+	runContainer<ARTBench>(options, all);
+	runContainer<StaticSearchTreeBench>(options, all);
+	runContainer<BTreeBench>(options, all);
+	runContainer<HashDictionaryBench>(options, all);
+	runContainer<ConcurrentDictionaryBench>(options, all);
+	runContainer<PersistentAVLBench>(options, all);
+	runContainer<SkipListBench>(options, all);
+	runContainer<LockedAVLBench>(options, all);
+	runContainer<StdMapBench>(options, all);
+	runContainer<StdUnorderedMapBench>(options, all);
+
+	if (!options.csvFile.empty())
+		writeCsv(options.csvFile, all);
+	if (!options.jsonFile.empty())
+		writeJson(options.jsonFile, all);
+
+	//A container returning wrong results fails the run so that scripts catch it
+	for (const Result &result : all)
+	{
+		if (!result.valid)
+			return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,53 @@
+#include "stress.h"
+
+#include "SkipList.h"
+
+using namespace Stress;
+
+//Stress test of the lock-free SkipList and its epoch based reclamation.
+//Results are checked per thread against sequential models and, on shared keys, for linearizability,
+//while an extra thread iterates the list checking the key order and that every item belongs to its key.
+int main(int argc, char* argv[])
+{
+	Options options = parseOptions(argc, argv);
+	Failures failures;
+
+	{
+		Containers::SkipList<uint64_t, uint64_t> list;
+		std::map<uint64_t, uint64_t> expected = disjointKeys(list, options, failures, [&](const std::atomic<bool> &stop) {
+			while (!stop.load())
+			{
+				bool first = true;
+				uint64_t previous = 0;
+				list.forEach([&](const uint64_t &key, const uint64_t &item) {
+					if (!first && !(previous < key))
+						failures.report("forEach visited " + std::to_string(key) + " after " + std::to_string(previous));
+					if (itemKey(item) != key)
+						failures.report("forEach found an item stored under " + std::to_string(itemKey(item)) + " at " + std::to_string(key));
+					first = false;
+					previous = key;
+				});
+			}
+		});
+
+		//Quiescent now, iteration has to see exactly the entries of the models
+		auto next = expected.begin();
+		list.forEach([&](const uint64_t &key, const uint64_t &item) {
+			if (next == expected.end() || next->first != key || next->second != item)
+				failures.report("forEach after the run found " + std::to_string(key) + " out of place");
+			else
+				++next;
+		});
+		if (next != expected.end())
+			failures.report("forEach after the run missed " + std::to_string(next->first));
+
+		contendedKeys(list, options, failures);
+	}
+
+	{
+		Containers::SkipList<uint64_t, uint64_t> list;
+		sharedKeys(list, options, failures);
+	}
+
+	return finish("SkipList", failures);
+}
@@ -0,0 +1,432 @@
+#ifndef STRESS_H
+#define STRESS_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+//Shared harness of the concurrent container stress tests. Containers are driven through insert(key, item),
+//remove(key) returning whether an entry went, lookup(key, item) copying the item out and contains(key).
+//Every result is checked: against a sequential model where each thread owns its keys, and by a linearizability
+//check of the recorded history where all threads share a few keys.
+
+namespace Stress
+{
+	struct Options
+	{
+		unsigned threads = 4;
+		size_t operations = 200000;		//per thread, on its own keys
+		size_t rounds = 2000;			//of shared key histories
+		uint64_t seed = 42;
+	};
+
+	inline void printUsage(const char* program)
+	{
+		std::cout << "Usage: " << program << R"( [options]
+  --threads N              worker threads (default 4)
+  --operations N           operations per thread on its own keys (default 200000)
+  --rounds N               rounds of shared key operations, each one checked for linearizability (default 2000)
+  --seed N                 random seed
+)";
+	}
+
+	inline Options parseOptions(int argc, char* argv[])
+	{
+		Options options;
+		for (int i = 1; i < argc; i++)
+		{
+			std::string option = argv[i];
+			if (option == "--help" || option == "-h" || i + 1 >= argc)
+			{
+				printUsage(argv[0]);
+				exit(option == "--help" || option == "-h" ? EXIT_SUCCESS : EXIT_FAILURE);
+			}
+
+			std::string value = argv[++i];
+			if (option == "--threads")
+				options.threads = std::min(32, std::max(1, std::stoi(value)));
+			else if (option == "--operations")
+				options.operations = std::stoull(value);
+			else if (option == "--rounds")
+				options.rounds = std::stoull(value);
+			else if (option == "--seed")
+				options.seed = std::stoull(value);
+			else
+			{
+				printUsage(argv[0]);
+				exit(EXIT_FAILURE);
+			}
+		}
+		return options;
+	}
+
+	//Counts failed checks from any thread, printing the first few
+	class Failures
+	{
+	public:
+		void report(const std::string &message)
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (count++ < printLimit)
+				std::cerr << "FAILED: " << message << std::endl;
+		}
+
+		size_t total() const
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			return count;
+		}
+
+	private:
+		static const size_t printLimit = 20;
+		mutable std::mutex lock;
+		size_t count = 0;
+	};
+
+	//Reusable barrier, C++17 has no std::barrier
+	class Barrier
+	{
+	public:
+		explicit Barrier(unsigned _parties) : parties(_parties) {}
+
+		void wait()
+		{
+			unsigned generation = phase.load();
+			if (arrived.fetch_add(1) + 1 == parties)
+			{
+				arrived.store(0);
+				phase.fetch_add(1);
+				return;
+			}
+			while (phase.load() == generation)
+				std::this_thread::yield();
+		}
+
+	private:
+		const unsigned parties;
+		std::atomic<unsigned> arrived{ 0 };
+		std::atomic<unsigned> phase{ 0 };
+	};
+
+	//An item records the key it was stored under, so an item read back under another key, or freed and reused, shows
+	inline uint64_t makeItem(uint64_t key, uint64_t version)
+	{
+		return (key << 24) | (version & 0xFFFFFF);
+	}
+
+	inline uint64_t itemKey(uint64_t item)
+	{
+		return item >> 24;
+	}
+
+	//Every thread works on its own keys, interleaved with those of the others (key % threads == thread) so that
+	//neighbouring entries are written by different threads, and checks every result against a sequential model.
+	//background runs on one more thread until the workers are done, it is given a flag telling it to stop.
+	//Returns the final contents of all models.
+	template<typename Container>
+	std::map<uint64_t, uint64_t> disjointKeys(Container &container, const Options &options, Failures &failures,
+		std::function<void(const std::atomic<bool> &)> background = nullptr)
+	{
+		const uint64_t keysPerThread = 1024;
+		std::vector<std::map<uint64_t, uint64_t>> models(options.threads);
+		std::atomic<bool> stop{ false };
+
+		std::thread observer;
+		if (background)
+			observer = std::thread([&]() { background(stop); });
+
+		std::vector<std::thread> workers;
+		for (unsigned t = 0; t < options.threads; t++)
+		{
+			workers.emplace_back([&, t]() {
+				std::mt19937_64 random(options.seed + t);
+				std::map<uint64_t, uint64_t> &model = models[t];
+
+				for (size_t i = 0; i < options.operations; i++)
+				{
+					uint64_t key = (random() % keysPerThread) * options.threads + t;
+					auto expected = model.find(key);
+					bool present = expected != model.end();
+					unsigned choice = random() % 10;
+
+					if (choice < 4)
+					{
+						uint64_t item = makeItem(key, i);
+						container.insert(key, item);
+						model[key] = item;
+					}
+					else if (choice < 7)
+					{
+						bool removed = container.remove(key);
+						if (removed != present)
+							failures.report("remove(" + std::to_string(key) + ") returned " + std::to_string(removed) + ", the model says " + std::to_string(present));
+						model.erase(key);
+					}
+					else if (choice < 9)
+					{
+						uint64_t item = 0;
+						bool found = container.lookup(key, item);
+						if (found != present || (found && item != expected->second))
+							failures.report("lookup(" + std::to_string(key) + ") returned " + std::to_string(found) + " / " + std::to_string(item) +
+								", the model says " + std::to_string(present) + " / " + std::to_string(present ? expected->second : 0));
+					}
+					else if (container.contains(key) != present)
+						failures.report("contains(" + std::to_string(key) + ") disagrees with the model");
+
+					if (random() % 64 == 0)
+						std::this_thread::yield();
+				}
+			});
+		}
+		for (std::thread &worker : workers)
+			worker.join();
+		stop.store(true);
+		if (observer.joinable())
+			observer.join();
+
+		std::map<uint64_t, uint64_t> all;
+		for (const std::map<uint64_t, uint64_t> &model : models)
+			all.insert(model.begin(), model.end());
+
+		for (const auto &entry : all)
+		{
+			uint64_t item = 0;
+			if (!container.lookup(entry.first, item) || item != entry.second)
+				failures.report("key " + std::to_string(entry.first) + " lost or wrong after the run");
+		}
+		if (container.size() != all.size())
+			failures.report("size() is " + std::to_string(container.size()) + ", the models hold " + std::to_string(all.size()));
+		return all;
+	}
+
+	//All threads insert, remove and look up the same few keys as fast as they can, so that entries are unlinked and
+	//reclaimed while others are reading them. Results cannot be predicted here, but every item read has to be
+	//one stored under that key, and the size has to match the entries present at the end
+	template<typename Container>
+	void contendedKeys(Container &container, const Options &options, Failures &failures)
+	{
+		const uint64_t keyCount = 16;
+		const uint64_t firstKey = uint64_t(1) << 33;
+		size_t sizeBefore = container.size();
+
+		std::vector<std::thread> workers;
+		for (unsigned t = 0; t < options.threads; t++)
+		{
+			workers.emplace_back([&, t]() {
+				std::mt19937_64 random(options.seed * 17 + t);
+				for (size_t i = 0; i < options.operations; i++)
+				{
+					uint64_t key = firstKey + random() % keyCount;
+					unsigned choice = random() % 3;
+					uint64_t item = 0;
+					if (choice == 0)
+						container.insert(key, makeItem(key, i));
+					else if (choice == 1)
+						container.remove(key);
+					else if (container.lookup(key, item) && itemKey(item) != key)
+						failures.report("lookup(" + std::to_string(key) + ") returned an item stored under " + std::to_string(itemKey(item)));
+				}
+			});
+		}
+		for (std::thread &worker : workers)
+			worker.join();
+
+		size_t present = 0;
+		for (uint64_t k = 0; k < keyCount; k++)
+			present += container.contains(firstKey + k);
+		if (container.size() != sizeBefore + present)
+			failures.report("size() is " + std::to_string(container.size()) + " after the contended run, " +
+				std::to_string(sizeBefore + present) + " keys are present");
+	}
+
+	enum class Operation { Insert, Remove, Lookup };
+
+	//One completed call. invoke and response are taken from a shared counter just before and after the call,
+	//an event whose response precedes another's invoke happened before it
+	struct Event
+	{
+		uint64_t key;
+		Operation operation;
+		uint64_t item;		//Inserted, or returned by lookup
+		bool result;		//Returned by remove or lookup
+		uint64_t invoke;
+		uint64_t response;
+	};
+
+	struct KeyState
+	{
+		bool present = false;
+		uint64_t item = 0;
+	};
+
+	//Applies an event to the state of its key, returns whether its result is the one a sequential run would give
+	inline bool apply(const Event &event, KeyState &state)
+	{
+		switch (event.operation)
+		{
+		case Operation::Insert:
+			state = { true, event.item };
+			return true;
+		case Operation::Remove:
+		{
+			bool valid = event.result == state.present;
+			state = KeyState();
+			return valid;
+		}
+		default:
+			return event.result == state.present && (!event.result || event.item == state.item);
+		}
+	}
+
+	//Wing and Gong's search with memoization (Lowe): tries every order of the events of one key that respects
+	//their real time order, looking for one in which each result matches the sequential specification
+	inline bool linearizable(const std::vector<Event> &events, uint64_t done, KeyState state,
+		std::set<std::tuple<uint64_t, bool, uint64_t>> &failed)
+	{
+		if (done == (events.size() == 64 ? ~uint64_t(0) : (uint64_t(1) << events.size()) - 1))
+			return true;
+		if (failed.count(std::make_tuple(done, state.present, state.item)) != 0)
+			return false;
+
+		//Only an event invoked before every pending event has responded can come next
+		uint64_t firstResponse = ~uint64_t(0);
+		for (size_t i = 0; i < events.size(); i++)
+		{
+			if ((done & (uint64_t(1) << i)) == 0)
+				firstResponse = std::min(firstResponse, events[i].response);
+		}
+
+		for (size_t i = 0; i < events.size(); i++)
+		{
+			if ((done & (uint64_t(1) << i)) != 0 || events[i].invoke > firstResponse)
+				continue;
+
+			KeyState next = state;
+			if (apply(events[i], next) && linearizable(events, done | (uint64_t(1) << i), next, failed))
+				return true;
+		}
+
+		failed.insert(std::make_tuple(done, state.present, state.item));
+		return false;
+	}
+
+	inline std::string describe(const std::vector<Event> &events)
+	{
+		const char* names[] = { "insert", "remove", "lookup" };
+		std::ostringstream text;
+		for (const Event &event : events)
+		{
+			text << "\n  [" << event.invoke << ", " << event.response << "] " << names[static_cast<int>(event.operation)]
+				<< " -> " << event.result << " / " << event.item;
+		}
+		return text.str();
+	}
+
+	//All threads hammer a few shared keys in rounds. Every round's history is checked key by key for linearizability,
+	//starting from the state the previous round ended in, and ends with one lookup per key once the threads are quiet
+	template<typename Container>
+	void sharedKeys(Container &container, const Options &options, Failures &failures)
+	{
+		const uint64_t keyCount = 4;
+		const uint64_t firstKey = uint64_t(1) << 32;
+		//A key's history, with the final lookup, has to fit the 64 bit masks of the search
+		const size_t operationsPerRound = std::min<size_t>(6, 63 / options.threads);
+
+		std::atomic<uint64_t> clock{ 0 };
+		std::vector<std::vector<Event>> histories(options.threads);
+		std::vector<KeyState> states(keyCount);
+		Barrier barrier(options.threads);
+
+		for (uint64_t k = 0; k < keyCount; k++)
+			container.remove(firstKey + k);
+
+		std::vector<std::thread> workers;
+		for (unsigned t = 0; t < options.threads; t++)
+		{
+			workers.emplace_back([&, t]() {
+				std::mt19937_64 random(options.seed * 31 + t);
+				for (size_t round = 0; round < options.rounds; round++)
+				{
+					std::vector<Event> &history = histories[t];
+					history.clear();
+					for (size_t i = 0; i < operationsPerRound; i++)
+					{
+						uint64_t key = firstKey + random() % keyCount;
+						Event event = { key, static_cast<Operation>(random() % 3), 0, false, 0, 0 };
+						if (event.operation == Operation::Insert)
+							event.item = makeItem(t, round * operationsPerRound + i);
+
+						event.invoke = clock.fetch_add(1);
+						if (event.operation == Operation::Insert)
+							container.insert(key, event.item);
+						else if (event.operation == Operation::Remove)
+							event.result = container.remove(key);
+						else
+							event.result = container.lookup(key, event.item);
+						event.response = clock.fetch_add(1);
+
+						history.push_back(event);
+						if (random() % 4 == 0)
+							std::this_thread::yield();
+					}
+
+					barrier.wait();
+					if (t == 0)
+					{
+						for (uint64_t k = 0; k < keyCount; k++)
+						{
+							std::vector<Event> events;
+							for (const std::vector<Event> &threadHistory : histories)
+							{
+								for (const Event &event : threadHistory)
+								{
+									if (event.key == firstKey + k)
+										events.push_back(event);
+								}
+							}
+
+							Event final = { firstKey + k, Operation::Lookup, 0, false, clock.fetch_add(1), 0 };
+							final.result = container.lookup(final.key, final.item);
+							final.response = clock.fetch_add(1);
+							events.push_back(final);
+
+							std::set<std::tuple<uint64_t, bool, uint64_t>> failed;
+							if (!linearizable(events, 0, states[k], failed))
+								failures.report("round " + std::to_string(round) + " of key " + std::to_string(k) + " is not linearizable, starting from " +
+									(states[k].present ? std::to_string(states[k].item) : std::string("absent")) + ":" + describe(events));
+							states[k] = { final.result, final.result ? final.item : 0 };
+						}
+					}
+					barrier.wait();
+				}
+			});
+		}
+		for (std::thread &worker : workers)
+			worker.join();
+	}
+
+	inline int finish(const char* name, const Failures &failures)
+	{
+		if (failures.total() == 0)
+		{
+			std::cout << name << ": all checks passed" << std::endl;
+			return EXIT_SUCCESS;
+		}
+		std::cout << name << ": " << failures.total() << " checks failed" << std::endl;
+		return EXIT_FAILURE;
+	}
+}
+
+#endif // !STRESS_H
@@ -0,0 +1,542 @@
+#ifndef COMPACTAVL_H
+#define COMPACTAVL_H
+
+#include <string>
+#include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <assert.h>
+
+#include "KeyTraits.h"
+
+//AVL dictionary for small keys and items, where the links of AVL.h outweigh the entries.
+//The nodes live in one contiguous vector and link their children by 32-bit index. The balance factor needs no field
+//of its own: the top bit of each child index marks the taller side. An int to int node takes 16 bytes, against 40 in AVL.h.
+//Removal moves the last node of the vector into the freed slot, so the vector stays dense.
+//Items move with their nodes: pointers returned by lookup stay valid only until the next insertion or removal.
+template<typename K, typename I, typename C = std::less<K>>
+class CompactAVL
+{
+public:
+	using Key = K;
+	using Item = I;
+	using Compare = C;
+
+
+	void insert(Key, Item);
+	void remove(const Key &);
+	Item* lookup(const Key &);
+
+	//Heterogeneous overloads for types comparable with Key, e.g. std::string_view for std::string keys
+	template<typename KeyLike, typename = EnableIfOrderedKey<K, KeyLike, Compare>>
+	void remove(const KeyLike &);
+	template<typename KeyLike, typename = EnableIfOrderedKey<K, KeyLike, Compare>>
+	Item* lookup(const KeyLike &);
+
+	//Constructs the item from args only if the key is absent, returns the item and whether it was inserted
+	template<typename... Args>
+	std::pair<Item*, bool> try_emplace(Key, Args&&...);
+	//Inserts, or assigns to the existing item
+	template<typename ItemArg>
+	std::pair<Item*, bool> insert_or_assign(Key, ItemArg &&);
+
+	void clear();
+	//Reserves room for the given number of entries, so that inserting up to it does not reallocate
+	void reserve(size_t);
+
+	size_t size() const { return nodes.size(); }
+	bool empty() const { return nodes.empty(); }
+	//Bytes held by the node vector, reserved capacity included
+	size_t memoryUsage() const { return nodes.capacity() * sizeof(Node); }
+
+	//Calls function(key, item) for every entry in key order
+	template<typename Function>
+	void forEach(Function) const;
+
+	void printEntries() const;
+	void printTree() const;
+
+	int height() const;
+	//Walks the whole tree checking key order, the balance bits and the AVL height invariant
+	bool checkInvariants() const;
+
+	//Index 0x7FFFFFFF marks a missing child, the top bit of a link holds the balance
+	static constexpr size_t maxSize = 0x7FFFFFFF;
+
+	template<typename KT, typename IT, typename CT>
+	friend std::ostream & operator<<(std::ostream &, const CompactAVL<KT, IT, CT> &);
+
+
+
+	CompactAVL() = default;
+	explicit CompactAVL(const Compare &);
+
+private:
+	using Index = uint32_t;
+
+	static const Index none = 0x7FFFFFFF;
+	static const Index indexMask = 0x7FFFFFFF;
+	//Positions in the links word of a node: left index in the low half, right index in the high half
+	static const uint64_t leftTaller = uint64_t(1) << 31;
+	static const uint64_t rightTaller = uint64_t(1) << 63;
+	static const uint64_t noChildren = (uint64_t(none) << 32) | none;
+
+	//A tree of 2^31 nodes is at most 45 levels deep
+	static const int maxDepth = 48;
+
+	struct Node
+	{
+		Key key;
+		Item item;
+		//Both child indices in one word, each with its top bit set on the side of the taller subtree.
+		//A descent loads the word with the key and shifts the next index out of it, instead of a load that waits on the comparison
+		uint64_t links = noChildren;
+
+		template<typename KeyArg, typename... Args>
+		Node(KeyArg &&_key, Args&&... args) : key(std::forward<KeyArg>(_key)), item(std::forward<Args>(args)...) {}
+	};
+
+	//A node on the descent path and the side (-1 left, +1 right) taken below it
+	struct PathEntry
+	{
+		Index node;
+		int direction;
+	};
+
+	Index leftChild(Index current) const { return static_cast<Index>(nodes[current].links) & indexMask; }
+	Index rightChild(Index current) const { return static_cast<Index>(nodes[current].links >> 32) & indexMask; }
+	void setLeft(Index current, Index child) { nodes[current].links = (nodes[current].links & ~uint64_t(indexMask)) | child; }
+	void setRight(Index current, Index child)
+	{
+		nodes[current].links = (nodes[current].links & ~(uint64_t(indexMask) << 32)) | (uint64_t(child) << 32);
+	}
+	int balanceOf(Index) const;
+	void setBalance(Index, int);
+
+	//One three way comparison per node, see ThreeWayCompare in KeyTraits.h
+	template<typename Left, typename Right>
+	int compareKeys(const Left &a, const Right &b) const { return ThreeWayCompare<Compare>::compare(keyLess, a, b); }
+
+	template<typename KeyLike>
+	Index find(const KeyLike &) const;
+	template<typename KeyLike>
+	void removeNode(const KeyLike &);
+	//Points the link that led to path[depth] at child instead, the root when depth is 0
+	void relink(const PathEntry*, int, Index);
+	Index rebalance(Index, int);
+	void fillHole(Index);
+	void printTreeRec(Index, int) const;
+	int checkInvariantsRec(Index, const Key*, const Key*) const;
+
+	std::vector<Node> nodes;
+	Index root = none;
+	Compare keyLess;
+};
+
+template<typename K, typename I, typename C>
+CompactAVL<K, I, C>::CompactAVL(const Compare &_keyLess) : keyLess(_keyLess)
+{
+}
+
+//-1, 0 or +1 from the taller bits of the two links
+template<typename K, typename I, typename C>
+int CompactAVL<K, I, C>::balanceOf(Index current) const
+{
+	uint64_t links = nodes[current].links;
+	return ((links & rightTaller) ? 1 : 0) - ((links & leftTaller) ? 1 : 0);
+}
+
+template<typename K, typename I, typename C>
+void CompactAVL<K, I, C>::setBalance(Index current, int balance)
+{
+	assert(balance >= -1 && balance <= 1);
+	Node &node = nodes[current];
+	node.links = (node.links & ~(leftTaller | rightTaller)) | (balance < 0 ? leftTaller : 0) | (balance > 0 ? rightTaller : 0);
+}
+
+template<typename K, typename I, typename C>
+template<typename KeyLike>
+typename CompactAVL<K, I, C>::Index CompactAVL<K, I, C>::find(const KeyLike &_key) const
+{
+	const Node* data = nodes.data();
+	Index current = root;
+	while (current != none)
+	{
+		const Node &node = data[current];
+		int order = compareKeys(node.key, _key);
+		if (order == 0)
+			return current;
+		current = static_cast<Index>(node.links >> (order < 0 ? 32 : 0)) & indexMask;
+	}
+	return none;
+}
+
+template<typename K, typename I, typename C>
+typename CompactAVL<K, I, C>::Item* CompactAVL<K, I, C>::lookup(const Key &_key)
+{
+	Index found = find(_key);
+	return (found == none) ? nullptr : &nodes[found].item;
+}
+
+template<typename K, typename I, typename C>
+template<typename KeyLike, typename>
+typename CompactAVL<K, I, C>::Item* CompactAVL<K, I, C>::lookup(const KeyLike &_key)
+{
+	Index found = find(_key);
+	return (found == none) ? nullptr : &nodes[found].item;
+}
+
+template<typename K, typename I, typename C>
+void CompactAVL<K, I, C>::insert(Key _key, Item _item)
+{
+	insert_or_assign(std::move(_key), std::move(_item));
+}
+
+template<typename K, typename I, typename C>
+template<typename ItemArg>
+std::pair<typename CompactAVL<K, I, C>::Item*, bool> CompactAVL<K, I, C>::insert_or_assign(Key _key, ItemArg &&_item)
+{
+	std::pair<Item*, bool> result = try_emplace(std::move(_key), std::forward<ItemArg>(_item));
+	if (!result.second)
+		*result.first = std::forward<ItemArg>(_item);
+	return result;
+}
+
+//Iterative insertion on a path of indices: the vector may grow when the node is added, indices survive that
+template<typename K, typename I, typename C>
+template<typename... Args>
+std::pair<typename CompactAVL<K, I, C>::Item*, bool> CompactAVL<K, I, C>::try_emplace(Key _key, Args&&... args)
+{
+	PathEntry path[maxDepth];
+	int depth = 0;
+
+	for (Index current = root; current != none; )
+	{
+		int order = compareKeys(nodes[current].key, _key);
+		if (order == 0)
+			return { &nodes[current].item, false };
+
+		assert(depth < maxDepth);
+		int direction = (order < 0) ? 1 : -1;
+		path[depth++] = { current, direction };
+		current = (direction == 1) ? rightChild(current) : leftChild(current);
+	}
+
+	if (nodes.size() >= maxSize)
+		throw std::length_error("CompactAVL cannot hold more than 2^31 - 1 entries");
+
+	Index created = static_cast<Index>(nodes.size());
+	nodes.emplace_back(std::move(_key), std::forward<Args>(args)...);
+	relink(path, depth, created);
+
+	//Retrace: one rotation at most restores the height the subtree had before the insertion
+	while (depth > 0)
+	{
+		PathEntry &entry = path[--depth];
+		int balance = balanceOf(entry.node) + entry.direction;
+
+		if (balance == 0)
+		{
+			setBalance(entry.node, 0);
+			break;
+		}
+		if (balance == 1 || balance == -1)
+		{
+			setBalance(entry.node, balance);
+			continue;
+		}
+
+		relink(path, depth, rebalance(entry.node, balance));
+		break;
+	}
+
+	return { &nodes[created].item, true };
+}
+
+template<typename K, typename I, typename C>
+void CompactAVL<K, I, C>::relink(const PathEntry* path, int depth, Index child)
+{
+	if (depth == 0)
+		root = child;
+	else if (path[depth - 1].direction == 1)
+		setRight(path[depth - 1].node, child);
+	else
+		setLeft(path[depth - 1].node, child);
+}
+
+//Restores a node whose balance reached +2 or -2, which the two link bits cannot hold, and returns the subtree's new root.
+//The final balance factors are set directly for the single and the double rotation
+template<typename K, typename I, typename C>
+typename CompactAVL<K, I, C>::Index CompactAVL<K, I, C>::rebalance(Index current, int balance)
+{
+	if (balance == 2)
+	{
+		Index child = rightChild(current);
+		int childBalance = balanceOf(child);
+		if (childBalance >= 0)
+		{
+			setRight(current, leftChild(child));
+			setLeft(child, current);
+			setBalance(current, childBalance == 0 ? 1 : 0);
+			setBalance(child, childBalance == 0 ? -1 : 0);
+			return child;
+		}
+
+		Index grandchild = leftChild(child);
+		int grandchildBalance = balanceOf(grandchild);
+		setRight(current, leftChild(grandchild));
+		setLeft(child, rightChild(grandchild));
+		setLeft(grandchild, current);
+		setRight(grandchild, child);
+		setBalance(current, grandchildBalance == 1 ? -1 : 0);
+		setBalance(child, grandchildBalance == -1 ? 1 : 0);
+		setBalance(grandchild, 0);
+		return grandchild;
+	}
+
+	Index child = leftChild(current);
+	int childBalance = balanceOf(child);
+	if (childBalance <= 0)
+	{
+		setLeft(current, rightChild(child));
+		setRight(child, current);
+		setBalance(current, childBalance == 0 ? -1 : 0);
+		setBalance(child, childBalance == 0 ? 1 : 0);
+		return child;
+	}
+
+	Index grandchild = rightChild(child);
+	int grandchildBalance = balanceOf(grandchild);
+	setLeft(current, rightChild(grandchild));
+	setRight(child, leftChild(grandchild));
+	setRight(grandchild, current);
+	setLeft(grandchild, child);
+	setBalance(current, grandchildBalance == -1 ? 1 : 0);
+	setBalance(child, grandchildBalance == 1 ? -1 : 0);
+	setBalance(grandchild, 0);
+	return grandchild;
+}
+
+template<typename K, typename I, typename C>
+void CompactAVL<K, I, C>::remove(const Key &_key)
+{
+	removeNode(_key);
+}
+
+template<typename K, typename I, typename C>
+template<typename KeyLike, typename>
+void CompactAVL<K, I, C>::remove(const KeyLike &_key)
+{
+	removeNode(_key);
+}
+
+//Iterative removal: a node with two children takes over the entry of its in-order successor,
+//whose node is unlinked instead, then the freed slot is filled from the end of the vector
+template<typename K, typename I, typename C>
+template<typename KeyLike>
+void CompactAVL<K, I, C>::removeNode(const KeyLike &_key)
+{
+	PathEntry path[maxDepth];
+	int depth = 0;
+
+	Index target = root;
+	while (target != none)
+	{
+		int order = compareKeys(nodes[target].key, _key);
+		if (order == 0)
+			break;
+
+		assert(depth < maxDepth);
+		int direction = (order < 0) ? 1 : -1;
+		path[depth++] = { target, direction };
+		target = (direction == 1) ? rightChild(target) : leftChild(target);
+	}
+
+	if (target == none)
+		return;
+
+	Index removed = target;
+	if (leftChild(target) != none && rightChild(target) != none)
+	{
+		path[depth++] = { target, 1 };
+		removed = rightChild(target);
+		while (leftChild(removed) != none)
+		{
+			assert(depth < maxDepth);
+			path[depth++] = { removed, -1 };
+			removed = leftChild(removed);
+		}
+
+		nodes[target].key = std::move(nodes[removed].key);
+		nodes[target].item = std::move(nodes[removed].item);
+	}
+
+	relink(path, depth, (leftChild(removed) == none) ? rightChild(removed) : leftChild(removed));
+
+	//Retrace: keep going while the subtree height has shrunk
+	while (depth > 0)
+	{
+		PathEntry &entry = path[--depth];
+		int balance = balanceOf(entry.node) - entry.direction;
+
+		if (balance == 1 || balance == -1)
+		{
+			setBalance(entry.node, balance);
+			break;
+		}
+		if (balance == 0)
+		{
+			setBalance(entry.node, 0);
+			continue;
+		}
+
+		Index subtreeRoot = rebalance(entry.node, balance);
+		relink(path, depth, subtreeRoot);
+		if (balanceOf(subtreeRoot) != 0)
+			break;
+	}
+
+	fillHole(removed);
+}
+
+//Moves the last node of the vector into an unlinked slot, found again from the root by its key
+template<typename K, typename I, typename C>
+void CompactAVL<K, I, C>::fillHole(Index hole)
+{
+	Index last = static_cast<Index>(nodes.size() - 1);
+	if (hole != last)
+	{
+		if (root == last)
+			root = hole;
+		else
+		{
+			Index parent = root;
+			while (true)
+			{
+				int order = compareKeys(nodes[parent].key, nodes[last].key);
+				Index next = (order < 0) ? rightChild(parent) : leftChild(parent);
+				if (next == last)
+					break;
+				parent = next;
+			}
+
+			if (rightChild(parent) == last)
+				setRight(parent, hole);
+			else
+				setLeft(parent, hole);
+		}
+		nodes[hole] = std::move(nodes[last]);
+	}
+	nodes.pop_back();
+}
+
+template<typename K, typename I, typename C>
+void CompactAVL<K, I, C>::clear()
+{
+	nodes.clear();
+	root = none;
+}
+
+template<typename K, typename I, typename C>
+void CompactAVL<K, I, C>::reserve(size_t count)
+{
+	nodes.reserve(std::min(count, maxSize));
+}
+
+//In-order walk on an explicit stack of indices
+template<typename K, typename I, typename C>
+template<typename Function>
+void CompactAVL<K, I, C>::forEach(Function function) const
+{
+	Index stack[maxDepth];
+	int depth = 0;
+
+	Index current = root;
+	while (current != none || depth > 0)
+	{
+		for (; current != none; current = leftChild(current))
+			stack[depth++] = current;
+
+		current = stack[--depth];
+		function(nodes[current].key, nodes[current].item);
+		current = rightChild(current);
+	}
+}
+
+template<typename K, typename I, typename C>
+int CompactAVL<K, I, C>::height() const
+{
+	int treeHeight = 0;
+	for (Index current = root; current != none; ++treeHeight)
+		current = (balanceOf(current) > 0) ? rightChild(current) : leftChild(current);
+
+	return treeHeight;
+}
+
+template<typename K, typename I, typename C>
+bool CompactAVL<K, I, C>::checkInvariants() const
+{
+	return checkInvariantsRec(root, nullptr, nullptr) >= 0;
+}
+
+//Returns the height of the subtree, or -1 if any node breaks the ordering,
+//has stale balance bits or is out of balance
+template<typename K, typename I, typename C>
+int CompactAVL<K, I, C>::checkInvariantsRec(Index current, const Key* lowerBound, const Key* upperBound) const
+{
+	if (current == none)
+		return 0;
+
+	const Key &key = nodes[current].key;
+	if ((lowerBound != nullptr && !keyLess(*lowerBound, key)) ||
+		(upperBound != nullptr && !keyLess(key, *upperBound)))
+		return -1;
+
+	int leftHeight = checkInvariantsRec(leftChild(current), lowerBound, &key);
+	int rightHeight = checkInvariantsRec(rightChild(current), &key, upperBound);
+	if (leftHeight < 0 || rightHeight < 0)
+		return -1;
+
+	int balance = rightHeight - leftHeight;
+	if (balance != balanceOf(current) || balance < -1 || balance > 1)
+		return -1;
+
+	return std::max(leftHeight, rightHeight) + 1;
+}
+
+template<typename K, typename I, typename C>
+void CompactAVL<K, I, C>::printEntries() const
+{
+	std::cout << *this;
+}
+
+template<typename K, typename I, typename C>
+void CompactAVL<K, I, C>::printTree() const
+{
+	printTreeRec(root, 0);
+}
+
+template<typename K, typename I, typename C>
+void CompactAVL<K, I, C>::printTreeRec(Index current, int indent) const
+{
+	if (current == none)
+		return;
+	std::cout << std::string(indent, '\t') << nodes[current].key << " " <<
+		((leftChild(current) == none && rightChild(current) == none) ? "*" : " ") <<
+		nodes[current].item << " (" << balanceOf(current) << ")" << std::endl;
+	printTreeRec(leftChild(current), indent + 1);
+	printTreeRec(rightChild(current), indent + 1);
+}
+
+template<typename K, typename I, typename C>
+std::ostream & operator<<(std::ostream &os, const CompactAVL<K, I, C> &tree)
+{
+	tree.forEach([&os](const K &key, const I &item) { os << key << " " << item << std::endl; });
+	return os;
+}
+
+#endif // !COMPACTAVL_H
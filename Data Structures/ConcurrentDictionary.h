@@ -0,0 +1,216 @@
+#ifndef CONCURRENTDICTIONARY_H
+#define CONCURRENTDICTIONARY_H
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <utility>
+
+#include "HashDictionary.h"
+
+namespace Containers
+{
+	//Thread safe dictionary: keys are spread over independently locked shards, each one a HashDictionary.
+	//Readers only ever take a shared lock, so lookups of different keys - or of the same key - run in parallel;
+	//writers lock a single shard exclusively.
+	//Items never leave a shard by pointer, lookups copy them out or run a visitor under the shard lock.
+	template<typename K, typename I, typename Hash = std::hash<K>>
+	class ConcurrentDictionary
+	{
+	public:
+		using Key = K;
+		using Item = I;
+
+		void insert(Key, Item);
+		//Returns whether an entry was removed
+		bool remove(const Key &);
+		//Copies the item into result, returns whether the key was found
+		bool lookup(const Key &, Item &) const;
+		bool contains(const Key &) const;
+
+		//Calls visitor(const Item &) under the shared lock, returns whether the key was found
+		template<typename Visitor>
+		bool visit(const Key &, Visitor) const;
+
+		//Atomically applies update(Item &) to the item, default constructing it first if the key is absent
+		template<typename Update>
+		void upsert(const Key &, Update);
+
+		void clear();
+		bool empty() const;
+		//Sum of the shard sizes, not a snapshot when writers are active
+		size_t size() const;
+		size_t shardCount() const;
+
+		void printEntries() const;
+
+		//The shard count is rounded up to a power of two
+		explicit ConcurrentDictionary(size_t shards = 64);
+		ConcurrentDictionary(const ConcurrentDictionary &) = delete;
+		ConcurrentDictionary &operator=(const ConcurrentDictionary &) = delete;
+
+		template<typename KT, typename IT, typename HT>
+		friend std::ostream& operator<<(std::ostream &, const ConcurrentDictionary<KT, IT, HT> &);
+
+	private:
+		//Every shard gets its own cache lines so that lock traffic on one never invalidates another
+		struct alignas(64) Shard
+		{
+			mutable std::shared_mutex lock;
+			HashDictionary<K, I, Hash> table;
+		};
+
+		std::unique_ptr<Shard[]> shards;
+		size_t shardMask = 0;
+		Hash hasher;
+
+		Shard &shardFor(const Key &);
+		const Shard &shardFor(const Key &) const;
+	};
+
+	template<typename K, typename I, typename H>
+	ConcurrentDictionary<K, I, H>::ConcurrentDictionary(size_t shards)
+	{
+		size_t count = 1;
+		while (count < shards)
+			count *= 2;
+
+		this->shards.reset(new Shard[count]);
+		shardMask = count - 1;
+	}
+
+	//The shard is picked from the top bits of a different scramble than the one HashDictionary uses inside,
+	//so the keys of a shard still spread over its whole table
+	template<typename K, typename I, typename H>
+	typename ConcurrentDictionary<K, I, H>::Shard & ConcurrentDictionary<K, I, H>::shardFor(const Key &_key)
+	{
+		uint64_t hash = static_cast<uint64_t>(hasher(_key)) * 0xC2B2AE3D27D4EB4Full;
+		return shards[static_cast<size_t>(hash >> 40) & shardMask];
+	}
+
+	template<typename K, typename I, typename H>
+	const typename ConcurrentDictionary<K, I, H>::Shard & ConcurrentDictionary<K, I, H>::shardFor(const Key &_key) const
+	{
+		uint64_t hash = static_cast<uint64_t>(hasher(_key)) * 0xC2B2AE3D27D4EB4Full;
+		return shards[static_cast<size_t>(hash >> 40) & shardMask];
+	}
+
+	template<typename K, typename I, typename H>
+	void ConcurrentDictionary<K, I, H>::insert(Key _key, Item _item)
+	{
+		Shard &shard = shardFor(_key);
+		std::unique_lock<std::shared_mutex> guard(shard.lock);
+		shard.table.insert(std::move(_key), std::move(_item));
+	}
+
+	template<typename K, typename I, typename H>
+	bool ConcurrentDictionary<K, I, H>::remove(const Key &_key)
+	{
+		Shard &shard = shardFor(_key);
+		std::unique_lock<std::shared_mutex> guard(shard.lock);
+		size_t before = shard.table.size();
+		shard.table.remove(_key);
+		return shard.table.size() != before;
+	}
+
+	template<typename K, typename I, typename H>
+	bool ConcurrentDictionary<K, I, H>::lookup(const Key &_key, Item &result) const
+	{
+		return visit(_key, [&result](const Item &item) { result = item; });
+	}
+
+	template<typename K, typename I, typename H>
+	bool ConcurrentDictionary<K, I, H>::contains(const Key &_key) const
+	{
+		const Shard &shard = shardFor(_key);
+		std::shared_lock<std::shared_mutex> guard(shard.lock);
+		return shard.table.lookup(_key) != nullptr;
+	}
+
+	template<typename K, typename I, typename H>
+	template<typename Visitor>
+	bool ConcurrentDictionary<K, I, H>::visit(const Key &_key, Visitor visitor) const
+	{
+		const Shard &shard = shardFor(_key);
+		std::shared_lock<std::shared_mutex> guard(shard.lock);
+
+		const Item* item = shard.table.lookup(_key);
+		if (item == nullptr)
+			return false;
+
+		visitor(*item);
+		return true;
+	}
+
+	template<typename K, typename I, typename H>
+	template<typename Update>
+	void ConcurrentDictionary<K, I, H>::upsert(const Key &_key, Update update)
+	{
+		Shard &shard = shardFor(_key);
+		std::unique_lock<std::shared_mutex> guard(shard.lock);
+
+		Item* item = shard.table.lookup(_key);
+		if (item == nullptr)
+		{
+			shard.table.insert(_key, Item());
+			item = shard.table.lookup(_key);
+		}
+		update(*item);
+	}
+
+	template<typename K, typename I, typename H>
+	void ConcurrentDictionary<K, I, H>::clear()
+	{
+		for (size_t i = 0; i <= shardMask; i++)
+		{
+			std::unique_lock<std::shared_mutex> guard(shards[i].lock);
+			shards[i].table.clear();
+		}
+	}
+
+	template<typename K, typename I, typename H>
+	bool ConcurrentDictionary<K, I, H>::empty() const
+	{
+		return size() == 0;
+	}
+
+	template<typename K, typename I, typename H>
+	size_t ConcurrentDictionary<K, I, H>::size() const
+	{
+		size_t total = 0;
+		for (size_t i = 0; i <= shardMask; i++)
+		{
+			std::shared_lock<std::shared_mutex> guard(shards[i].lock);
+			total += shards[i].table.size();
+		}
+		return total;
+	}
+
+	template<typename K, typename I, typename H>
+	size_t ConcurrentDictionary<K, I, H>::shardCount() const
+	{
+		return shardMask + 1;
+	}
+
+	template<typename K, typename I, typename H>
+	void ConcurrentDictionary<K, I, H>::printEntries() const
+	{
+		std::cout << *this;
+	}
+
+	//operator<< overloading, shards are printed one after another under their shared locks
+	template<typename K, typename I, typename H>
+	std::ostream& operator<< (std::ostream &os, const ConcurrentDictionary<K, I, H> &dictionary)
+	{
+		for (size_t i = 0; i <= dictionary.shardMask; i++)
+		{
+			std::shared_lock<std::shared_mutex> guard(dictionary.shards[i].lock);
+			os << dictionary.shards[i].table;
+		}
+		return os;
+	}
+};
+#endif // !CONCURRENTDICTIONARY_H
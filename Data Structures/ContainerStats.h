@@ -0,0 +1,94 @@
+#ifndef CONTAINERSTATS_H
+#define CONTAINERSTATS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+//Opt-in instrumentation for AVL, BST and Dictionary. Defining CONTAINERS_ENABLE_STATS before including them
+//adds a stats() member returning a ContainerStats. Without it the counters, and every statement updating them,
+//are compiled out: the containers keep their layout and code.
+#ifdef CONTAINERS_ENABLE_STATS
+#define CONTAINERS_STATS(statement) statement
+#else
+#define CONTAINERS_STATS(statement)
+#endif
+
+struct ContainerStats
+{
+	//Lookups visiting more nodes than the last bucket are counted in it
+	static const size_t depthBuckets = 64;
+
+	uint64_t lookups = 0;
+	//lookupDepths[d] counts the lookups that visited d nodes: tree levels, or list positions for Dictionary
+	uint64_t lookupDepths[depthBuckets] = {};
+	//Insertions and removals that changed the contents, and the rotations they made
+	uint64_t inserts = 0;
+	uint64_t removes = 0;
+	uint64_t insertRotations = 0;
+	uint64_t removeRotations = 0;
+
+	//Current shape, filled in by stats()
+	size_t height = 0;
+	size_t nodes = 0;
+	//Held by the node allocator, including pooled nodes not in use
+	size_t bytesAllocated = 0;
+
+	void recordLookup(size_t depth)
+	{
+		lookups++;
+		lookupDepths[std::min(depth, depthBuckets - 1)]++;
+	}
+
+	double meanLookupDepth() const
+	{
+		uint64_t total = 0;
+		for (size_t depth = 0; depth < depthBuckets; depth++)
+			total += depth * lookupDepths[depth];
+		return (lookups == 0) ? 0.0 : static_cast<double>(total) / lookups;
+	}
+
+	//A single JSON object, the histogram is trimmed after its last non-zero bucket
+	std::string toJson() const
+	{
+		size_t usedBuckets = depthBuckets;
+		while (usedBuckets > 0 && lookupDepths[usedBuckets - 1] == 0)
+			usedBuckets--;
+
+		std::string histogram;
+		for (size_t depth = 0; depth < usedBuckets; depth++)
+			histogram += (depth == 0 ? "" : ",") + std::to_string(lookupDepths[depth]);
+
+		return "{\"lookups\":" + std::to_string(lookups) +
+			",\"meanLookupDepth\":" + std::to_string(meanLookupDepth()) +
+			",\"lookupDepths\":[" + histogram + "]" +
+			",\"inserts\":" + std::to_string(inserts) +
+			",\"removes\":" + std::to_string(removes) +
+			",\"insertRotations\":" + std::to_string(insertRotations) +
+			",\"removeRotations\":" + std::to_string(removeRotations) +
+			",\"height\":" + std::to_string(height) +
+			",\"nodes\":" + std::to_string(nodes) +
+			",\"bytesAllocated\":" + std::to_string(bytesAllocated) + "}";
+	}
+};
+
+//Bytes held by a node allocator: whole chunks for policies reporting their capacity, the live nodes otherwise
+template<typename Allocator, typename = void>
+struct ReportsCapacity : std::false_type {};
+
+template<typename Allocator>
+struct ReportsCapacity<Allocator, std::void_t<decltype(std::declval<const Allocator &>().capacity())>> : std::true_type {};
+
+template<typename Node, typename Allocator>
+size_t allocatedNodeBytes(const Allocator &allocator, size_t liveNodes)
+{
+	if constexpr (ReportsCapacity<Allocator>::value)
+		return allocator.capacity() * sizeof(Node);
+	else
+		return liveNodes * sizeof(Node);
+}
+
+#endif // !CONTAINERSTATS_H
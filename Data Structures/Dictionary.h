@@ -2,13 +2,19 @@
 #include <functional>
 #include <iostream>
 #include <algorithm>
+#include <type_traits>
+#include <utility>
+
+#include "NodePool.h"
+#include "KeyTraits.h"
+#include "ContainerStats.h"
 
 #ifndef DICTIONARY_H
 #define DICTIONARY_H
 
 namespace Containers
 {
-	template<typename K, typename I>
+	template<typename K, typename I, template<typename> class Allocator = NodePool>
 	class Dictionary
 	{
 	public:
@@ -16,14 +22,41 @@ namespace Containers
 		using Item = I;
 
 		void insert(Key, Item);
-		Item* lookup(Key) const;
-		void remove(Key);
+		Item* lookup(const Key &) const;
+		void remove(const Key &);
+
+		//Heterogeneous overloads for types comparable with Key, e.g. std::string_view for std::string keys
+		template<typename KeyLike, typename = EnableIfEqualityComparableKey<K, KeyLike>>
+		Item* lookup(const KeyLike &) const;
+		template<typename KeyLike, typename = EnableIfEqualityComparableKey<K, KeyLike>>
+		void remove(const KeyLike &);
+
+		//Constructs the item from args only if the key is absent, returns the item and whether it was inserted
+		template<typename... Args>
+		std::pair<Item*, bool> try_emplace(const Key &, Args&&...);
+		template<typename... Args>
+		std::pair<Item*, bool> try_emplace(Key &&, Args&&...);
+		//Like try_emplace, the key is passed on its own and only the item is built from args
+		template<typename... Args>
+		std::pair<Item*, bool> emplace(const Key &, Args&&...);
+		template<typename... Args>
+		std::pair<Item*, bool> emplace(Key &&, Args&&...);
+
+		//Inserts, or assigns to the existing item
+		template<typename ItemArg>
+		std::pair<Item*, bool> insert_or_assign(const Key &, ItemArg &&);
+		template<typename ItemArg>
+		std::pair<Item*, bool> insert_or_assign(Key &&, ItemArg &&);
 		void printEntries() const;
 		void clear();
 		bool empty() const;
 		size_t size() const;
 		void swap(Dictionary&);
-		void sort(std::function<bool(Key, Key)> comparison = std::greater<Key>);
+		//Stable O(n log n) sorts, comparison(a, b) returns true when a belongs before b
+		template<typename Compare = std::less<Key>>
+		void sort(Compare comparison = Compare());
+		template<typename Compare = std::less<Item>>
+		void sortByItem(Compare comparison = Compare());
 
 		Dictionary() = default;
 		Dictionary(Dictionary &&);
@@ -33,85 +66,100 @@ namespace Containers
 		Dictionary &operator=(const Dictionary &);
 		Dictionary &operator=(Dictionary &&);
 
-		template<typename K, typename I>
-		friend std::ostream& operator<<(std::ostream &, const Dictionary<K, I> &);
+		template<typename KT, typename IT, template<typename> class AT>
+		friend std::ostream& operator<<(std::ostream &, const Dictionary<KT, IT, AT> &);
+
+		//Static comparison functions for sortByItem
+		static bool ascending(const Item &, const Item &);
+		static bool descending(const Item &, const Item &);
 
-		//Static comparison functions for the user
-		static bool ascending(const Item, const Item);
-		static bool descending(const Item, const Item);
+#ifdef CONTAINERS_ENABLE_STATS
+		//Counters since construction, with the current node count and allocator footprint.
+		//The lookup histogram holds the list positions walked, the height is the list length
+		ContainerStats stats() const;
+#endif
 
 	private:
 		struct Node;
+		using NodeAllocator = Allocator<Node>;
+
 		Node* root = nullptr;
 		size_t listSize = 0;
-
-		static Item* lookupRec(Key, Node*);
-		static bool insertRec(Key, Item, Node*&);
-		static bool removeRec(Key, Node*&);
-		static void deepDelete(Node*);
-		static Node* deepCopy(Node*);
+		NodeAllocator nodes;
+#ifdef CONTAINERS_ENABLE_STATS
+		//Lookups are const, counting them is not a change to the contents
+		mutable ContainerStats statistics;
+#endif
+
+		template<typename KeyLike>
+		Item* lookupNode(const KeyLike &, Node*) const;
+		template<typename KeyArg, typename... Args>
+		std::pair<Node*, bool> insertRec(Node*&, KeyArg &&, Args&&...);
+		template<typename KeyLike>
+		bool removeRec(const KeyLike &, Node*&);
+		void deepDelete(Node*);
+		Node* deepCopy(Node*);
 		static void printEntriesRec(std::ostream&, Node*);
+
+		template<typename NodeOrder>
+		void mergeSort(NodeOrder);
+		static Node* splitList(Node*, size_t);
+		template<typename NodeOrder>
+		static Node** mergeLists(Node*, Node*, Node**, NodeOrder &);
 	};
 
 	//Node struct definiton
-	template<typename K, typename I>
-	struct Dictionary<K, I>::Node
+	template<typename K, typename I, template<typename> class A>
+	struct Dictionary<K, I, A>::Node
 	{
 		Key key;
 		Item item;
 
 		Node* nextNode;
 
-		Node(Key _key, Item _item)
+		template<typename KeyArg, typename... Args>
+		Node(KeyArg &&_key, Args&&... args) : key(std::forward<KeyArg>(_key)), item(std::forward<Args>(args)...)
 		{
-			key = _key;
-			item = _item;
-			nextNode = nullptr;
-		}
-
-		Node(const Node &original)
-		{
-			key = original.key;
-			item = original.item;
 			nextNode = nullptr;
 		}
 	};
 
 	//Move constructor
-	template<typename K, typename I>
-	Dictionary<K, I>::Dictionary(Dictionary<K, I> &&original)
+	template<typename K, typename I, template<typename> class A>
+	Dictionary<K, I, A>::Dictionary(Dictionary<K, I, A> &&original)
 	{
 		this->root = original.root;
 		original.root = nullptr;
 		this->listSize = original.listSize;
 		original.listSize = 0;
+		this->nodes.swap(original.nodes);
 	}
 
 	//Copy constructor
-	template<typename K, typename I>
-	Dictionary<K, I>::Dictionary(const Dictionary<K, I> &original)
+	template<typename K, typename I, template<typename> class A>
+	Dictionary<K, I, A>::Dictionary(const Dictionary<K, I, A> &original)
 	{
 		this->root = deepCopy(original.root);
 		this->listSize = original.listSize;
 	}
 
 	//Destructor
-	template<typename K, typename I>
-	Dictionary<K, I>::~Dictionary()
+	template<typename K, typename I, template<typename> class A>
+	Dictionary<K, I, A>::~Dictionary()
 	{
 		deepDelete(root);
+		nodes.release();
 	}
 
 	//Copy assignment operator
-	template<typename K, typename I>
-	Dictionary<K, I> & Dictionary<K, I>::operator=(const Dictionary<K, I> &original)
+	template<typename K, typename I, template<typename> class A>
+	Dictionary<K, I, A> & Dictionary<K, I, A>::operator=(const Dictionary<K, I, A> &original)
 	{
 		if (this == &original)
 			return *this;
 		else
 		{
-			if (this->root != nullptr)
-				deepDelete(root);
+			clear();
 			this->root = deepCopy(original.root);
 			this->listSize = original.listSize;
 		}
@@ -119,156 +167,311 @@ namespace Containers
 	}
 
 	//Move assignment operator
-	template<typename K, typename I>
-	Dictionary<K, I> & Containers::Dictionary<K, I>::operator=(Dictionary<K, I> &&original)
+	template<typename K, typename I, template<typename> class A>
+	Dictionary<K, I, A> & Containers::Dictionary<K, I, A>::operator=(Dictionary<K, I, A> &&original)
 	{
 		if (this == &original)
 			return *this;
 		else
 		{
-			if (this->root != nullptr)
-				deepDelete(this->root);
+			clear();
 			this->root = original.root;
 			original.root = nullptr;
 			this->listSize = original.listSize;
 			original.listSize = 0;
+			this->nodes.swap(original.nodes);
 		}
+		return *this;
 	}
 
 	//Comparison functions
-	template<typename K, typename I>
-	bool Containers::Dictionary<K, I>::ascending(const Item a, const Item b)
+	template<typename K, typename I, template<typename> class A>
+	bool Containers::Dictionary<K, I, A>::ascending(const Item &a, const Item &b)
 	{
-		return a > b;
+		return a < b;
 	}
 
-	template<typename K, typename I>
-	bool Containers::Dictionary<K, I>::descending(const Item a, const Item b)
+	template<typename K, typename I, template<typename> class A>
+	bool Containers::Dictionary<K, I, A>::descending(const Item &a, const Item &b)
 	{
-		return a < b;
+		return a > b;
 	}
 
 	//Insert wrapper function
-	template<typename K, typename I>
-	void Dictionary<K, I>::insert(Key _key, Item _item)
+	template<typename K, typename I, template<typename> class A>
+	void Dictionary<K, I, A>::insert(Key _key, Item _item)
+	{
+		insert_or_assign(std::move(_key), std::move(_item));
+	}
+
+	//Emplace wrapper functions
+	template<typename K, typename I, template<typename> class A>
+	template<typename... Args>
+	std::pair<typename Dictionary<K, I, A>::Item*, bool> Dictionary<K, I, A>::try_emplace(const Key &_key, Args&&... args)
 	{
-		if (insertRec(_key, _item, root)) listSize++; //Increment the listSize variable as the list size has increased after the insertion
+		std::pair<Node*, bool> result = insertRec(root, _key, std::forward<Args>(args)...);
+		if (result.second) listSize++; //Increment the listSize variable as the list size has increased after the insertion
+		CONTAINERS_STATS(statistics.inserts += result.second);
+		return { &result.first->item, result.second };
+	}
+
+	template<typename K, typename I, template<typename> class A>
+	template<typename... Args>
+	std::pair<typename Dictionary<K, I, A>::Item*, bool> Dictionary<K, I, A>::try_emplace(Key &&_key, Args&&... args)
+	{
+		std::pair<Node*, bool> result = insertRec(root, std::move(_key), std::forward<Args>(args)...);
+		if (result.second) listSize++;
+		CONTAINERS_STATS(statistics.inserts += result.second);
+		return { &result.first->item, result.second };
+	}
+
+	template<typename K, typename I, template<typename> class A>
+	template<typename... Args>
+	std::pair<typename Dictionary<K, I, A>::Item*, bool> Dictionary<K, I, A>::emplace(const Key &_key, Args&&... args)
+	{
+		return try_emplace(_key, std::forward<Args>(args)...);
+	}
+
+	template<typename K, typename I, template<typename> class A>
+	template<typename... Args>
+	std::pair<typename Dictionary<K, I, A>::Item*, bool> Dictionary<K, I, A>::emplace(Key &&_key, Args&&... args)
+	{
+		return try_emplace(std::move(_key), std::forward<Args>(args)...);
+	}
+
+	//The item argument is only consumed by one of the construction or the assignment
+	template<typename K, typename I, template<typename> class A>
+	template<typename ItemArg>
+	std::pair<typename Dictionary<K, I, A>::Item*, bool> Dictionary<K, I, A>::insert_or_assign(const Key &_key, ItemArg &&_item)
+	{
+		std::pair<Item*, bool> result = try_emplace(_key, std::forward<ItemArg>(_item));
+		if (!result.second)
+			*result.first = std::forward<ItemArg>(_item);
+		return result;
+	}
+
+	template<typename K, typename I, template<typename> class A>
+	template<typename ItemArg>
+	std::pair<typename Dictionary<K, I, A>::Item*, bool> Dictionary<K, I, A>::insert_or_assign(Key &&_key, ItemArg &&_item)
+	{
+		std::pair<Item*, bool> result = try_emplace(std::move(_key), std::forward<ItemArg>(_item));
+		if (!result.second)
+			*result.first = std::forward<ItemArg>(_item);
+		return result;
 	}
 
 	//Lookup wrapper function
-	template<typename K, typename I>
-	typename Dictionary<K, I>::Item* Dictionary<K, I>::lookup(Key _key) const
+	template<typename K, typename I, template<typename> class A>
+	typename Dictionary<K, I, A>::Item* Dictionary<K, I, A>::lookup(const Key &_key) const
 	{
-		return lookupRec(_key, root);
+		return lookupNode(_key, root);
+	}
+
+	template<typename K, typename I, template<typename> class A>
+	template<typename KeyLike, typename>
+	typename Dictionary<K, I, A>::Item* Dictionary<K, I, A>::lookup(const KeyLike &_key) const
+	{
+		return lookupNode(_key, root);
 	}
 
 	//Remove wrapper function
-	template<typename K, typename I>
-	void Dictionary<K, I>::remove(Key _key)
+	template<typename K, typename I, template<typename> class A>
+	void Dictionary<K, I, A>::remove(const Key &_key)
+	{
+		if (removeRec(_key, root))
+		{
+			listSize--; //Decrement the listSize variable as the list size has decreased after the removal
+			CONTAINERS_STATS(statistics.removes++);
+		}
+	}
+
+	template<typename K, typename I, template<typename> class A>
+	template<typename KeyLike, typename>
+	void Dictionary<K, I, A>::remove(const KeyLike &_key)
 	{
-		if (removeRec(_key, root)) listSize--; //Decrement the listSize variable as the list size has decreased after the removal
+		if (removeRec(_key, root))
+		{
+			listSize--;
+			CONTAINERS_STATS(statistics.removes++);
+		}
 	}
 
-	template<typename K, typename I>
-	void Containers::Dictionary<K, I>::printEntries() const
+	template<typename K, typename I, template<typename> class A>
+	void Containers::Dictionary<K, I, A>::printEntries() const
 	{
 		printEntriesRec(std::cout, root);
 	}
 
 	//Clear the list
-	template<typename K, typename I>
-	void Containers::Dictionary<K, I>::clear()
+	template<typename K, typename I, template<typename> class A>
+	void Containers::Dictionary<K, I, A>::clear()
 	{
 		deepDelete(root);
+		nodes.release();
 		root = nullptr;
 		listSize = 0;
 	}
 
 	//Check if list is empty
-	template<typename K, typename I>
-	bool Containers::Dictionary<K, I>::empty() const
+	template<typename K, typename I, template<typename> class A>
+	bool Containers::Dictionary<K, I, A>::empty() const
 	{
 		return (root == nullptr);
 	}
 
 	//Return the size of the list
-	template<typename K, typename I>
-	size_t Containers::Dictionary<K, I>::size() const
+	template<typename K, typename I, template<typename> class A>
+	size_t Containers::Dictionary<K, I, A>::size() const
 	{
 		return listSize;
 	}
 
+#ifdef CONTAINERS_ENABLE_STATS
+	template<typename K, typename I, template<typename> class A>
+	ContainerStats Containers::Dictionary<K, I, A>::stats() const
+	{
+		ContainerStats result = statistics;
+		result.height = listSize;
+		result.nodes = listSize;
+		result.bytesAllocated = allocatedNodeBytes<Node>(nodes, listSize);
+		return result;
+	}
+#endif
+
 	//Swapping two dictionaries
-	template<typename K, typename I>
-	void Containers::Dictionary<K, I>::swap(Dictionary<K, I> &original)
+	template<typename K, typename I, template<typename> class A>
+	void Containers::Dictionary<K, I, A>::swap(Dictionary<K, I, A> &original)
 	{
 		Node* tempNode = this->root;
 		this->root = original.root;
 		original.root = tempNode;
 
-		unsigned int tempSize = this->listSize;
+		size_t tempSize = this->listSize;
 		this->listSize = original.listSize;
 		original.listSize = tempSize;
+
+		this->nodes.swap(original.nodes);
 	}
 
-	//Bubble sort algorithm utilising higher order functions for comparison
-	//Algorithm made available by Lakshay Chawla on https://stackoverflow.com/questions/19556427/sorting-a-singly-linked-list-with-pointers
-	//and modified by me in order to utilise higher order functions
-	template<typename K, typename I>
-	void Containers::Dictionary<K, I>::sort(std::function<bool(Key, Key)> comparison)
+	//Stable bottom-up merge sort by key, the nodes are relinked and no keys or items are copied
+	template<typename K, typename I, template<typename> class A>
+	template<typename Compare>
+	void Containers::Dictionary<K, I, A>::sort(Compare comparison)
 	{
-		Node *i = root, *j = root;
-		while (i != nullptr) {
-			while (j->nextNode != nullptr) {
+		mergeSort([&comparison](const Node* a, const Node* b) { return comparison(a->key, b->key); });
+	}
 
-				if (comparison(j->item, j->nextNode->item)) {
-					Item tempData = j->item;
-					Key tempKey = j->key;
-					j->item = j->nextNode->item;
-					j->key = j->nextNode->key;
+	//Stable bottom-up merge sort by item
+	template<typename K, typename I, template<typename> class A>
+	template<typename Compare>
+	void Containers::Dictionary<K, I, A>::sortByItem(Compare comparison)
+	{
+		mergeSort([&comparison](const Node* a, const Node* b) { return comparison(a->item, b->item); });
+	}
+
+	//Merges runs of width 1, 2, 4... until a single pass does a single merge
+	template<typename K, typename I, template<typename> class A>
+	template<typename NodeOrder>
+	void Containers::Dictionary<K, I, A>::mergeSort(NodeOrder before)
+	{
+		if (root == nullptr)
+			return;
+
+		for (size_t width = 1; ; width *= 2)
+		{
+			Node* remaining = root;
+			Node** tail = &root;
+			size_t merges = 0;
 
-					j->nextNode->item = tempData;
-					j->nextNode->key = tempKey;
-				}
-				j = j->nextNode;
+			while (remaining != nullptr)
+			{
+				Node* left = remaining;
+				Node* right = splitList(left, width);
+				remaining = splitList(right, width);
+				tail = mergeLists(left, right, tail, before);
+				merges++;
 			}
-			j = root;
-			i = i->nextNode;
+
+			if (merges <= 1)
+				break;
 		}
 	}
 
-	//Lookup worker function
-	template<typename K, typename I>
-	typename Dictionary<K, I>::Item* Dictionary<K, I>::lookupRec(Key _key, Node* _current)
+	//Cuts the list after count nodes and returns the rest
+	template<typename K, typename I, template<typename> class A>
+	typename Dictionary<K, I, A>::Node* Containers::Dictionary<K, I, A>::splitList(Node* list, size_t count)
 	{
-		if (_current == nullptr)
+		for (; list != nullptr && count > 1; count--)
+			list = list->nextNode;
+
+		if (list == nullptr)
 			return nullptr;
-		else if (_current->key == _key)
-			return &_current->item;
-		else
-			return lookupRec(_key, _current->nextNode);
+
+		Node* rest = list->nextNode;
+		list->nextNode = nullptr;
+		return rest;
+	}
+
+	//Appends the merge of two sorted lists at tail and returns the link after the last node.
+	//Ties are taken from the left list first, which keeps the sort stable
+	template<typename K, typename I, template<typename> class A>
+	template<typename NodeOrder>
+	typename Dictionary<K, I, A>::Node** Containers::Dictionary<K, I, A>::mergeLists(Node* left, Node* right, Node** tail, NodeOrder &before)
+	{
+		while (left != nullptr && right != nullptr)
+		{
+			Node* &smaller = before(right, left) ? right : left;
+			*tail = smaller;
+			tail = &smaller->nextNode;
+			smaller = smaller->nextNode;
+		}
+
+		*tail = (left != nullptr) ? left : right;
+		while (*tail != nullptr)
+			tail = &(*tail)->nextNode;
+		return tail;
 	}
 
-	//Insert worker function
-	template<typename K, typename I>
-	bool Dictionary<K, I>::insertRec(Key _key, Item _item, Node* &_current)
+	//Lookup worker function
+	template<typename K, typename I, template<typename> class A>
+	template<typename KeyLike>
+	typename Dictionary<K, I, A>::Item* Dictionary<K, I, A>::lookupNode(const KeyLike &_key, Node* _current) const
+	{
+		CONTAINERS_STATS(size_t length = 0);
+		for (; _current != nullptr; _current = _current->nextNode)
+		{
+			CONTAINERS_STATS(length++);
+			if (_current->key == _key)
+			{
+				CONTAINERS_STATS(statistics.recordLookup(length));
+				return &_current->item;
+			}
+		}
+
+		CONTAINERS_STATS(statistics.recordLookup(length));
+		return nullptr;
+	}
+
+	//Insert worker function, returns the node holding the key and whether it was created
+	template<typename K, typename I, template<typename> class A>
+	template<typename KeyArg, typename... Args>
+	std::pair<typename Dictionary<K, I, A>::Node*, bool> Dictionary<K, I, A>::insertRec(Node* &_current, KeyArg &&_key, Args&&... args)
 	{
 		if (_current == nullptr)
 		{
-			_current = new Node(_key, _item);
-			return true; //Return true if new node is added in order to increment the size variable;
+			_current = nodes.create(std::forward<KeyArg>(_key), std::forward<Args>(args)...);
+			return { _current, true }; //New node is added, the wrapper increments the size variable
 		}
 		else if (_current->key == _key)
-			_current->item = _item;
+			return { _current, false };
 		else
-			return insertRec(_key, _item, _current->nextNode);
-
-		return false;
+			return insertRec(_current->nextNode, std::forward<KeyArg>(_key), std::forward<Args>(args)...);
 	}
 
 	//Remoce worker funciton
-	template<typename K, typename I>
-	bool Dictionary<K, I>::removeRec(Key _key, Node* &_current)
+	template<typename K, typename I, template<typename> class A>
+	template<typename KeyLike>
+	bool Dictionary<K, I, A>::removeRec(const KeyLike &_key, Node* &_current)
 	{
 		if (_current == nullptr)
 			return false;
@@ -277,7 +480,7 @@ namespace Containers
 		{
 			if (_current->nextNode == nullptr)
 			{
-				delete _current;
+				nodes.destroy(_current);
 				_current = nullptr;
 			}
 
@@ -285,7 +488,7 @@ namespace Containers
 			{
 				Node* temp = _current;
 				_current = temp->nextNode;
-				delete temp;
+				nodes.destroy(temp);
 			}
 			return true;
 		}
@@ -295,32 +498,40 @@ namespace Containers
 		return false;
 	}
 
-	//Deep delete recursive function
-	template<typename K, typename I>
-	void Containers::Dictionary<K, I>::deepDelete(Node* _current)
+	//Deep delete function, the caller releases the allocator afterwards
+	template<typename K, typename I, template<typename> class A>
+	void Containers::Dictionary<K, I, A>::deepDelete(Node* _current)
 	{
-		if (_current == nullptr)
+		//A pool frees its chunks wholesale, so nodes without destructors need no walk
+		if (NodeAllocator::releasesInBulk && std::is_trivially_destructible<Node>::value)
 			return;
 
-		deepDelete(_current->nextNode);
-		delete _current;
+		while (_current != nullptr)
+		{
+			Node* next = _current->nextNode;
+			nodes.destroy(_current);
+			_current = next;
+		}
 	}
 
-	//Deep copy recursive function
-	template<typename K, typename I>
-	typename Dictionary<K, I>::Node* Containers::Dictionary<K, I>::deepCopy(Node* original)
+	//Deep copy function
+	template<typename K, typename I, template<typename> class A>
+	typename Dictionary<K, I, A>::Node* Containers::Dictionary<K, I, A>::deepCopy(Node* original)
 	{
-		if (original == nullptr)
-			return nullptr;
+		Node* copyRoot = nullptr;
+		Node** tail = &copyRoot;
 
-		Node* tempNode = new Node(*original);
-		tempNode->nextNode = deepCopy(original->nextNode);
-		return tempNode;
+		for (; original != nullptr; original = original->nextNode)
+		{
+			*tail = nodes.create(original->key, original->item);
+			tail = &(*tail)->nextNode;
+		}
+		return copyRoot;
 	}
 
 	//Printing entries recursive worker function
-	template<typename K, typename I>
-	void Containers::Dictionary<K, I>::printEntriesRec(std::ostream &os, Node* _current)
+	template<typename K, typename I, template<typename> class A>
+	void Containers::Dictionary<K, I, A>::printEntriesRec(std::ostream &os, Node* _current)
 	{
 		if (_current == nullptr)
 			return;
@@ -329,10 +540,10 @@ namespace Containers
 	}
 
 	//operator<< overloading to transfer the entries into the stream
-	template<typename K, typename I>
-	std::ostream& operator<< (std::ostream &os, const Dictionary<K, I> &dictionary)
+	template<typename K, typename I, template<typename> class A>
+	std::ostream& operator<< (std::ostream &os, const Dictionary<K, I, A> &dictionary)
 	{
-		Dictionary<K, I>::printEntriesRec(os, dictionary.root);
+		Dictionary<K, I, A>::printEntriesRec(os, dictionary.root);
 		return os;
 	}
 };
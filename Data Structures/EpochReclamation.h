@@ -0,0 +1,211 @@
+#ifndef EPOCHRECLAMATION_H
+#define EPOCHRECLAMATION_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include <assert.h>
+
+//Epoch based memory reclamation for the lock-free containers.
+//Threads touching shared nodes hold an EpochDomain::Guard. Unlinked memory is retired with the global epoch current
+//at that time and freed once the epoch has advanced twice, which can only happen after every thread that was
+//inside a guard when it was unlinked has left it. The epoch advances when all active threads have seen its current value.
+class EpochDomain
+{
+	struct Record;
+
+public:
+	//Guards nest, only the outermost one enters and leaves the epoch
+	class Guard
+	{
+	public:
+		Guard() : record(EpochDomain::instance().enter()) {}
+		~Guard() { EpochDomain::instance().leave(record); }
+		Guard(const Guard &) = delete;
+		Guard &operator=(const Guard &) = delete;
+
+	private:
+		Record* record;
+	};
+
+	//One domain is shared by every container so that a thread only ever registers once
+	static EpochDomain &instance()
+	{
+		static EpochDomain domain;
+		return domain;
+	}
+
+	//Frees the memory through deleter once no guarded thread can still reach it
+	void retire(void*, void (*)(void*));
+	//Waits until every thread inside a guard has left it and frees everything the calling thread has retired,
+	//instead of leaving it for later retires or the thread's exit. Must not be called inside a guard
+	void synchronize();
+
+	~EpochDomain();
+
+private:
+	EpochDomain() = default;
+
+	struct Retired
+	{
+		void* memory;
+		void (*deleter)(void*);
+		uint64_t epoch;
+	};
+
+	static const size_t collectThreshold = 64;
+
+	//Per thread state, recycled when its thread exits.
+	//state holds the epoch observed on entry shifted left by one, with the low bit set while inside a guard.
+	struct Record
+	{
+		std::atomic<uint64_t> state{ 0 };
+		std::atomic<bool> inUse{ true };
+		unsigned nesting = 0;
+		std::vector<Retired> retired;
+		size_t collectAt = collectThreshold;
+		Record* next = nullptr;
+	};
+
+	//Releases the calling thread's record when it exits
+	struct RecordOwner
+	{
+		Record* record = nullptr;
+		~RecordOwner();
+	};
+
+	Record* localRecord();
+	Record* enter();
+	void leave(Record*);
+	void tryAdvance();
+	void collect(Record &);
+
+	std::atomic<uint64_t> globalEpoch{ 0 };
+	std::atomic<Record*> records{ nullptr };
+};
+
+inline EpochDomain::Record* EpochDomain::localRecord()
+{
+	thread_local RecordOwner owner;
+	if (owner.record != nullptr)
+		return owner.record;
+
+	//Adopt the record of a thread that has exited, or register a new one
+	for (Record* current = records.load(std::memory_order_acquire); current != nullptr; current = current->next)
+	{
+		bool expected = false;
+		if (!current->inUse.load(std::memory_order_relaxed) && current->inUse.compare_exchange_strong(expected, true))
+			return owner.record = current;
+	}
+
+	Record* record = new Record();
+	record->next = records.load(std::memory_order_relaxed);
+	while (!records.compare_exchange_weak(record->next, record, std::memory_order_release, std::memory_order_relaxed));
+	return owner.record = record;
+}
+
+inline EpochDomain::Record* EpochDomain::enter()
+{
+	Record* record = localRecord();
+	if (record->nesting++ == 0)
+	{
+		record->state.store((globalEpoch.load() << 1) | 1);
+		//Publishing the state must come before any shared pointer is read. ThreadSanitizer does not model this fence,
+		//so a clean TSan run says nothing about it; Benchmarks/skipListStress checks the reclamation instead
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+	}
+	return record;
+}
+
+inline void EpochDomain::leave(Record* record)
+{
+	if (--record->nesting == 0)
+		record->state.store(0, std::memory_order_release);
+}
+
+inline void EpochDomain::retire(void* memory, void (*deleter)(void*))
+{
+	Record* record = localRecord();
+	record->retired.push_back({ memory, deleter, globalEpoch.load() });
+	if (record->retired.size() >= record->collectAt)
+	{
+		tryAdvance();
+		collect(*record);
+		record->collectAt = record->retired.size() + collectThreshold;
+	}
+}
+
+//Two advances past the current epoch make everything retired so far reclaimable. An advance waits for the threads
+//that entered their guard in an older epoch, so this spins only while such a guard is held
+inline void EpochDomain::synchronize()
+{
+	Record* record = localRecord();
+	assert(record->nesting == 0);
+
+	uint64_t target = globalEpoch.load() + 2;
+	for (;;)
+	{
+		tryAdvance();
+		if (globalEpoch.load() >= target)
+			break;
+		std::this_thread::yield();
+	}
+
+	collect(*record);
+	record->collectAt = record->retired.size() + collectThreshold;
+}
+
+inline void EpochDomain::tryAdvance()
+{
+	uint64_t epoch = globalEpoch.load();
+	for (Record* current = records.load(std::memory_order_acquire); current != nullptr; current = current->next)
+	{
+		uint64_t state = current->state.load();
+		if ((state & 1) != 0 && (state >> 1) != epoch)
+			return;
+	}
+	globalEpoch.compare_exchange_strong(epoch, epoch + 1);
+}
+
+//Retired entries are in epoch order, so the reclaimable ones form a prefix
+inline void EpochDomain::collect(Record &record)
+{
+	uint64_t epoch = globalEpoch.load();
+	size_t reclaimable = 0;
+	while (reclaimable < record.retired.size() && record.retired[reclaimable].epoch + 2 <= epoch)
+	{
+		record.retired[reclaimable].deleter(record.retired[reclaimable].memory);
+		reclaimable++;
+	}
+	record.retired.erase(record.retired.begin(), record.retired.begin() + reclaimable);
+}
+
+inline EpochDomain::RecordOwner::~RecordOwner()
+{
+	if (record == nullptr)
+		return;
+
+	EpochDomain &domain = EpochDomain::instance();
+	domain.tryAdvance();
+	domain.collect(*record);
+	record->inUse.store(false, std::memory_order_release);
+}
+
+//Runs at exit, when no other thread is expected to touch the containers any more
+inline EpochDomain::~EpochDomain()
+{
+	Record* current = records.load();
+	while (current != nullptr)
+	{
+		for (Retired &retired : current->retired)
+			retired.deleter(retired.memory);
+
+		Record* next = current->next;
+		delete current;
+		current = next;
+	}
+}
+
+#endif // !EPOCHRECLAMATION_H
@@ -0,0 +1,427 @@
+#ifndef FLATSNAPSHOT_H
+#define FLATSNAPSHOT_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define FLATSNAPSHOT_MMAP
+#endif
+
+#include "KeyTraits.h"
+
+//Flat file format behind the trees' saveSnapshot/loadSnapshot, for trivially copyable keys and items.
+//The file holds a header followed by the sorted keys and then the items in the same order, each section padded
+//to 64 bytes. It is written in native byte order and layout, and read back by mapping it: lookups binary search
+//the key section in place, nothing is deserialized.
+struct FlatSnapshotHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSize;
+	uint32_t keySize;
+	uint32_t itemSize;
+	uint64_t count;
+	uint64_t keysOffset;
+	uint64_t itemsOffset;
+	uint64_t fileSize;
+	//Over everything after the header, padding included
+	uint64_t checksum;
+};
+
+//Word at a time hash with four independent lanes, fed in blocks of 32 bytes
+class FlatSnapshotChecksum
+{
+public:
+	static const size_t blockSize = 32;
+
+	void update(const unsigned char* data, size_t size)
+	{
+		for (size_t offset = 0; offset + blockSize <= size; offset += blockSize)
+		{
+			for (int lane = 0; lane < 4; lane++)
+			{
+				uint64_t word;
+				std::memcpy(&word, data + offset + lane * 8, 8);
+				lanes[lane] = rotate(lanes[lane] + word * prime2, 31) * prime1;
+			}
+		}
+	}
+
+	uint64_t value() const
+	{
+		uint64_t hash = rotate(lanes[0], 1) + rotate(lanes[1], 7) + rotate(lanes[2], 12) + rotate(lanes[3], 18);
+		hash ^= hash >> 33;
+		hash *= prime2;
+		hash ^= hash >> 29;
+		return hash;
+	}
+
+private:
+	static const uint64_t prime1 = 0x9E3779B185EBCA87ull;
+	static const uint64_t prime2 = 0xC2B2AE3D27D4EB4Full;
+
+	static uint64_t rotate(uint64_t value, int bits) { return (value << bits) | (value >> (64 - bits)); }
+
+	uint64_t lanes[4] = { prime1 + prime2, prime2, 0, 0 - prime1 };
+};
+
+template<typename K, typename I, typename C = std::less<K>>
+class FlatSnapshot
+{
+public:
+	using Key = K;
+	using Item = I;
+	using Compare = C;
+
+	static const uint32_t version = 1;
+
+	//Writes the entries that forEachEntry(function) passes to function(key, item), in strictly increasing key order.
+	//forEachEntry is called twice, once for the keys and once for the items. The file is written next to the path,
+	//synced and renamed over it when complete, then the directory is synced, so neither readers nor a crash leave
+	//a partial snapshot behind. Returns false on I/O failure.
+	template<typename ForEachEntry>
+	static bool save(const std::string &, ForEachEntry);
+
+	//Maps a file written by save, returns null if it cannot be read, has another format or,
+	//when verify is set, fails the checksum or is out of order under the comparator.
+	//The header, sizes included, is always checked. Verifying reads the whole file once, O(n),
+	//without it only the pages that lookups touch are ever read.
+	static std::unique_ptr<FlatSnapshot> open(const std::string &, bool verify, const Compare & = Compare());
+
+	template<typename KeyLike>
+	Item* lookup(const KeyLike &);
+	//Number of keys less than the given one, or not greater with inclusive set
+	template<typename KeyLike>
+	size_t rank(const KeyLike &, bool inclusive) const;
+
+	//Calls function(key, item) for every entry in key order
+	template<typename Function>
+	void forEach(Function) const;
+
+	size_t size() const { return count; }
+	//Whether the checksum and key order were checked when the file was opened
+	bool verified() const { return contentsVerified; }
+	//Whether the keys are strictly increasing under the comparator, one pass over the key section
+	bool keysInOrder() const;
+	const Key* keys() const { return keyData; }
+	const Item* items() const { return itemData; }
+
+	FlatSnapshot(const FlatSnapshot &) = delete;
+	FlatSnapshot &operator=(const FlatSnapshot &) = delete;
+	~FlatSnapshot();
+
+private:
+	static const size_t sectionAlignment = 64;
+	static const size_t bufferSize = 1 << 16;
+
+	static uint64_t padded(uint64_t size) { return (size + sectionAlignment - 1) & ~static_cast<uint64_t>(sectionAlignment - 1); }
+	static FlatSnapshotHeader expectedHeader(uint64_t);
+	//Checked where files are read or written, so that containers may hold a FlatSnapshot member for any types
+	static void checkTypes()
+	{
+		static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Item>::value,
+			"Snapshots store keys and items as raw bytes, both have to be trivially copyable");
+	}
+
+	//Buffers the sections so that the checksum always sees whole blocks
+	class Writer;
+
+	FlatSnapshot() = default;
+	bool validate(bool);
+	static bool syncDirectoryOf(const std::string &);
+
+	unsigned char* data = nullptr;
+	size_t dataSize = 0;
+	bool mapped = false;
+
+	const Key* keyData = nullptr;
+	Item* itemData = nullptr;
+	size_t count = 0;
+	bool contentsVerified = false;
+	Compare keyLess;
+};
+
+template<typename K, typename I, typename C>
+class FlatSnapshot<K, I, C>::Writer
+{
+public:
+	explicit Writer(FILE* _file) : file(_file), buffer(bufferSize) {}
+
+	void write(const void* source, size_t size)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(source);
+		while (size > 0)
+		{
+			size_t chunk = std::min(size, bufferSize - used);
+			std::memcpy(buffer.data() + used, bytes, chunk);
+			used += chunk;
+			bytes += chunk;
+			size -= chunk;
+			written += chunk;
+			if (used == bufferSize)
+				flush();
+		}
+	}
+
+	//Zero fills up to the next section boundary
+	void pad()
+	{
+		static const unsigned char zeros[sectionAlignment] = {};
+		write(zeros, padded(written) - written);
+	}
+
+	//Only called on section boundaries or with a full buffer, both multiples of the checksum block
+	void flush()
+	{
+		checksum.update(buffer.data(), used);
+		if (used != 0 && std::fwrite(buffer.data(), 1, used, file) != used)
+			failed = true;
+		used = 0;
+	}
+
+	FILE* file;
+	std::vector<unsigned char> buffer;
+	size_t used = 0;
+	uint64_t written = 0;
+	FlatSnapshotChecksum checksum;
+	bool failed = false;
+};
+
+template<typename K, typename I, typename C>
+FlatSnapshotHeader FlatSnapshot<K, I, C>::expectedHeader(uint64_t entries)
+{
+	FlatSnapshotHeader header = {};
+	std::memcpy(header.magic, "FLATSNAP", 8);
+	header.version = version;
+	header.headerSize = sizeof(FlatSnapshotHeader);
+	header.keySize = sizeof(Key);
+	header.itemSize = sizeof(Item);
+	header.count = entries;
+	header.keysOffset = padded(sizeof(FlatSnapshotHeader));
+	header.itemsOffset = header.keysOffset + padded(entries * sizeof(Key));
+	header.fileSize = header.itemsOffset + padded(entries * sizeof(Item));
+	return header;
+}
+
+template<typename K, typename I, typename C>
+template<typename ForEachEntry>
+bool FlatSnapshot<K, I, C>::save(const std::string &path, ForEachEntry forEachEntry)
+{
+	checkTypes();
+	std::string temporaryPath = path + ".tmp";
+	FILE* file = std::fopen(temporaryPath.c_str(), "wb");
+	if (file == nullptr)
+		return false;
+
+	//The header is written last, once the entry count is known
+	FlatSnapshotHeader header = expectedHeader(0);
+	bool failed = std::fseek(file, static_cast<long>(header.keysOffset), SEEK_SET) != 0;
+
+	Writer writer(file);
+	uint64_t entries = 0;
+	forEachEntry([&writer, &entries](const Key &_key, const Item &) { writer.write(&_key, sizeof(Key)); entries++; });
+	writer.pad();
+	forEachEntry([&writer](const Key &, const Item &_item) { writer.write(&_item, sizeof(Item)); });
+	writer.pad();
+	writer.flush();
+
+	header = expectedHeader(entries);
+	header.checksum = writer.checksum.value();
+	failed = failed || writer.failed || header.fileSize != header.keysOffset + writer.written;
+	failed = failed || std::fseek(file, 0, SEEK_SET) != 0 || std::fwrite(&header, sizeof(header), 1, file) != 1;
+	failed = failed || std::fflush(file) != 0;
+#ifdef FLATSNAPSHOT_MMAP
+	//The contents have to be on disk before the rename is, or a crash may leave the new name on an empty file
+	failed = failed || ::fsync(fileno(file)) != 0;
+#endif
+	failed = (std::fclose(file) != 0) || failed;
+
+	if (failed || std::rename(temporaryPath.c_str(), path.c_str()) != 0)
+	{
+		std::remove(temporaryPath.c_str());
+		return false;
+	}
+	return syncDirectoryOf(path);
+}
+
+//Makes the rename durable. Without POSIX there is nothing portable to sync, the rename is left to the system
+template<typename K, typename I, typename C>
+bool FlatSnapshot<K, I, C>::syncDirectoryOf(const std::string &path)
+{
+#ifdef FLATSNAPSHOT_MMAP
+	size_t separator = path.find_last_of('/');
+	std::string directory = (separator == std::string::npos) ? "." : (separator == 0) ? "/" : path.substr(0, separator);
+	int descriptor = ::open(directory.c_str(), O_RDONLY);
+	if (descriptor < 0)
+		return false;
+
+	bool synced = ::fsync(descriptor) == 0;
+	::close(descriptor);
+	return synced;
+#else
+	(void)path;
+	return true;
+#endif
+}
+
+template<typename K, typename I, typename C>
+std::unique_ptr<FlatSnapshot<K, I, C>> FlatSnapshot<K, I, C>::open(const std::string &path, bool verify, const Compare &_keyLess)
+{
+	checkTypes();
+	std::unique_ptr<FlatSnapshot> snapshot(new FlatSnapshot());
+	snapshot->keyLess = _keyLess;
+
+#ifdef FLATSNAPSHOT_MMAP
+	int descriptor = ::open(path.c_str(), O_RDONLY);
+	if (descriptor < 0)
+		return nullptr;
+
+	struct stat status;
+	if (::fstat(descriptor, &status) == 0 && status.st_size >= static_cast<off_t>(sizeof(FlatSnapshotHeader)))
+	{
+		//Private and writable: items handed out by lookup may be modified, the changes never reach the file
+		void* address = ::mmap(nullptr, status.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, descriptor, 0);
+		if (address != MAP_FAILED)
+		{
+			snapshot->data = static_cast<unsigned char*>(address);
+			snapshot->dataSize = status.st_size;
+			snapshot->mapped = true;
+		}
+	}
+	::close(descriptor);
+#endif
+
+	//Without mmap the file is read into memory as it is
+	if (!snapshot->mapped)
+	{
+		FILE* file = std::fopen(path.c_str(), "rb");
+		if (file == nullptr)
+			return nullptr;
+
+		long size = -1;
+		if (std::fseek(file, 0, SEEK_END) == 0)
+			size = std::ftell(file);
+		if (size >= static_cast<long>(sizeof(FlatSnapshotHeader)) && std::fseek(file, 0, SEEK_SET) == 0)
+		{
+			snapshot->data = static_cast<unsigned char*>(::operator new(size));
+			snapshot->dataSize = size;
+			if (std::fread(snapshot->data, 1, size, file) != static_cast<size_t>(size))
+				snapshot->dataSize = 0;
+		}
+		std::fclose(file);
+	}
+
+	if (snapshot->dataSize < sizeof(FlatSnapshotHeader) || !snapshot->validate(verify))
+		return nullptr;
+	return snapshot;
+}
+
+template<typename K, typename I, typename C>
+bool FlatSnapshot<K, I, C>::validate(bool verify)
+{
+	FlatSnapshotHeader header;
+	std::memcpy(&header, data, sizeof(header));
+
+	//Bounding the count first keeps the offsets computed from it from overflowing
+	if (header.count > dataSize / (sizeof(Key) + sizeof(Item)))
+		return false;
+
+	FlatSnapshotHeader expected = expectedHeader(header.count);
+	if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 || header.version != expected.version ||
+		header.headerSize != expected.headerSize || header.keySize != expected.keySize || header.itemSize != expected.itemSize ||
+		header.keysOffset != expected.keysOffset || header.itemsOffset != expected.itemsOffset ||
+		header.fileSize != expected.fileSize || header.fileSize != dataSize)
+		return false;
+
+	count = header.count;
+	keyData = reinterpret_cast<const Key*>(data + header.keysOffset);
+	itemData = reinterpret_cast<Item*>(data + header.itemsOffset);
+
+	if (!verify)
+		return true;
+
+	FlatSnapshotChecksum checksum;
+	checksum.update(data + header.keysOffset, dataSize - header.keysOffset);
+	if (checksum.value() != header.checksum || !keysInOrder())
+		return false;
+
+	contentsVerified = true;
+	return true;
+}
+
+template<typename K, typename I, typename C>
+bool FlatSnapshot<K, I, C>::keysInOrder() const
+{
+	for (size_t i = 1; i < count; i++)
+		if (!keyLess(keyData[i - 1], keyData[i]))
+			return false;
+	return true;
+}
+
+template<typename K, typename I, typename C>
+FlatSnapshot<K, I, C>::~FlatSnapshot()
+{
+#ifdef FLATSNAPSHOT_MMAP
+	if (mapped)
+	{
+		::munmap(data, dataSize);
+		return;
+	}
+#endif
+	::operator delete(data);
+}
+
+template<typename K, typename I, typename C>
+template<typename KeyLike>
+typename FlatSnapshot<K, I, C>::Item* FlatSnapshot<K, I, C>::lookup(const KeyLike &_key)
+{
+	size_t index = rank(_key, false);
+	return (index < count && !ThreeWayCompare<Compare>::before(keyLess, _key, keyData[index])) ? &itemData[index] : nullptr;
+}
+
+//Branch free binary search, the compiler turns the halving step into a conditional move
+template<typename K, typename I, typename C>
+template<typename KeyLike>
+size_t FlatSnapshot<K, I, C>::rank(const KeyLike &_key, bool inclusive) const
+{
+	if (count == 0)
+		return 0;
+
+	auto before = [this, &_key, inclusive](const Key &current)
+	{
+		using Order = ThreeWayCompare<Compare>;
+		return inclusive ? !Order::before(keyLess, _key, current) : Order::before(keyLess, current, _key);
+	};
+	const Key* base = keyData;
+	for (size_t length = count; length > 1; )
+	{
+		size_t half = length / 2;
+		base = before(base[half]) ? base + half : base;
+		length -= half;
+	}
+	return (base - keyData) + before(*base);
+}
+
+template<typename K, typename I, typename C>
+template<typename Function>
+void FlatSnapshot<K, I, C>::forEach(Function function) const
+{
+	for (size_t i = 0; i < count; i++)
+		function(keyData[i], itemData[i]);
+}
+
+#endif // !FLATSNAPSHOT_H
@@ -0,0 +1,479 @@
+#ifndef HASHDICTIONARY_H
+#define HASHDICTIONARY_H
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HASHDICTIONARY_SSE2
+#endif
+
+namespace Containers
+{
+	//Dictionary utilizing a flat open addressing table.
+	//Every slot has a control byte: empty, or 7 bits of the key's hash. Lookups compare the control bytes
+	//of 16 consecutive slots at once and only compare keys whose hash bits match.
+	//Collisions are resolved with linear probing and removals shift the following entries back,
+	//so the table never contains tombstones.
+	//Item pointers returned by lookup are invalidated by insertions that grow the table and by removals.
+	template<typename K, typename I, typename Hash = std::hash<K>>
+	class HashDictionary
+	{
+	public:
+		using Key = K;
+		using Item = I;
+
+		void insert(Key, Item);
+		Item* lookup(const Key &) const;
+		void remove(const Key &);
+		void printEntries() const;
+		void clear();
+		bool empty() const;
+		size_t size() const;
+		void swap(HashDictionary&);
+
+		//Number of slots, always a power of two
+		size_t capacity() const;
+		//Makes room for count entries without exceeding the maximum load factor
+		void reserve(size_t);
+		//Rebuilds the table with at least the given number of slots
+		void rehash(size_t);
+
+		HashDictionary() = default;
+		HashDictionary(HashDictionary &&);
+		HashDictionary(const HashDictionary &);
+		~HashDictionary();
+
+		HashDictionary &operator=(const HashDictionary &);
+		HashDictionary &operator=(HashDictionary &&);
+
+		template<typename KT, typename IT, typename HT>
+		friend std::ostream& operator<<(std::ostream &, const HashDictionary<KT, IT, HT> &);
+
+	private:
+		struct Slot;
+		class Group;
+
+		static const size_t groupWidth = 16;
+		static const size_t minimumCapacity = 16;
+		static const uint8_t emptyControl = 0x80;
+
+		//Maximum load factor of 7/8
+		static size_t maxEntries(size_t);
+
+		Slot* slots = nullptr;
+		//capacity + groupWidth - 1 control bytes, the first groupWidth - 1 are mirrored at the end
+		//so that a group can be loaded from any slot without wrapping around
+		uint8_t* control = nullptr;
+		size_t slotCount = 0;
+		size_t tableSize = 0;
+		Hash hasher;
+
+		uint64_t hashKey(const Key&) const;
+		size_t homeSlot(uint64_t) const;
+		size_t findSlot(const Key&, uint64_t) const;
+		size_t findEmptySlot(size_t) const;
+		void setControl(size_t, uint8_t);
+		void allocate(size_t);
+		void destroyAll();
+		void deallocate();
+		void copyFrom(const HashDictionary&);
+
+		static const size_t notFound = ~size_t(0);
+	};
+
+	template<typename K, typename I, typename H>
+	struct HashDictionary<K, I, H>::Slot
+	{
+		Key key;
+		Item item;
+
+		Slot(Key _key, Item _item) : key(std::move(_key)), item(std::move(_item)) {}
+	};
+
+	//Bitmasks over the 16 control bytes starting at a slot, bit n stands for slot + n
+	template<typename K, typename I, typename H>
+	class HashDictionary<K, I, H>::Group
+	{
+	public:
+		explicit Group(const uint8_t* position)
+		{
+#ifdef HASHDICTIONARY_SSE2
+			bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(position));
+#else
+			std::memcpy(bytes, position, groupWidth);
+#endif
+		}
+
+		uint32_t match(uint8_t hashBits) const
+		{
+#ifdef HASHDICTIONARY_SSE2
+			return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(static_cast<char>(hashBits)))));
+#else
+			uint32_t mask = 0;
+			for (size_t i = 0; i < groupWidth; i++)
+				mask |= uint32_t(bytes[i] == hashBits) << i;
+			return mask;
+#endif
+		}
+
+		//Empty control bytes are the only ones with the top bit set
+		uint32_t matchEmpty() const
+		{
+#ifdef HASHDICTIONARY_SSE2
+			return static_cast<uint32_t>(_mm_movemask_epi8(bytes));
+#else
+			uint32_t mask = 0;
+			for (size_t i = 0; i < groupWidth; i++)
+				mask |= uint32_t(bytes[i] >> 7) << i;
+			return mask;
+#endif
+		}
+
+	private:
+#ifdef HASHDICTIONARY_SSE2
+		__m128i bytes;
+#else
+		uint8_t bytes[groupWidth];
+#endif
+	};
+
+	static inline unsigned lowestBit(uint32_t mask)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		return static_cast<unsigned>(__builtin_ctz(mask));
+#else
+		unsigned index = 0;
+		while (!(mask & 1u))
+		{
+			mask >>= 1;
+			index++;
+		}
+		return index;
+#endif
+	}
+
+	//Move constructor
+	template<typename K, typename I, typename H>
+	HashDictionary<K, I, H>::HashDictionary(HashDictionary &&original)
+	{
+		swap(original);
+	}
+
+	//Copy constructor
+	template<typename K, typename I, typename H>
+	HashDictionary<K, I, H>::HashDictionary(const HashDictionary &original) : hasher(original.hasher)
+	{
+		copyFrom(original);
+	}
+
+	//Destructor
+	template<typename K, typename I, typename H>
+	HashDictionary<K, I, H>::~HashDictionary()
+	{
+		destroyAll();
+		deallocate();
+	}
+
+	//Copy assignment operator
+	template<typename K, typename I, typename H>
+	HashDictionary<K, I, H> & HashDictionary<K, I, H>::operator=(const HashDictionary &original)
+	{
+		if (this == &original)
+			return *this;
+
+		destroyAll();
+		deallocate();
+		hasher = original.hasher;
+		copyFrom(original);
+		return *this;
+	}
+
+	//Move assignment operator
+	template<typename K, typename I, typename H>
+	HashDictionary<K, I, H> & HashDictionary<K, I, H>::operator=(HashDictionary &&original)
+	{
+		if (this == &original)
+			return *this;
+
+		destroyAll();
+		deallocate();
+		swap(original);
+		return *this;
+	}
+
+	template<typename K, typename I, typename H>
+	size_t HashDictionary<K, I, H>::maxEntries(size_t slots)
+	{
+		return slots - slots / 8;
+	}
+
+	//Scrambles the user hash so identity hashes of integers still spread over the table
+	template<typename K, typename I, typename H>
+	uint64_t HashDictionary<K, I, H>::hashKey(const Key &_key) const
+	{
+		uint64_t hash = static_cast<uint64_t>(hasher(_key)) * 0x9E3779B97F4A7C15ull;
+		return hash ^ (hash >> 32);
+	}
+
+	template<typename K, typename I, typename H>
+	size_t HashDictionary<K, I, H>::homeSlot(uint64_t hash) const
+	{
+		return static_cast<size_t>(hash >> 7) & (slotCount - 1);
+	}
+
+	template<typename K, typename I, typename H>
+	void HashDictionary<K, I, H>::setControl(size_t index, uint8_t value)
+	{
+		control[index] = value;
+		if (index < groupWidth - 1)
+			control[slotCount + index] = value;
+	}
+
+	//Probes group by group from the home slot; with no tombstones the first empty slot ends the search
+	template<typename K, typename I, typename H>
+	size_t HashDictionary<K, I, H>::findSlot(const Key &_key, uint64_t hash) const
+	{
+		if (tableSize == 0)
+			return notFound;
+
+		uint8_t hashBits = static_cast<uint8_t>(hash & 0x7F);
+		size_t mask = slotCount - 1;
+		size_t position = homeSlot(hash);
+
+		while (true)
+		{
+			Group group(control + position);
+			for (uint32_t matches = group.match(hashBits); matches != 0; matches &= matches - 1)
+			{
+				size_t index = (position + lowestBit(matches)) & mask;
+				if (slots[index].key == _key)
+					return index;
+			}
+			if (group.matchEmpty() != 0)
+				return notFound;
+			position = (position + groupWidth) & mask;
+		}
+	}
+
+	template<typename K, typename I, typename H>
+	size_t HashDictionary<K, I, H>::findEmptySlot(size_t position) const
+	{
+		size_t mask = slotCount - 1;
+		while (true)
+		{
+			uint32_t empties = Group(control + position).matchEmpty();
+			if (empties != 0)
+				return (position + lowestBit(empties)) & mask;
+			position = (position + groupWidth) & mask;
+		}
+	}
+
+	template<typename K, typename I, typename H>
+	void HashDictionary<K, I, H>::allocate(size_t count)
+	{
+		slotCount = count;
+		slots = static_cast<Slot*>(::operator new(count * sizeof(Slot)));
+		control = static_cast<uint8_t*>(::operator new(count + groupWidth - 1));
+		std::memset(control, emptyControl, count + groupWidth - 1);
+	}
+
+	template<typename K, typename I, typename H>
+	void HashDictionary<K, I, H>::destroyAll()
+	{
+		for (size_t i = 0; i < slotCount && tableSize != 0; i++)
+		{
+			if (control[i] != emptyControl)
+			{
+				slots[i].~Slot();
+				setControl(i, emptyControl);
+				tableSize--;
+			}
+		}
+	}
+
+	template<typename K, typename I, typename H>
+	void HashDictionary<K, I, H>::deallocate()
+	{
+		::operator delete(slots);
+		::operator delete(control);
+		slots = nullptr;
+		control = nullptr;
+		slotCount = 0;
+		tableSize = 0;
+	}
+
+	//Same capacity and control bytes, so every entry lands in the slot it has in the original
+	template<typename K, typename I, typename H>
+	void HashDictionary<K, I, H>::copyFrom(const HashDictionary &original)
+	{
+		if (original.slotCount == 0)
+			return;
+
+		allocate(original.slotCount);
+		for (size_t i = 0; i < slotCount; i++)
+		{
+			if (original.control[i] != emptyControl)
+			{
+				new (&slots[i]) Slot(original.slots[i]);
+				setControl(i, original.control[i]);
+				tableSize++;
+			}
+		}
+	}
+
+	//Insert function
+	template<typename K, typename I, typename H>
+	void HashDictionary<K, I, H>::insert(Key _key, Item _item)
+	{
+		uint64_t hash = hashKey(_key);
+		size_t index = findSlot(_key, hash);
+		if (index != notFound)
+		{
+			slots[index].item = std::move(_item);
+			return;
+		}
+
+		if (tableSize + 1 > maxEntries(slotCount))
+			rehash(slotCount == 0 ? minimumCapacity : slotCount * 2);
+
+		index = findEmptySlot(homeSlot(hash));
+		new (&slots[index]) Slot(std::move(_key), std::move(_item));
+		setControl(index, static_cast<uint8_t>(hash & 0x7F));
+		tableSize++;
+	}
+
+	//Lookup function
+	template<typename K, typename I, typename H>
+	typename HashDictionary<K, I, H>::Item* HashDictionary<K, I, H>::lookup(const Key &_key) const
+	{
+		size_t index = findSlot(_key, hashKey(_key));
+		return (index == notFound) ? nullptr : &slots[index].item;
+	}
+
+	//Remove function, backward shift deletion: every following entry of the probe run that
+	//would be unreachable past the hole is moved into it, until an empty slot is reached
+	template<typename K, typename I, typename H>
+	void HashDictionary<K, I, H>::remove(const Key &_key)
+	{
+		size_t hole = findSlot(_key, hashKey(_key));
+		if (hole == notFound)
+			return;
+
+		size_t mask = slotCount - 1;
+		slots[hole].~Slot();
+
+		for (size_t next = (hole + 1) & mask; control[next] != emptyControl; next = (next + 1) & mask)
+		{
+			size_t home = homeSlot(hashKey(slots[next].key));
+			if (((next - home) & mask) >= ((next - hole) & mask))
+			{
+				new (&slots[hole]) Slot(std::move(slots[next]));
+				slots[next].~Slot();
+				setControl(hole, control[next]);
+				hole = next;
+			}
+		}
+
+		setControl(hole, emptyControl);
+		tableSize--;
+	}
+
+	template<typename K, typename I, typename H>
+	void HashDictionary<K, I, H>::printEntries() const
+	{
+		std::cout << *this;
+	}
+
+	//Clear the table, keeping its capacity
+	template<typename K, typename I, typename H>
+	void HashDictionary<K, I, H>::clear()
+	{
+		destroyAll();
+	}
+
+	template<typename K, typename I, typename H>
+	bool HashDictionary<K, I, H>::empty() const
+	{
+		return tableSize == 0;
+	}
+
+	template<typename K, typename I, typename H>
+	size_t HashDictionary<K, I, H>::size() const
+	{
+		return tableSize;
+	}
+
+	template<typename K, typename I, typename H>
+	size_t HashDictionary<K, I, H>::capacity() const
+	{
+		return slotCount;
+	}
+
+	template<typename K, typename I, typename H>
+	void HashDictionary<K, I, H>::swap(HashDictionary &original)
+	{
+		std::swap(slots, original.slots);
+		std::swap(control, original.control);
+		std::swap(slotCount, original.slotCount);
+		std::swap(tableSize, original.tableSize);
+		std::swap(hasher, original.hasher);
+	}
+
+	template<typename K, typename I, typename H>
+	void HashDictionary<K, I, H>::reserve(size_t count)
+	{
+		size_t newCapacity = minimumCapacity;
+		while (maxEntries(newCapacity) < count)
+			newCapacity *= 2;
+		if (newCapacity > slotCount)
+			rehash(newCapacity);
+	}
+
+	//Moves every entry into a freshly allocated table, never shrinking below the current size
+	template<typename K, typename I, typename H>
+	void HashDictionary<K, I, H>::rehash(size_t count)
+	{
+		size_t newCapacity = minimumCapacity;
+		while (newCapacity < count || maxEntries(newCapacity) < tableSize)
+			newCapacity *= 2;
+
+		HashDictionary rebuilt;
+		rebuilt.hasher = hasher;
+		rebuilt.allocate(newCapacity);
+
+		for (size_t i = 0; i < slotCount; i++)
+		{
+			if (control[i] == emptyControl)
+				continue;
+
+			uint64_t hash = hashKey(slots[i].key);
+			size_t index = rebuilt.findEmptySlot(rebuilt.homeSlot(hash));
+			new (&rebuilt.slots[index]) Slot(std::move(slots[i]));
+			rebuilt.setControl(index, control[i]);
+			rebuilt.tableSize++;
+		}
+
+		destroyAll();
+		deallocate();
+		swap(rebuilt);
+	}
+
+	//operator<< overloading to transfer the entries into the stream, in table order
+	template<typename K, typename I, typename H>
+	std::ostream& operator<< (std::ostream &os, const HashDictionary<K, I, H> &dictionary)
+	{
+		for (size_t i = 0; i < dictionary.slotCount; i++)
+		{
+			if (dictionary.control[i] != HashDictionary<K, I, H>::emptyControl)
+				os << dictionary.slots[i].key << " " << dictionary.slots[i].item << std::endl;
+		}
+		return os;
+	}
+};
+#endif // !HASHDICTIONARY_H
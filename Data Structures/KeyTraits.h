@@ -0,0 +1,139 @@
+#ifndef KEYTRAITS_H
+#define KEYTRAITS_H
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+//A std::string or std::string_view on at least one side, compared with a string literal, a character pointer or another string
+template<typename A, typename B>
+struct IsStringComparison : std::integral_constant<bool,
+	(std::is_same<A, std::string>::value || std::is_same<A, std::string_view>::value ||
+		std::is_same<B, std::string>::value || std::is_same<B, std::string_view>::value) &&
+	std::is_convertible<const A &, std::string_view>::value && std::is_convertible<const B &, std::string_view>::value> {};
+
+//Types that convert to Key implicitly, numbers in particular, are converted as they always were: comparing an int
+//with an unsigned key or a double with an int key through the operators would give other results than converting.
+//Strings are the exception, a literal compares with a std::string key the same either way and needs no temporary
+template<typename Key, typename KeyLike>
+struct ConvertsToKey : std::integral_constant<bool,
+	std::is_convertible<const KeyLike &, Key>::value && !IsStringComparison<Key, KeyLike>::value> {};
+
+//True when KeyLike can be compared against Key directly with == and <, in both directions.
+//Lookups accept such types as they are, e.g. std::string_view or string literals for std::string keys,
+//so no temporary Key has to be built.
+template<typename Key, typename KeyLike, typename = void>
+struct IsComparableKey : std::false_type {};
+
+template<typename Key, typename KeyLike>
+struct IsComparableKey<Key, KeyLike, std::void_t<
+	decltype(std::declval<const Key &>() == std::declval<const KeyLike &>()),
+	decltype(std::declval<const Key &>() < std::declval<const KeyLike &>()),
+	decltype(std::declval<const KeyLike &>() < std::declval<const Key &>())>> : std::true_type {};
+
+//Weaker form for containers that only test keys for equality
+template<typename Key, typename KeyLike, typename = void>
+struct IsEqualityComparableKey : std::false_type {};
+
+template<typename Key, typename KeyLike>
+struct IsEqualityComparableKey<Key, KeyLike, std::void_t<
+	decltype(std::declval<const Key &>() == std::declval<const KeyLike &>())>> : std::true_type {};
+
+//Enables the heterogeneous overloads for comparable types other than Key itself and the types converted to it
+template<typename Key, typename KeyLike>
+using EnableIfComparableKey = typename std::enable_if<IsComparableKey<Key, KeyLike>::value &&
+	!std::is_same<typename std::decay<KeyLike>::type, Key>::value && !ConvertsToKey<Key, KeyLike>::value>::type;
+
+template<typename Key, typename KeyLike>
+using EnableIfEqualityComparableKey = typename std::enable_if<IsEqualityComparableKey<Key, KeyLike>::value &&
+	!std::is_same<typename std::decay<KeyLike>::type, Key>::value && !ConvertsToKey<Key, KeyLike>::value>::type;
+
+//Comparators declaring is_transparent accept any pair of types they can order, like std::less<>
+template<typename Compare, typename = void>
+struct IsTransparent : std::false_type {};
+
+template<typename Compare>
+struct IsTransparent<Compare, std::void_t<typename Compare::is_transparent>> : std::true_type {};
+
+//Enables the heterogeneous overloads of the ordered containers: with the default std::less<Key> for types comparable
+//with Key through its operators and not converted to it, as above, and with a transparent comparator for any other type
+template<typename Key, typename KeyLike, typename Compare>
+using EnableIfOrderedKey = typename std::enable_if<!std::is_same<typename std::decay<KeyLike>::type, Key>::value &&
+	((std::is_same<Compare, std::less<Key>>::value && IsComparableKey<Key, KeyLike>::value && !ConvertsToKey<Key, KeyLike>::value) ||
+		IsTransparent<Compare>::value)>::type;
+
+//Three way comparison under a less-than comparator: compare is negative if a is ordered first, zero if the two are
+//equivalent, positive if b is ordered first. Tree descents branch on it once per node instead of testing == and then <.
+//Any comparator is called at most twice. std::less, which the ordered containers use by default, is bypassed for
+//arithmetic, string and pointer operands, where a program cannot specialize it: strings are walked once by compare()
+//and arithmetic keys need no branch at all. Other keys go through std::less<Key>, which a program may specialize for
+//its own types, and heterogeneous keys, which it cannot take, through their operators.
+//before is the plain less-than test, with the same treatment of std::less so that heterogeneous keys work with it.
+template<typename Compare>
+struct ThreeWayCompare
+{
+	template<typename A, typename B>
+	static bool before(const Compare &less, const A &a, const B &b)
+	{
+		return less(a, b);
+	}
+
+	template<typename A, typename B>
+	static int compare(const Compare &less, const A &a, const B &b)
+	{
+		if (less(a, b))
+			return -1;
+		return less(b, a) ? 1 : 0;
+	}
+};
+
+template<typename T>
+struct ThreeWayCompare<std::less<T>>
+{
+	template<typename A, typename B>
+	static bool before(const std::less<T> &less, const A &a, const B &b)
+	{
+		if constexpr (std::is_same<A, T>::value && std::is_same<B, T>::value)
+			return less(a, b);
+		else if constexpr (std::is_pointer<A>::value && std::is_pointer<B>::value)
+			return std::less<>()(a, b);
+		else
+			return a < b;
+	}
+
+	template<typename A, typename B>
+	static int compare(const std::less<T> &less, const A &a, const B &b)
+	{
+		if constexpr (std::is_arithmetic<A>::value && std::is_arithmetic<B>::value)
+			return (b < a) - (a < b);
+		else if constexpr (IsStringComparison<A, B>::value)
+		{
+			int order = std::string_view(a).compare(std::string_view(b));
+			return (order > 0) - (order < 0);
+		}
+		else if constexpr (std::is_pointer<A>::value || std::is_pointer<B>::value)
+		{
+			//Only std::less orders unrelated pointers
+			std::less<> pointerLess;
+			if (pointerLess(a, b))
+				return -1;
+			return pointerLess(b, a) ? 1 : 0;
+		}
+		else if constexpr (std::is_same<A, T>::value && std::is_same<B, T>::value)
+		{
+			if (less(a, b))
+				return -1;
+			return less(b, a) ? 1 : 0;
+		}
+		else
+		{
+			if (a < b)
+				return -1;
+			return (b < a) ? 1 : 0;
+		}
+	}
+};
+
+#endif // !KEYTRAITS_H
@@ -0,0 +1,345 @@
+#ifndef LRUCACHE_H
+#define LRUCACHE_H
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "HashDictionary.h"
+
+namespace Containers
+{
+	//Evicts the least recently used entry
+	struct LRUEviction
+	{
+		static const bool countsUses = false;
+
+		template<typename Entry>
+		uint32_t victim(const std::vector<Entry> &, uint32_t leastRecent) { return leastRecent; }
+	};
+
+	//Approximates least frequently used eviction the way Redis does: a few entries are drawn at random and the least used
+	//one goes, which needs no ordering by use count. The least recently used entry is always among the candidates and wins
+	//ties, so entries used equally often leave in LRU order. The cache halves the use counts periodically, so entries that
+	//were popular once do not stay forever.
+	template<unsigned Samples = 5>
+	struct SampledLFUEviction
+	{
+		static const bool countsUses = true;
+
+		template<typename Entry>
+		uint32_t victim(const std::vector<Entry> &entries, uint32_t leastRecent)
+		{
+			uint32_t chosen = leastRecent;
+			for (unsigned i = 1; i < Samples; i++)
+			{
+				uint32_t candidate = static_cast<uint32_t>(((next() >> 32) * entries.size()) >> 32);
+				if (entries[candidate].uses < entries[chosen].uses)
+					chosen = candidate;
+			}
+			return chosen;
+		}
+
+	private:
+		//xorshift64, sampling needs speed rather than quality
+		uint64_t next()
+		{
+			state ^= state << 13;
+			state ^= state >> 7;
+			state ^= state << 17;
+			return state;
+		}
+
+		uint64_t state = 0x9E3779B97F4A7C15ull;
+	};
+
+	//Cache holding at most capacity entries, evicting one chosen by Policy to make room for a new key.
+	//Entries sit in a vector linked into a recency list by index, a HashDictionary maps keys to their slots,
+	//so get, put and eviction are O(1). An evicted entry's slot is reused by the new one.
+	//Item pointers returned by get and peek are invalidated by put and remove.
+	template<typename K, typename I, typename Policy = LRUEviction, typename Hash = std::hash<K>>
+	class Cache
+	{
+	public:
+		using Key = K;
+		using Item = I;
+		//Called with every evicted entry before it is overwritten, not on remove or clear
+		using EvictionCallback = std::function<void(const Key &, Item &)>;
+
+		//Returns the item and marks it as used, or null, counting a hit or a miss
+		Item* get(const Key &);
+		//Returns the item without touching the recency order or the counters
+		Item* peek(const Key &);
+		//Inserts or assigns, evicting an entry when the cache is full, and marks the entry as used
+		void put(Key, Item);
+		void remove(const Key &);
+		void clear();
+
+		size_t size() const { return entries.size(); }
+		size_t capacity() const { return limit; }
+		bool empty() const { return entries.empty(); }
+
+		uint64_t hits() const { return hitCount; }
+		uint64_t misses() const { return missCount; }
+		uint64_t evictions() const { return evictionCount; }
+		double hitRatio() const;
+		void resetCounters();
+
+		//Calls function(key, item) from the most to the least recently used entry
+		template<typename Function>
+		void forEach(Function) const;
+		void printEntries() const;
+
+		template<typename KT, typename IT, typename PT, typename HT>
+		friend std::ostream& operator<<(std::ostream &, const Cache<KT, IT, PT, HT> &);
+
+		explicit Cache(size_t, EvictionCallback = nullptr, Policy = Policy());
+
+	private:
+		struct Entry
+		{
+			Key key;
+			Item item;
+			uint32_t newer;
+			uint32_t older;
+			uint32_t uses = 0;
+
+			Entry(Key _key, Item _item) : key(std::move(_key)), item(std::move(_item)) {}
+		};
+
+		static const uint32_t none = ~uint32_t(0);
+		//Use counts are halved after this many uses per entry
+		static const uint32_t agingPeriod = 16;
+
+		void unlink(uint32_t);
+		void pushFront(uint32_t);
+		void touch(uint32_t);
+		void countUse(uint32_t);
+
+		std::vector<Entry> entries;
+		HashDictionary<Key, uint32_t, Hash> index;
+		uint32_t newest = none;
+		uint32_t oldest = none;
+		size_t limit;
+		uint64_t usesSinceAging = 0;
+		EvictionCallback onEvict;
+		Policy policy;
+
+		uint64_t hitCount = 0;
+		uint64_t missCount = 0;
+		uint64_t evictionCount = 0;
+	};
+
+	template<typename K, typename I, typename Hash = std::hash<K>>
+	using LRUCache = Cache<K, I, LRUEviction, Hash>;
+
+	template<typename K, typename I, typename Hash = std::hash<K>>
+	using LFUCache = Cache<K, I, SampledLFUEviction<>, Hash>;
+
+	template<typename K, typename I, typename P, typename H>
+	Cache<K, I, P, H>::Cache(size_t _capacity, EvictionCallback _onEvict, P _policy)
+		: limit(_capacity), onEvict(std::move(_onEvict)), policy(std::move(_policy))
+	{
+		if (_capacity == 0 || _capacity >= none)
+			throw std::invalid_argument("Cache capacity must be between 1 and 2^32 - 2");
+	}
+
+	template<typename K, typename I, typename P, typename H>
+	void Cache<K, I, P, H>::unlink(uint32_t slot)
+	{
+		Entry &entry = entries[slot];
+		if (entry.newer != none)
+			entries[entry.newer].older = entry.older;
+		else
+			newest = entry.older;
+		if (entry.older != none)
+			entries[entry.older].newer = entry.newer;
+		else
+			oldest = entry.newer;
+	}
+
+	template<typename K, typename I, typename P, typename H>
+	void Cache<K, I, P, H>::pushFront(uint32_t slot)
+	{
+		Entry &entry = entries[slot];
+		entry.newer = none;
+		entry.older = newest;
+		if (newest != none)
+			entries[newest].newer = slot;
+		else
+			oldest = slot;
+		newest = slot;
+	}
+
+	template<typename K, typename I, typename P, typename H>
+	void Cache<K, I, P, H>::touch(uint32_t slot)
+	{
+		if (slot != newest)
+		{
+			unlink(slot);
+			pushFront(slot);
+		}
+		countUse(slot);
+	}
+
+	//Only kept for policies that look at use counts. Halving every count once in agingPeriod uses per entry
+	//costs O(1) amortized per use
+	template<typename K, typename I, typename P, typename H>
+	void Cache<K, I, P, H>::countUse(uint32_t slot)
+	{
+		if constexpr (P::countsUses)
+		{
+			uint32_t &uses = entries[slot].uses;
+			if (uses != std::numeric_limits<uint32_t>::max())
+				uses++;
+
+			if (++usesSinceAging >= static_cast<uint64_t>(agingPeriod) * entries.size())
+			{
+				for (Entry &entry : entries)
+					entry.uses >>= 1;
+				usesSinceAging = 0;
+			}
+		}
+	}
+
+	template<typename K, typename I, typename P, typename H>
+	typename Cache<K, I, P, H>::Item* Cache<K, I, P, H>::get(const Key &_key)
+	{
+		uint32_t* slot = index.lookup(_key);
+		if (slot == nullptr)
+		{
+			missCount++;
+			return nullptr;
+		}
+
+		hitCount++;
+		touch(*slot);
+		return &entries[*slot].item;
+	}
+
+	template<typename K, typename I, typename P, typename H>
+	typename Cache<K, I, P, H>::Item* Cache<K, I, P, H>::peek(const Key &_key)
+	{
+		uint32_t* slot = index.lookup(_key);
+		return (slot == nullptr) ? nullptr : &entries[*slot].item;
+	}
+
+	template<typename K, typename I, typename P, typename H>
+	void Cache<K, I, P, H>::put(Key _key, Item _item)
+	{
+		uint32_t* existing = index.lookup(_key);
+		if (existing != nullptr)
+		{
+			uint32_t slot = *existing;
+			entries[slot].item = std::move(_item);
+			touch(slot);
+			return;
+		}
+
+		if (entries.size() < limit)
+		{
+			uint32_t slot = static_cast<uint32_t>(entries.size());
+			entries.emplace_back(_key, std::move(_item));
+			index.insert(std::move(_key), slot);
+			pushFront(slot);
+			countUse(slot);
+			return;
+		}
+
+		//The victim's slot is taken over by the new entry
+		uint32_t slot = policy.victim(entries, oldest);
+		Entry &victim = entries[slot];
+		evictionCount++;
+		if (onEvict)
+			onEvict(victim.key, victim.item);
+
+		index.remove(victim.key);
+		index.insert(_key, slot);
+		victim.key = std::move(_key);
+		victim.item = std::move(_item);
+		victim.uses = 0;
+		touch(slot);
+	}
+
+	//The last entry moves into the freed slot, keeping the vector dense for sampling
+	template<typename K, typename I, typename P, typename H>
+	void Cache<K, I, P, H>::remove(const Key &_key)
+	{
+		uint32_t* found = index.lookup(_key);
+		if (found == nullptr)
+			return;
+
+		uint32_t slot = *found;
+		unlink(slot);
+		index.remove(_key);
+
+		uint32_t last = static_cast<uint32_t>(entries.size() - 1);
+		if (slot != last)
+		{
+			Entry &moved = entries[slot];
+			moved = std::move(entries[last]);
+			if (moved.newer != none)
+				entries[moved.newer].older = slot;
+			else
+				newest = slot;
+			if (moved.older != none)
+				entries[moved.older].newer = slot;
+			else
+				oldest = slot;
+			*index.lookup(moved.key) = slot;
+		}
+		entries.pop_back();
+	}
+
+	template<typename K, typename I, typename P, typename H>
+	void Cache<K, I, P, H>::clear()
+	{
+		entries.clear();
+		index.clear();
+		newest = none;
+		oldest = none;
+		usesSinceAging = 0;
+	}
+
+	template<typename K, typename I, typename P, typename H>
+	double Cache<K, I, P, H>::hitRatio() const
+	{
+		uint64_t accesses = hitCount + missCount;
+		return (accesses == 0) ? 0.0 : static_cast<double>(hitCount) / accesses;
+	}
+
+	template<typename K, typename I, typename P, typename H>
+	void Cache<K, I, P, H>::resetCounters()
+	{
+		hitCount = 0;
+		missCount = 0;
+		evictionCount = 0;
+	}
+
+	template<typename K, typename I, typename P, typename H>
+	template<typename Function>
+	void Cache<K, I, P, H>::forEach(Function function) const
+	{
+		for (uint32_t slot = newest; slot != none; slot = entries[slot].older)
+			function(entries[slot].key, entries[slot].item);
+	}
+
+	template<typename K, typename I, typename P, typename H>
+	void Cache<K, I, P, H>::printEntries() const
+	{
+		std::cout << *this;
+	}
+
+	template<typename K, typename I, typename P, typename H>
+	std::ostream& operator<<(std::ostream &os, const Cache<K, I, P, H> &cache)
+	{
+		cache.forEach([&os](const K &key, const I &item) { os << key << " " << item << std::endl; });
+		return os;
+	}
+}
+
+#endif // !LRUCACHE_H
@@ -0,0 +1,225 @@
+#ifndef NODEPOOL_H
+#define NODEPOOL_H
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+#include <algorithm>
+
+//Node allocation policies used by the dictionaries.
+//A policy is a class template over the node type offering create/destroy for single nodes,
+//release() for dropping everything at once, swap() for exchanging ownership between containers,
+//and merge() for taking over the nodes of another allocator when containers are combined.
+
+//Every node is a separate heap allocation
+template<typename T>
+class HeapAllocator
+{
+public:
+	//release() cannot reclaim anything, nodes have to be destroyed one by one
+	static const bool releasesInBulk = false;
+
+	template<typename... Args>
+	T* create(Args&&... args)
+	{
+		return new T(std::forward<Args>(args)...);
+	}
+
+	void destroy(T* node)
+	{
+		delete node;
+	}
+
+	void release() {}
+	void swap(HeapAllocator &) {}
+	void merge(HeapAllocator &) {}
+};
+
+//Slab allocator: nodes are carved out of contiguous chunks and recycled through a free list.
+//release() frees whole chunks without visiting the nodes, so the owner only has to walk
+//its nodes when they need their destructors run.
+template<typename T>
+class NodePool
+{
+public:
+	static const bool releasesInBulk = true;
+
+	template<typename... Args>
+	T* create(Args&&...);
+	void destroy(T*);
+	void release();
+	void swap(NodePool &);
+	//Takes over the chunks of another pool, its nodes can then be destroyed through this one. The other is left empty
+	void merge(NodePool &);
+
+	//Number of nodes the currently allocated chunks can hold
+	size_t capacity() const;
+
+	NodePool() = default;
+	NodePool(NodePool &&);
+	NodePool(const NodePool &) = delete;
+	~NodePool();
+
+	NodePool &operator=(NodePool &&);
+	NodePool &operator=(const NodePool &) = delete;
+
+private:
+	union Slot;
+
+	//Chunks start small and double up to maxChunkBytes so small containers stay small
+	static const size_t firstChunkSlots = 32;
+	static const size_t maxChunkBytes = 64 * 1024;
+
+	std::vector<std::pair<Slot*, size_t>> chunks;
+	Slot* freeList = nullptr;
+	size_t chunkUsed = 0;
+
+	Slot* allocateSlot();
+};
+
+template<typename T>
+union NodePool<T>::Slot
+{
+	Slot* next;
+	alignas(T) unsigned char storage[sizeof(T)];
+};
+
+template<typename T>
+NodePool<T>::NodePool(NodePool &&original)
+{
+	swap(original);
+}
+
+template<typename T>
+NodePool<T>::~NodePool()
+{
+	release();
+}
+
+template<typename T>
+NodePool<T> & NodePool<T>::operator=(NodePool &&original)
+{
+	if (this != &original)
+	{
+		release();
+		swap(original);
+	}
+	return *this;
+}
+
+template<typename T>
+template<typename... Args>
+T* NodePool<T>::create(Args&&... args)
+{
+	Slot* slot = allocateSlot();
+	try
+	{
+		return new (slot->storage) T(std::forward<Args>(args)...);
+	}
+	catch (...)
+	{
+		slot->next = freeList;
+		freeList = slot;
+		throw;
+	}
+}
+
+template<typename T>
+void NodePool<T>::destroy(T* node)
+{
+	node->~T();
+
+	Slot* slot = reinterpret_cast<Slot*>(node);
+	slot->next = freeList;
+	freeList = slot;
+}
+
+template<typename T>
+void NodePool<T>::release()
+{
+	for (auto &chunk : chunks)
+		::operator delete(chunk.first);
+
+	chunks.clear();
+	freeList = nullptr;
+	chunkUsed = 0;
+}
+
+template<typename T>
+void NodePool<T>::swap(NodePool &original)
+{
+	chunks.swap(original.chunks);
+	std::swap(freeList, original.freeList);
+	std::swap(chunkUsed, original.chunkUsed);
+}
+
+template<typename T>
+void NodePool<T>::merge(NodePool &original)
+{
+	if (this == &original || original.chunks.empty())
+		return;
+
+	//Allocation continues in the newest chunk of the other pool, the unused tail of this one is recycled
+	if (!chunks.empty())
+	{
+		for (; chunkUsed < chunks.back().second; chunkUsed++)
+		{
+			Slot* slot = chunks.back().first + chunkUsed;
+			slot->next = freeList;
+			freeList = slot;
+		}
+	}
+
+	if (original.freeList != nullptr)
+	{
+		Slot* last = original.freeList;
+		while (last->next != nullptr)
+			last = last->next;
+		last->next = freeList;
+		freeList = original.freeList;
+	}
+
+	chunks.insert(chunks.end(), original.chunks.begin(), original.chunks.end());
+	chunkUsed = original.chunkUsed;
+
+	original.chunks.clear();
+	original.freeList = nullptr;
+	original.chunkUsed = 0;
+}
+
+template<typename T>
+size_t NodePool<T>::capacity() const
+{
+	size_t total = 0;
+	for (auto &chunk : chunks)
+		total += chunk.second;
+	return total;
+}
+
+//Recycled slots first, then the unused tail of the newest chunk, then a fresh chunk
+template<typename T>
+typename NodePool<T>::Slot* NodePool<T>::allocateSlot()
+{
+	if (freeList != nullptr)
+	{
+		Slot* slot = freeList;
+		freeList = slot->next;
+		return slot;
+	}
+
+	if (chunks.empty() || chunkUsed == chunks.back().second)
+	{
+		size_t maxSlots = std::max<size_t>(maxChunkBytes / sizeof(Slot), firstChunkSlots);
+		size_t slots = chunks.empty() ? firstChunkSlots : std::min(chunks.back().second * 2, maxSlots);
+
+		chunks.reserve(chunks.size() + 1);
+		Slot* chunk = static_cast<Slot*>(::operator new(slots * sizeof(Slot)));
+		chunks.emplace_back(chunk, slots);
+		chunkUsed = 0;
+	}
+
+	return chunks.back().first + chunkUsed++;
+}
+
+#endif // !NODEPOOL_H
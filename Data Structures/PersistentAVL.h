@@ -0,0 +1,452 @@
+#ifndef PERSISTENTAVL_H
+#define PERSISTENTAVL_H
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <assert.h>
+
+#include "EpochReclamation.h"
+#include "TreeIterator.h"
+
+//Persistent AVL dictionary for a single writer and any number of concurrent readers.
+//Nodes are immutable once published: insert and remove copy the O(log n) nodes on the path from the root,
+//share every untouched subtree with the previous version and then publish the new version with an atomic store.
+//snapshot() hands out an immutable version that can be read without any locking while the writer carries on;
+//nodes are reference counted, so a version disappears once neither the dictionary nor a snapshot refers to it.
+//Taking a snapshot takes no lock either: the current version is read as a raw pointer inside an EpochDomain guard,
+//and the dictionary's own reference to a replaced version is only dropped through the epoch domain, so the version
+//is still alive when the reader adds its reference.
+template<typename K, typename I>
+class PersistentAVL
+{
+public:
+	using Key = K;
+	using Item = I;
+
+	class Snapshot;
+
+	//Writers are serialized internally, the structure is meant for one writer at a time
+	void insert(Key, Item);
+	void remove(const Key &);
+	void clear();
+
+	//Current version: an atomic load of the published version and a reference count increment
+	Snapshot snapshot() const;
+	size_t size() const;
+
+	PersistentAVL();
+	PersistentAVL(const PersistentAVL &) = delete;
+	PersistentAVL &operator=(const PersistentAVL &) = delete;
+	~PersistentAVL();
+
+private:
+	struct Node;
+	struct Version;
+
+	using NodePtr = std::shared_ptr<const Node>;
+	//Nodes of the version being built, they are still private to the writer and may be modified
+	using MutableNodePtr = std::shared_ptr<Node>;
+
+	//An AVL tree of height 92 holds more than 2^64 nodes, so the path arrays never overflow
+	static const int maxDepth = 96;
+
+	static void rebalance(MutableNodePtr &);
+	static void rotateRight(MutableNodePtr &);
+	static void rotateLeft(MutableNodePtr &);
+
+	void publish(NodePtr, size_t);
+
+	static void releaseVersion(void*);
+
+	//Read by snapshot(), the version is kept alive by published
+	std::atomic<const Version*> current;
+	//The dictionary's reference to the current version, only touched by the writer
+	std::shared_ptr<const Version> published;
+	std::mutex writerLock;
+};
+
+template<typename K, typename I>
+struct PersistentAVL<K, I>::Node
+{
+	const Key key;
+	Item item;
+	short int balance = 0;
+
+	NodePtr leftChild;
+	NodePtr rightChild;
+
+	Node(Key _key, Item _item) : key(std::move(_key)), item(std::move(_item)) {}
+
+	//Takes the place of shape in the tree, with a different entry
+	Node(const Key &_key, const Item &_item, const Node &shape) : key(_key), item(_item),
+		balance(shape.balance), leftChild(shape.leftChild), rightChild(shape.rightChild) {}
+};
+
+template<typename K, typename I>
+struct PersistentAVL<K, I>::Version : std::enable_shared_from_this<Version>
+{
+	NodePtr root;
+	size_t size = 0;
+};
+
+//Immutable view of one version of the dictionary
+template<typename K, typename I>
+class PersistentAVL<K, I>::Snapshot
+{
+public:
+	//The pointer stays valid for as long as the snapshot exists
+	const Item* lookup(const Key &) const;
+	size_t size() const;
+	bool empty() const;
+
+	//Calls function(key, item) for every entry in key order, without recursion
+	template<typename Function>
+	void forEach(Function) const;
+	//Calls function(key, item) for every entry with lo <= key <= hi in key order, in O(log n + k)
+	template<typename Function>
+	void forEachInRange(const Key &, const Key &, Function) const;
+
+private:
+	friend class PersistentAVL;
+	explicit Snapshot(std::shared_ptr<const Version> _version) : version(std::move(_version)) {}
+
+	template<typename Function>
+	static void inorderFrom(FixedStack<const Node*, maxDepth> &, const Key*, Function);
+
+	std::shared_ptr<const Version> version;
+};
+
+template<typename K, typename I>
+PersistentAVL<K, I>::PersistentAVL() : published(std::make_shared<const Version>())
+{
+	current.store(published.get(), std::memory_order_release);
+}
+
+//Versions retired by the destroying thread are freed here rather than whenever the epoch domain next collects.
+//Snapshots still holding a version keep it alive as usual
+template<typename K, typename I>
+PersistentAVL<K, I>::~PersistentAVL()
+{
+	published.reset();
+	EpochDomain::instance().synchronize();
+}
+
+//The guard keeps the dictionary's retired reference, if the version has just been replaced, from being dropped
+//until the reader holds its own
+template<typename K, typename I>
+typename PersistentAVL<K, I>::Snapshot PersistentAVL<K, I>::snapshot() const
+{
+	EpochDomain::Guard guard;
+	return Snapshot(current.load(std::memory_order_acquire)->shared_from_this());
+}
+
+template<typename K, typename I>
+size_t PersistentAVL<K, I>::size() const
+{
+	EpochDomain::Guard guard;
+	return current.load(std::memory_order_acquire)->size;
+}
+
+template<typename K, typename I>
+void PersistentAVL<K, I>::releaseVersion(void* reference)
+{
+	delete static_cast<std::shared_ptr<const Version>*>(reference);
+}
+
+//Readers may have loaded the old version and not yet taken their reference, so the dictionary's reference to it
+//is retired rather than dropped
+template<typename K, typename I>
+void PersistentAVL<K, I>::publish(NodePtr root, size_t size)
+{
+	std::shared_ptr<Version> version = std::make_shared<Version>();
+	version->root = std::move(root);
+	version->size = size;
+
+	std::shared_ptr<const Version> previous = std::move(published);
+	published = std::move(version);
+	current.store(published.get(), std::memory_order_release);
+	EpochDomain::instance().retire(new std::shared_ptr<const Version>(std::move(previous)), releaseVersion);
+}
+
+//Path copying insertion: the descent is recorded, then the path is rebuilt bottom-up from copies,
+//updating balance factors the same way AVL::insertNode does for as long as the subtree height grows
+template<typename K, typename I>
+void PersistentAVL<K, I>::insert(Key _key, Item _item)
+{
+	std::lock_guard<std::mutex> guard(writerLock);
+	std::shared_ptr<const Version> version = published;
+
+	const Node* path[maxDepth];
+	short int directions[maxDepth];
+	int depth = 0;
+
+	const Node* existing = version->root.get();
+	while (existing != nullptr && !(existing->key == _key))
+	{
+		assert(depth < maxDepth);
+		directions[depth] = (existing->key < _key) ? 1 : -1;
+		path[depth++] = existing;
+		existing = (directions[depth - 1] == 1) ? existing->rightChild.get() : existing->leftChild.get();
+	}
+
+	MutableNodePtr subtree;
+	bool grew = (existing == nullptr);
+	if (grew)
+		subtree = std::make_shared<Node>(std::move(_key), std::move(_item));
+	else
+	{
+		subtree = std::make_shared<Node>(*existing);
+		subtree->item = std::move(_item);
+	}
+
+	while (depth > 0)
+	{
+		depth--;
+		MutableNodePtr copy = std::make_shared<Node>(*path[depth]);
+		(directions[depth] == 1 ? copy->rightChild : copy->leftChild) = std::move(subtree);
+
+		if (grew)
+		{
+			copy->balance += directions[depth];
+			if (copy->balance == 0)
+				grew = false;
+			else if (copy->balance == 2 || copy->balance == -2)
+			{
+				rebalance(copy);
+				grew = false;
+			}
+		}
+		subtree = std::move(copy);
+	}
+
+	publish(std::move(subtree), version->size + (existing == nullptr ? 1 : 0));
+}
+
+//Path copying removal: a node with two children is replaced by a copy of its in-order successor,
+//balance factors are retraced while the subtree height shrinks
+template<typename K, typename I>
+void PersistentAVL<K, I>::remove(const Key &_key)
+{
+	std::lock_guard<std::mutex> guard(writerLock);
+	std::shared_ptr<const Version> version = published;
+
+	const Node* path[maxDepth];
+	short int directions[maxDepth];
+	int depth = 0;
+
+	const Node* target = version->root.get();
+	while (target != nullptr && !(target->key == _key))
+	{
+		assert(depth < maxDepth);
+		directions[depth] = (target->key < _key) ? 1 : -1;
+		path[depth++] = target;
+		target = (directions[depth - 1] == 1) ? target->rightChild.get() : target->leftChild.get();
+	}
+
+	if (target == nullptr)
+		return;
+
+	NodePtr subtree;
+	int targetDepth = -1;
+	const Node* successor = nullptr;
+
+	if (target->leftChild == nullptr || target->rightChild == nullptr)
+		subtree = (target->leftChild == nullptr) ? target->rightChild : target->leftChild;
+	else
+	{
+		targetDepth = depth;
+		directions[depth] = 1;
+		path[depth++] = target;
+
+		successor = target->rightChild.get();
+		while (successor->leftChild != nullptr)
+		{
+			assert(depth < maxDepth);
+			directions[depth] = -1;
+			path[depth++] = successor;
+			successor = successor->leftChild.get();
+		}
+		subtree = successor->rightChild;
+	}
+
+	bool shrunk = true;
+	while (depth > 0)
+	{
+		depth--;
+		MutableNodePtr copy = (depth == targetDepth) ?
+			std::make_shared<Node>(successor->key, successor->item, *path[depth]) :
+			std::make_shared<Node>(*path[depth]);
+		(directions[depth] == 1 ? copy->rightChild : copy->leftChild) = std::move(subtree);
+
+		if (shrunk)
+		{
+			copy->balance -= directions[depth];
+			if (copy->balance == 1 || copy->balance == -1)
+				shrunk = false;
+			else if (copy->balance == 2 || copy->balance == -2)
+			{
+				rebalance(copy);
+				if (copy->balance != 0)
+					shrunk = false;
+			}
+		}
+		subtree = std::move(copy);
+	}
+
+	publish(std::move(subtree), version->size - 1);
+}
+
+//The whole tree may go at once, so it is freed now, once no reader can still be loading it, rather than left
+//in the epoch domain until enough later writes have been retired
+template<typename K, typename I>
+void PersistentAVL<K, I>::clear()
+{
+	{
+		std::lock_guard<std::mutex> guard(writerLock);
+		publish(nullptr, 0);
+	}
+	EpochDomain::instance().synchronize();
+}
+
+template<typename K, typename I>
+void PersistentAVL<K, I>::rebalance(MutableNodePtr &localRoot)
+{
+	if (localRoot->balance == 2)
+	{
+		if (localRoot->rightChild->balance == -1)
+		{
+			MutableNodePtr right = std::make_shared<Node>(*localRoot->rightChild);
+			rotateRight(right);
+			localRoot->rightChild = std::move(right);
+		}
+		rotateLeft(localRoot);
+	}
+	else if (localRoot->balance == -2)
+	{
+		if (localRoot->leftChild->balance == 1)
+		{
+			MutableNodePtr left = std::make_shared<Node>(*localRoot->leftChild);
+			rotateLeft(left);
+			localRoot->leftChild = std::move(left);
+		}
+		rotateRight(localRoot);
+	}
+}
+
+//Same rotations as AVL, except that the child moving up may still be shared with older versions and is copied first
+template<typename K, typename I>
+void PersistentAVL<K, I>::rotateRight(MutableNodePtr &localRoot)
+{
+	MutableNodePtr b = localRoot;
+	assert(b != nullptr && b->leftChild != nullptr);
+
+	MutableNodePtr a = std::make_shared<Node>(*b->leftChild);
+
+	b->leftChild = a->rightChild;
+	a->rightChild = b;
+	localRoot = a;
+
+	//Update Node balance
+	b->balance = b->balance + 1 + std::max<short int>(-a->balance, 0);
+	a->balance = a->balance + 1 + std::max<short int>(b->balance, 0);
+}
+
+template<typename K, typename I>
+void PersistentAVL<K, I>::rotateLeft(MutableNodePtr &localRoot)
+{
+	MutableNodePtr a = localRoot;
+	assert(a != nullptr && a->rightChild != nullptr);
+
+	MutableNodePtr b = std::make_shared<Node>(*a->rightChild);
+
+	a->rightChild = b->leftChild;
+	b->leftChild = a;
+	localRoot = b;
+
+	//Update Node balance
+	a->balance = a->balance - 1 - std::max<short int>(b->balance, 0);
+	b->balance = b->balance - 1 - std::max<short int>(-a->balance, 0);
+}
+
+template<typename K, typename I>
+const typename PersistentAVL<K, I>::Item* PersistentAVL<K, I>::Snapshot::lookup(const Key &_key) const
+{
+	const Node* current = version->root.get();
+	while (current != nullptr)
+	{
+		if (current->key == _key)
+			return &current->item;
+		else if (current->key < _key)
+			current = current->rightChild.get();
+		else
+			current = current->leftChild.get();
+	}
+
+	return nullptr;
+}
+
+template<typename K, typename I>
+size_t PersistentAVL<K, I>::Snapshot::size() const
+{
+	return version->size;
+}
+
+template<typename K, typename I>
+bool PersistentAVL<K, I>::Snapshot::empty() const
+{
+	return version->size == 0;
+}
+
+//Pops nodes off the pending stack in key order, stopping after upperBound when one is given
+template<typename K, typename I>
+template<typename Function>
+void PersistentAVL<K, I>::Snapshot::inorderFrom(FixedStack<const Node*, maxDepth> &pending, const Key* upperBound, Function function)
+{
+	while (!pending.empty())
+	{
+		const Node* current = pending.back();
+		pending.pop_back();
+		if (upperBound != nullptr && *upperBound < current->key)
+			return;
+
+		function(current->key, current->item);
+		for (const Node* next = current->rightChild.get(); next != nullptr; next = next->leftChild.get())
+			pending.push_back(next);
+	}
+}
+
+template<typename K, typename I>
+template<typename Function>
+void PersistentAVL<K, I>::Snapshot::forEach(Function function) const
+{
+	FixedStack<const Node*, maxDepth> pending;
+	for (const Node* current = version->root.get(); current != nullptr; current = current->leftChild.get())
+		pending.push_back(current);
+
+	inorderFrom(pending, nullptr, function);
+}
+
+template<typename K, typename I>
+template<typename Function>
+void PersistentAVL<K, I>::Snapshot::forEachInRange(const Key &lo, const Key &hi, Function function) const
+{
+	//Only nodes not less than lo are stacked, so the first one popped is the lower bound
+	FixedStack<const Node*, maxDepth> pending;
+	for (const Node* current = version->root.get(); current != nullptr; )
+	{
+		if (current->key < lo)
+			current = current->rightChild.get();
+		else
+		{
+			pending.push_back(current);
+			current = current->leftChild.get();
+		}
+	}
+
+	inorderFrom(pending, &hi, function);
+}
+
+#endif // !PERSISTENTAVL_H
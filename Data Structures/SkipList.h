@@ -0,0 +1,406 @@
+#ifndef SKIPLIST_H
+#define SKIPLIST_H
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <new>
+#include <utility>
+
+#include "EpochReclamation.h"
+
+namespace Containers
+{
+	//Lock-free ordered dictionary for concurrent readers and writers, a skip list in the style of Fraser and Herlihy-Shavit.
+	//Every link carries a mark bit in its low bit: a node is removed by claiming its item, marking its links top-down
+	//and letting the next traversal that meets it unlink it with a CAS. Lookups and iteration never write to shared memory
+	//and never retry. Unlinked nodes and replaced items are reclaimed through EpochDomain.
+	//Like ConcurrentDictionary, items never leave the list by pointer: lookups copy them out.
+	template<typename K, typename I>
+	class SkipList
+	{
+	public:
+		using Key = K;
+		using Item = I;
+
+		//Adds the entry, or replaces the item when the key is already present
+		void insert(Key, Item);
+		//Returns whether an entry was removed
+		bool remove(const Key &);
+		//Copies the item into result, returns whether the key was found
+		bool lookup(const Key &, Item &) const;
+		bool contains(const Key &) const;
+
+		//Calls function(key, item) for every entry in key order, the references are only valid during the call.
+		//Entries inserted or removed concurrently may or may not be visited.
+		template<typename Function>
+		void forEach(Function) const;
+
+		bool empty() const;
+		//Not a snapshot when writers are active
+		size_t size() const;
+		void printEntries() const;
+
+		SkipList();
+		~SkipList();
+		SkipList(const SkipList &) = delete;
+		SkipList &operator=(const SkipList &) = delete;
+
+		template<typename KT, typename IT>
+		friend std::ostream& operator<<(std::ostream &, const SkipList<KT, IT> &);
+
+	private:
+		struct Node;
+		using Link = std::atomic<uintptr_t>;
+
+		//Levels are promoted with probability 1/4, enough for 4^16 entries
+		static const int maxLevel = 16;
+
+		static Node* pointer(uintptr_t link) { return reinterpret_cast<Node*>(link & ~static_cast<uintptr_t>(1)); }
+		static bool marked(uintptr_t link) { return (link & 1) != 0; }
+
+		static Node* createNode(Key &&, Item*, int);
+		static void destroyNode(void*);
+		static void destroyItem(void*);
+		static int randomHeight();
+
+		bool find(const Key &, Link* [], Node* []);
+		bool tryFind(const Key &, Link* [], Node* [], bool &);
+		const Node* findNode(const Key &) const;
+		void linkUpperLevels(Node*, Link* [], Node* []);
+		static void markLevels(Node*);
+		static void releaseUnlinkToken(Node*);
+
+		Link head[maxLevel];
+		std::atomic<size_t> entryCount{ 0 };
+	};
+
+	//The links follow the node in the same allocation
+	template<typename K, typename I>
+	struct SkipList<K, I>::Node
+	{
+		const Key key;
+		std::atomic<Item*> item;	//Null once a removal has claimed the node
+		//Held by the inserter until its links are in place and by the remover until its unlinking pass is done,
+		//whoever releases the last one retires the node
+		std::atomic<int> unlinkTokens{ 2 };
+		const int height;
+		Link* const next;
+
+		Node(Key &&_key, Item* _item, int _height) : key(std::move(_key)), item(_item), height(_height),
+			next(reinterpret_cast<Link*>(this + 1)) {}
+	};
+
+	template<typename K, typename I>
+	SkipList<K, I>::SkipList()
+	{
+		for (int level = 0; level < maxLevel; level++)
+			head[level].store(0, std::memory_order_relaxed);
+	}
+
+	//Must not run concurrently with any other operation
+	template<typename K, typename I>
+	SkipList<K, I>::~SkipList()
+	{
+		Node* current = pointer(head[0].load());
+		while (current != nullptr)
+		{
+			Node* next = pointer(current->next[0].load());
+			delete current->item.load();
+			destroyNode(current);
+			current = next;
+		}
+	}
+
+	template<typename K, typename I>
+	typename SkipList<K, I>::Node* SkipList<K, I>::createNode(Key &&_key, Item* item, int height)
+	{
+		void* memory = ::operator new(sizeof(Node) + height * sizeof(Link));
+		Node* node = new (memory) Node(std::move(_key), item, height);
+		for (int level = 0; level < height; level++)
+			new (&node->next[level]) Link(0);
+		return node;
+	}
+
+	template<typename K, typename I>
+	void SkipList<K, I>::destroyNode(void* memory)
+	{
+		static_cast<Node*>(memory)->~Node();
+		::operator delete(memory);
+	}
+
+	template<typename K, typename I>
+	void SkipList<K, I>::destroyItem(void* item)
+	{
+		delete static_cast<Item*>(item);
+	}
+
+	template<typename K, typename I>
+	int SkipList<K, I>::randomHeight()
+	{
+		//xorshift64, one generator per thread
+		thread_local uint64_t state = 0x9E3779B97F4A7C15ull ^ reinterpret_cast<uintptr_t>(&state);
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+
+		int height = 1;
+		for (uint64_t bits = state; height < maxLevel && (bits & 3) == 0; bits >>= 2)
+			height++;
+		return height;
+	}
+
+	//Fills in, for every level, the link to rewrite and the first node not ordered before the key,
+	//unlinking marked nodes on the way. Returns whether the key is present.
+	template<typename K, typename I>
+	bool SkipList<K, I>::find(const Key &_key, Link* preds[], Node* succs[])
+	{
+		bool found;
+		while (!tryFind(_key, preds, succs, found));
+		return found;
+	}
+
+	//Returns false when an unlinking CAS loses a race and the search has to start over
+	template<typename K, typename I>
+	bool SkipList<K, I>::tryFind(const Key &_key, Link* preds[], Node* succs[], bool &found)
+	{
+		Link* predLinks = head;
+		Node* current = nullptr;
+
+		for (int level = maxLevel - 1; level >= 0; level--)
+		{
+			current = pointer(predLinks[level].load());
+			while (current != nullptr)
+			{
+				uintptr_t successor = current->next[level].load();
+				if (marked(successor))
+				{
+					uintptr_t expected = reinterpret_cast<uintptr_t>(current);
+					if (!predLinks[level].compare_exchange_strong(expected, successor & ~static_cast<uintptr_t>(1)))
+						return false;
+					current = pointer(successor);
+				}
+				else if (current->key < _key)
+				{
+					predLinks = current->next;
+					current = pointer(successor);
+				}
+				else
+					break;
+			}
+			preds[level] = &predLinks[level];
+			succs[level] = current;
+		}
+
+		found = current != nullptr && current->key == _key;
+		return true;
+	}
+
+	//Read only search, marked nodes are walked through rather than unlinked
+	template<typename K, typename I>
+	const typename SkipList<K, I>::Node* SkipList<K, I>::findNode(const Key &_key) const
+	{
+		const Link* predLinks = head;
+		const Node* current = nullptr;
+
+		for (int level = maxLevel - 1; level >= 0; level--)
+		{
+			current = pointer(predLinks[level].load(std::memory_order_acquire));
+			while (current != nullptr && current->key < _key)
+			{
+				predLinks = current->next;
+				current = pointer(current->next[level].load(std::memory_order_acquire));
+			}
+		}
+
+		return (current != nullptr && current->key == _key) ? current : nullptr;
+	}
+
+	template<typename K, typename I>
+	void SkipList<K, I>::insert(Key _key, Item _item)
+	{
+		EpochDomain::Guard guard;
+		Link* preds[maxLevel];
+		Node* succs[maxLevel];
+
+		Item* item = new Item(std::move(_item));
+		Node* node = createNode(std::move(_key), item, randomHeight());
+
+		while (true)
+		{
+			if (find(node->key, preds, succs))
+			{
+				Node* existing = succs[0];
+				Item* previous = existing->item.load();
+				while (previous != nullptr && !existing->item.compare_exchange_weak(previous, item));
+
+				if (previous != nullptr)
+				{
+					//The new node was never published
+					destroyNode(node);
+					EpochDomain::instance().retire(previous, destroyItem);
+					return;
+				}
+
+				//A removal has claimed the node, help it along so the next search unlinks it
+				markLevels(existing);
+				continue;
+			}
+
+			for (int level = 0; level < node->height; level++)
+				node->next[level].store(reinterpret_cast<uintptr_t>(succs[level]), std::memory_order_relaxed);
+
+			//Linking the bottom level is the linearization point
+			uintptr_t expected = reinterpret_cast<uintptr_t>(succs[0]);
+			if (preds[0]->compare_exchange_strong(expected, reinterpret_cast<uintptr_t>(node)))
+				break;
+		}
+
+		entryCount.fetch_add(1, std::memory_order_relaxed);
+		linkUpperLevels(node, preds, succs);
+	}
+
+	template<typename K, typename I>
+	void SkipList<K, I>::linkUpperLevels(Node* node, Link* preds[], Node* succs[])
+	{
+		for (int level = 1; level < node->height; level++)
+		{
+			bool linked = false;
+			while (!linked)
+			{
+				//Only a removal writes to the links of a published node, so stop once it has started
+				uintptr_t current = node->next[level].load();
+				if (marked(current))
+					break;
+
+				//Never link in front of a dying node with the same key, its remover would stop at ours and miss it
+				Node* successor = succs[level];
+				if (successor != nullptr && !(node->key < successor->key))
+				{
+					find(node->key, preds, succs);
+					continue;
+				}
+
+				if (!node->next[level].compare_exchange_strong(current, reinterpret_cast<uintptr_t>(successor)))
+					break;
+
+				uintptr_t expected = reinterpret_cast<uintptr_t>(successor);
+				linked = preds[level]->compare_exchange_strong(expected, reinterpret_cast<uintptr_t>(node));
+				if (!linked)
+					find(node->key, preds, succs);
+			}
+
+			if (!linked)
+				break;
+		}
+
+		//A removal that ran while the levels were being linked may have missed some of them
+		if (node->item.load() == nullptr)
+			find(node->key, preds, succs);
+		releaseUnlinkToken(node);
+	}
+
+	template<typename K, typename I>
+	void SkipList<K, I>::markLevels(Node* node)
+	{
+		for (int level = node->height - 1; level >= 0; level--)
+			node->next[level].fetch_or(1);
+	}
+
+	template<typename K, typename I>
+	void SkipList<K, I>::releaseUnlinkToken(Node* node)
+	{
+		if (node->unlinkTokens.fetch_sub(1) == 1)
+			EpochDomain::instance().retire(node, destroyNode);
+	}
+
+	template<typename K, typename I>
+	bool SkipList<K, I>::remove(const Key &_key)
+	{
+		EpochDomain::Guard guard;
+		Link* preds[maxLevel];
+		Node* succs[maxLevel];
+
+		if (!find(_key, preds, succs))
+			return false;
+
+		//Claiming the item is the linearization point, exactly one remover wins it
+		Node* node = succs[0];
+		Item* item = node->item.exchange(nullptr);
+		if (item == nullptr)
+			return false;
+
+		entryCount.fetch_sub(1, std::memory_order_relaxed);
+		EpochDomain::instance().retire(item, destroyItem);
+
+		markLevels(node);
+		find(_key, preds, succs);
+		releaseUnlinkToken(node);
+		return true;
+	}
+
+	template<typename K, typename I>
+	bool SkipList<K, I>::lookup(const Key &_key, Item &result) const
+	{
+		EpochDomain::Guard guard;
+		const Node* node = findNode(_key);
+		if (node == nullptr)
+			return false;
+
+		const Item* item = node->item.load(std::memory_order_acquire);
+		if (item == nullptr)
+			return false;
+
+		result = *item;
+		return true;
+	}
+
+	template<typename K, typename I>
+	bool SkipList<K, I>::contains(const Key &_key) const
+	{
+		EpochDomain::Guard guard;
+		const Node* node = findNode(_key);
+		return node != nullptr && node->item.load(std::memory_order_acquire) != nullptr;
+	}
+
+	template<typename K, typename I>
+	template<typename Function>
+	void SkipList<K, I>::forEach(Function function) const
+	{
+		EpochDomain::Guard guard;
+		for (const Node* current = pointer(head[0].load(std::memory_order_acquire)); current != nullptr;
+			current = pointer(current->next[0].load(std::memory_order_acquire)))
+		{
+			const Item* item = current->item.load(std::memory_order_acquire);
+			if (item != nullptr)
+				function(current->key, *item);
+		}
+	}
+
+	template<typename K, typename I>
+	bool SkipList<K, I>::empty() const
+	{
+		return size() == 0;
+	}
+
+	template<typename K, typename I>
+	size_t SkipList<K, I>::size() const
+	{
+		return entryCount.load(std::memory_order_relaxed);
+	}
+
+	template<typename K, typename I>
+	void SkipList<K, I>::printEntries() const
+	{
+		std::cout << *this;
+	}
+
+	//operator<< overloading to transfer the entries into the stream, in key order
+	template<typename K, typename I>
+	std::ostream& operator<< (std::ostream &os, const SkipList<K, I> &list)
+	{
+		list.forEach([&os](const K &key, const I &item) { os << key << " " << item << std::endl; });
+		return os;
+	}
+};
+#endif // !SKIPLIST_H
@@ -0,0 +1,237 @@
+#ifndef STATICSEARCHTREE_H
+#define STATICSEARCHTREE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <utility>
+#include <assert.h>
+
+#include "TreeBatch.h"
+#include "KeyTraits.h"
+
+//Immutable ordered dictionary for data that is built once and queried many times, produced by AVL::freeze and BST::freeze.
+//The keys sit in one contiguous array in Eytzinger order, the breadth first numbering of a complete binary tree:
+//the children of position k are 2k and 2k + 1, so there are no pointers, and the top levels of every search share
+//the first cache lines. The search is branch free, each step computes the next position from a comparison,
+//and the descendants a few levels down, which lie next to each other, are prefetched while the current level is compared.
+//Items are kept in a second array at the same positions and are only touched by a hit.
+template<typename K, typename I, typename C = std::less<K>>
+class StaticSearchTree
+{
+public:
+	using Key = K;
+	using Item = I;
+	using Compare = C;
+
+	//Builds from count entries that forEachEntry(function) passes to function(key, item) in strictly increasing key order
+	template<typename ForEachEntry>
+	StaticSearchTree(size_t, ForEachEntry, const Compare & = Compare());
+	StaticSearchTree() = default;
+	StaticSearchTree(StaticSearchTree &&);
+	StaticSearchTree &operator=(StaticSearchTree &&);
+	StaticSearchTree(const StaticSearchTree &) = delete;
+	StaticSearchTree &operator=(const StaticSearchTree &) = delete;
+	~StaticSearchTree();
+
+	const Item* lookup(const Key &) const;
+	//Heterogeneous overload for types comparable with Key, e.g. std::string_view for std::string keys
+	template<typename KeyLike, typename = EnableIfOrderedKey<K, KeyLike, Compare>>
+	const Item* lookup(const KeyLike &) const;
+
+	//Calls function(key, item) for every entry in key order
+	template<typename Function>
+	void forEach(Function) const;
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	void printEntries() const;
+
+	template<typename KT, typename IT, typename CT>
+	friend std::ostream & operator<<(std::ostream &, const StaticSearchTree<KT, IT, CT> &);
+
+private:
+	//Position 0 is unused, so with the array aligned to a cache line the four grandchildren 4k..4k+3 of any position
+	//share a line as long as they fit in one
+	static const size_t cacheLine = 64;
+	//Positions k * prefetchStride onwards are the first descendants that fill a cache line, 2 or more levels below k
+	static const size_t prefetchStride = (cacheLine / sizeof(Key) > 4) ? cacheLine / sizeof(Key) : 4;
+
+	template<typename KeyLike>
+	const Item* find(const KeyLike &) const;
+	//In-order walk over the implicit positions, first is the leftmost one and next returns 0 past the last
+	size_t firstPosition() const;
+	size_t nextPosition(size_t) const;
+	void release();
+
+	Key* keyData = nullptr;
+	Item* itemData = nullptr;
+	size_t count = 0;
+	Compare keyLess;
+};
+
+template<typename K, typename I, typename C>
+template<typename ForEachEntry>
+StaticSearchTree<K, I, C>::StaticSearchTree(size_t _count, ForEachEntry forEachEntry, const Compare &_keyLess) :
+	keyLess(_keyLess)
+{
+	if (_count == 0)
+		return;
+
+	keyData = static_cast<Key*>(::operator new((_count + 1) * sizeof(Key), std::align_val_t(cacheLine)));
+	itemData = static_cast<Item*>(::operator new((_count + 1) * sizeof(Item)));
+
+	//The in-order walk over the positions visits them in key order, so the sorted entries can be placed as they come
+	size_t position = 0;
+	size_t placed = 0;
+	count = _count;
+	forEachEntry([this, &position, &placed](const Key &_key, const Item &_item)
+	{
+		position = (placed == 0) ? firstPosition() : nextPosition(position);
+		assert(position != 0);
+		new (&keyData[position]) Key(_key);
+		new (&itemData[position]) Item(_item);
+		placed++;
+	});
+	assert(placed == count);
+}
+
+template<typename K, typename I, typename C>
+StaticSearchTree<K, I, C>::StaticSearchTree(StaticSearchTree &&original) :
+	keyData(original.keyData), itemData(original.itemData), count(original.count), keyLess(std::move(original.keyLess))
+{
+	original.keyData = nullptr;
+	original.itemData = nullptr;
+	original.count = 0;
+}
+
+template<typename K, typename I, typename C>
+StaticSearchTree<K, I, C> &StaticSearchTree<K, I, C>::operator=(StaticSearchTree &&original)
+{
+	if (this != &original)
+	{
+		release();
+		std::swap(keyData, original.keyData);
+		std::swap(itemData, original.itemData);
+		std::swap(count, original.count);
+		std::swap(keyLess, original.keyLess);
+	}
+	return *this;
+}
+
+template<typename K, typename I, typename C>
+StaticSearchTree<K, I, C>::~StaticSearchTree()
+{
+	release();
+}
+
+template<typename K, typename I, typename C>
+void StaticSearchTree<K, I, C>::release()
+{
+	if (keyData == nullptr)
+		return;
+
+	for (size_t position = 1; position <= count; position++)
+	{
+		keyData[position].~Key();
+		itemData[position].~Item();
+	}
+	::operator delete(keyData, std::align_val_t(cacheLine));
+	::operator delete(itemData);
+	keyData = nullptr;
+	itemData = nullptr;
+	count = 0;
+}
+
+template<typename K, typename I, typename C>
+size_t StaticSearchTree<K, I, C>::firstPosition() const
+{
+	size_t position = 1;
+	while (2 * position <= count)
+		position *= 2;
+	return position;
+}
+
+template<typename K, typename I, typename C>
+size_t StaticSearchTree<K, I, C>::nextPosition(size_t position) const
+{
+	//Leftmost position of the right subtree, or else the first ancestor reached from a left child
+	if (2 * position + 1 <= count)
+	{
+		position = 2 * position + 1;
+		while (2 * position <= count)
+			position *= 2;
+		return position;
+	}
+
+	while (position & 1)
+		position >>= 1;
+	return position >> 1;
+}
+
+template<typename K, typename I, typename C>
+template<typename KeyLike>
+const typename StaticSearchTree<K, I, C>::Item* StaticSearchTree<K, I, C>::find(const KeyLike &_key) const
+{
+	//The descent always runs to below the leaves, going right past every key less than the searched one.
+	//The position it ends at encodes the path, the lower bound is where it last went left
+	uintptr_t base = reinterpret_cast<uintptr_t>(keyData);
+	size_t position = 1;
+	while (position <= count)
+	{
+		TREE_PREFETCH(reinterpret_cast<const void*>(base + position * prefetchStride * sizeof(Key)));
+		position = 2 * position + ThreeWayCompare<Compare>::before(keyLess, keyData[position], _key);
+	}
+
+	//Drop the trailing right turns and the last left turn
+#if defined(__GNUC__) || defined(__clang__)
+	position >>= __builtin_ctzll(~static_cast<unsigned long long>(position)) + 1;
+#else
+	while (position & 1)
+		position >>= 1;
+	position >>= 1;
+#endif
+
+	return (position != 0 && !ThreeWayCompare<Compare>::before(keyLess, _key, keyData[position])) ? &itemData[position] : nullptr;
+}
+
+template<typename K, typename I, typename C>
+const typename StaticSearchTree<K, I, C>::Item* StaticSearchTree<K, I, C>::lookup(const Key &_key) const
+{
+	return find(_key);
+}
+
+template<typename K, typename I, typename C>
+template<typename KeyLike, typename>
+const typename StaticSearchTree<K, I, C>::Item* StaticSearchTree<K, I, C>::lookup(const KeyLike &_key) const
+{
+	return find(_key);
+}
+
+template<typename K, typename I, typename C>
+template<typename Function>
+void StaticSearchTree<K, I, C>::forEach(Function function) const
+{
+	if (count == 0)
+		return;
+
+	for (size_t position = firstPosition(); position != 0; position = nextPosition(position))
+		function(keyData[position], itemData[position]);
+}
+
+template<typename K, typename I, typename C>
+void StaticSearchTree<K, I, C>::printEntries() const
+{
+	std::cout << *this;
+}
+
+template<typename K, typename I, typename C>
+std::ostream & operator<<(std::ostream &os, const StaticSearchTree<K, I, C> &tree)
+{
+	tree.forEach([&os](const K &key, const I &item) { os << key << " " << item << std::endl; });
+	return os;
+}
+
+#endif // !STATICSEARCHTREE_H
@@ -0,0 +1,72 @@
+#ifndef TREEBATCH_H
+#define TREEBATCH_H
+
+#include <cstddef>
+
+#include "KeyTraits.h"
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TREE_PREFETCH(address) __builtin_prefetch(address)
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#define TREE_PREFETCH(address) _mm_prefetch(reinterpret_cast<const char*>(address), _MM_HINT_T0)
+#else
+#define TREE_PREFETCH(address) ((void)0)
+#endif
+
+//Number of descents kept in flight by lookupInterleaved, enough to cover a memory miss with the work on the others
+static const size_t treeBatchWidth = 16;
+
+//Looks up count keys in a binary tree ordered by less whose nodes have key, item, leftChild and rightChild, storing a pointer
+//to each item, or null, in results. A single descent stalls on every node that is not cached; here up to
+//treeBatchWidth descents advance in turns, one level each, with the next node of every descent prefetched,
+//so their misses overlap. A slot whose descent ends is refilled with the next key, which keeps the batch full
+//even when the depths differ, as they do in an unbalanced tree.
+template<typename Node, typename Key, typename Item, typename Compare>
+void lookupInterleaved(Node* root, const Key* keys, size_t count, Item** results, const Compare &less)
+{
+	struct Descent
+	{
+		Node* current;
+		size_t index;
+	};
+
+	Descent descents[treeBatchWidth];
+	size_t active = 0;
+	size_t next = 0;
+
+	if (root != nullptr)
+		TREE_PREFETCH(root);
+	for (; active < treeBatchWidth && next < count; next++)
+		descents[active++] = { root, next };
+
+	while (active > 0)
+	{
+		for (size_t slot = 0; slot < active; )
+		{
+			Descent &descent = descents[slot];
+			Node* current = descent.current;
+			int order = (current != nullptr) ? ThreeWayCompare<Compare>::compare(less, current->key, keys[descent.index]) : 0;
+
+			if (order != 0)
+			{
+				descent.current = (order < 0) ? current->rightChild : current->leftChild;
+				if (descent.current != nullptr)
+					TREE_PREFETCH(descent.current);
+				slot++;
+				continue;
+			}
+
+			results[descent.index] = (current != nullptr) ? &current->item : nullptr;
+
+			//The replacement is visited in this same pass: a new key restarts at the root, which is always cached,
+			//otherwise the last descent moves into the slot
+			if (next < count)
+				descent = { root, next++ };
+			else
+				descent = descents[--active];
+		}
+	}
+}
+
+#endif // !TREEBATCH_H
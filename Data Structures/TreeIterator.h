@@ -0,0 +1,354 @@
+#ifndef TREEITERATOR_H
+#define TREEITERATOR_H
+
+#include <cstddef>
+#include <iterator>
+#include <assert.h>
+
+//Stack with inline storage for trees whose height has a known bound
+template<typename T, size_t Capacity>
+class FixedStack
+{
+public:
+	FixedStack() = default;
+
+	//Only the used part of the storage is copied
+	FixedStack(const FixedStack &original) : count(original.count)
+	{
+		for (size_t i = 0; i < count; i++)
+			elements[i] = original.elements[i];
+	}
+
+	FixedStack &operator=(const FixedStack &original)
+	{
+		count = original.count;
+		for (size_t i = 0; i < count; i++)
+			elements[i] = original.elements[i];
+		return *this;
+	}
+
+	void push_back(const T &element)
+	{
+		assert(count < Capacity);
+		elements[count++] = element;
+	}
+
+	void pop_back()
+	{
+		count--;
+	}
+
+	void resize(size_t newSize)
+	{
+		assert(newSize <= count);
+		count = newSize;
+	}
+
+	const T &back() const { return elements[count - 1]; }
+	bool empty() const { return count == 0; }
+	size_t size() const { return count; }
+
+private:
+	T elements[Capacity];
+	size_t count = 0;
+};
+
+//Bidirectional in-order iterator over a binary tree whose nodes have leftChild and rightChild links.
+//Nodes carry no parent pointers, so the iterator keeps the path from the root to the current node;
+//the past-the-end iterator has an empty path and still knows the root so it can be decremented.
+//Path is a stack of node pointers, FixedStack for balanced trees or std::vector for unbalanced ones.
+template<typename Node, template<typename> class Path>
+class TreeIterator
+{
+public:
+	using iterator_category = std::bidirectional_iterator_tag;
+	using value_type = Node;
+	using difference_type = std::ptrdiff_t;
+	using pointer = Node*;
+	using reference = Node&;
+
+	TreeIterator() = default;
+
+	reference operator*() const { return *path.back(); }
+	pointer operator->() const { return path.back(); }
+
+	TreeIterator &operator++();
+	TreeIterator &operator--();
+	TreeIterator operator++(int);
+	TreeIterator operator--(int);
+
+	bool operator==(const TreeIterator &other) const;
+	bool operator!=(const TreeIterator &other) const { return !(*this == other); }
+
+	//Factories used by the containers
+	static TreeIterator first(Node*);
+	static TreeIterator end(Node*);
+	//First node not ordered before the key, or with upper set, first node ordered after it
+	template<typename Key, typename Less>
+	static TreeIterator bound(Node*, const Key&, Less, bool upper);
+	//Node at the given in-order position, or end, for trees whose nodes count their subtree in subtreeSize
+	static TreeIterator select(Node*, size_t);
+
+private:
+	explicit TreeIterator(Node* _root) : root(_root) {}
+
+	void descendLeft(Node*);
+	void descendRight(Node*);
+
+	Node* root = nullptr;
+	Path<Node*> path;
+};
+
+template<typename N, template<typename> class P>
+void TreeIterator<N, P>::descendLeft(N* current)
+{
+	for (; current != nullptr; current = current->leftChild)
+		path.push_back(current);
+}
+
+template<typename N, template<typename> class P>
+void TreeIterator<N, P>::descendRight(N* current)
+{
+	for (; current != nullptr; current = current->rightChild)
+		path.push_back(current);
+}
+
+template<typename N, template<typename> class P>
+TreeIterator<N, P> TreeIterator<N, P>::first(N* _root)
+{
+	TreeIterator iterator(_root);
+	iterator.descendLeft(_root);
+	return iterator;
+}
+
+template<typename N, template<typename> class P>
+TreeIterator<N, P> TreeIterator<N, P>::end(N* _root)
+{
+	return TreeIterator(_root);
+}
+
+template<typename N, template<typename> class P>
+template<typename Key, typename Less>
+TreeIterator<N, P> TreeIterator<N, P>::bound(N* _root, const Key &_key, Less less, bool upper)
+{
+	TreeIterator iterator(_root);
+	size_t candidateDepth = 0;
+
+	//Every left turn passes a candidate, the answer is the deepest one
+	for (N* current = _root; current != nullptr; )
+	{
+		iterator.path.push_back(current);
+		bool goLeft = upper ? less(_key, current->key) : !less(current->key, _key);
+		if (goLeft)
+		{
+			candidateDepth = iterator.path.size();
+			current = current->leftChild;
+		}
+		else
+			current = current->rightChild;
+	}
+
+	iterator.path.resize(candidateDepth);
+	return iterator;
+}
+
+template<typename N, template<typename> class P>
+TreeIterator<N, P> TreeIterator<N, P>::select(N* _root, size_t index)
+{
+	TreeIterator iterator(_root);
+	for (N* current = _root; current != nullptr; )
+	{
+		iterator.path.push_back(current);
+		size_t leftSize = (current->leftChild == nullptr) ? 0 : current->leftChild->subtreeSize;
+		if (index == leftSize)
+			return iterator;
+
+		if (index < leftSize)
+			current = current->leftChild;
+		else
+		{
+			index -= leftSize + 1;
+			current = current->rightChild;
+		}
+	}
+
+	iterator.path.resize(0);
+	return iterator;
+}
+
+template<typename N, template<typename> class P>
+TreeIterator<N, P> & TreeIterator<N, P>::operator++()
+{
+	N* current = path.back();
+	if (current->rightChild != nullptr)
+	{
+		descendLeft(current->rightChild);
+		return *this;
+	}
+
+	//Climb until we leave a left subtree
+	path.pop_back();
+	while (!path.empty() && path.back()->rightChild == current)
+	{
+		current = path.back();
+		path.pop_back();
+	}
+	return *this;
+}
+
+template<typename N, template<typename> class P>
+TreeIterator<N, P> & TreeIterator<N, P>::operator--()
+{
+	if (path.empty())
+	{
+		descendRight(root);
+		return *this;
+	}
+
+	N* current = path.back();
+	if (current->leftChild != nullptr)
+	{
+		descendRight(current->leftChild);
+		return *this;
+	}
+
+	//Climb until we leave a right subtree
+	path.pop_back();
+	while (!path.empty() && path.back()->leftChild == current)
+	{
+		current = path.back();
+		path.pop_back();
+	}
+	return *this;
+}
+
+template<typename N, template<typename> class P>
+TreeIterator<N, P> TreeIterator<N, P>::operator++(int)
+{
+	TreeIterator previous = *this;
+	++*this;
+	return previous;
+}
+
+template<typename N, template<typename> class P>
+TreeIterator<N, P> TreeIterator<N, P>::operator--(int)
+{
+	TreeIterator previous = *this;
+	--*this;
+	return previous;
+}
+
+template<typename N, template<typename> class P>
+bool TreeIterator<N, P>::operator==(const TreeIterator &other) const
+{
+	if (path.empty() || other.path.empty())
+		return path.empty() && other.path.empty();
+	return path.back() == other.path.back();
+}
+
+//Const iterator of a tree that may be serving a loaded snapshot instead, see FlatSnapshot.h. Over nodes it walks the tree
+//as TreeIterator does, over a snapshot it is an index into the sorted key and item arrays, so const members never build
+//the tree and concurrent readers stay read only. Entries are returned by value, as a pair of references named key and item
+template<typename Node, template<typename> class Path, typename Key, typename Item>
+class EntryIterator
+{
+public:
+	struct Entry
+	{
+		const Key &key;
+		const Item &item;
+	};
+
+	//Lets iterator->key work with entries returned by value
+	struct EntryPointer
+	{
+		Entry entry;
+		const Entry* operator->() const { return &entry; }
+	};
+
+	using iterator_category = std::bidirectional_iterator_tag;
+	using value_type = Entry;
+	using difference_type = std::ptrdiff_t;
+	using pointer = EntryPointer;
+	//Const so that auto & binds to entries, as it does to nodes
+	using reference = const Entry;
+	using NodeIterator = TreeIterator<const Node, Path>;
+
+	EntryIterator() = default;
+	//Over the nodes of a tree
+	EntryIterator(const NodeIterator &_position) : position(_position) {}
+	//Over sorted arrays, at the given index, their length for end
+	EntryIterator(const Key* _keys, const Item* _items, size_t _index) : keys(_keys), items(_items), index(_index) {}
+
+	reference operator*() const;
+	pointer operator->() const { return EntryPointer{ **this }; }
+
+	EntryIterator &operator++();
+	EntryIterator &operator--();
+	EntryIterator operator++(int);
+	EntryIterator operator--(int);
+
+	bool operator==(const EntryIterator &other) const;
+	bool operator!=(const EntryIterator &other) const { return !(*this == other); }
+
+private:
+	NodeIterator position;
+	//Null while iterating nodes
+	const Key* keys = nullptr;
+	const Item* items = nullptr;
+	size_t index = 0;
+};
+
+template<typename N, template<typename> class P, typename K, typename I>
+typename EntryIterator<N, P, K, I>::reference EntryIterator<N, P, K, I>::operator*() const
+{
+	if (keys != nullptr)
+		return Entry{ keys[index], items[index] };
+	return Entry{ position->key, position->item };
+}
+
+template<typename N, template<typename> class P, typename K, typename I>
+EntryIterator<N, P, K, I> & EntryIterator<N, P, K, I>::operator++()
+{
+	if (keys != nullptr)
+		index++;
+	else
+		++position;
+	return *this;
+}
+
+template<typename N, template<typename> class P, typename K, typename I>
+EntryIterator<N, P, K, I> & EntryIterator<N, P, K, I>::operator--()
+{
+	if (keys != nullptr)
+		index--;
+	else
+		--position;
+	return *this;
+}
+
+template<typename N, template<typename> class P, typename K, typename I>
+EntryIterator<N, P, K, I> EntryIterator<N, P, K, I>::operator++(int)
+{
+	EntryIterator previous = *this;
+	++*this;
+	return previous;
+}
+
+template<typename N, template<typename> class P, typename K, typename I>
+EntryIterator<N, P, K, I> EntryIterator<N, P, K, I>::operator--(int)
+{
+	EntryIterator previous = *this;
+	--*this;
+	return previous;
+}
+
+template<typename N, template<typename> class P, typename K, typename I>
+bool EntryIterator<N, P, K, I>::operator==(const EntryIterator &other) const
+{
+	if (keys != nullptr || other.keys != nullptr)
+		return keys == other.keys && index == other.index;
+	return position == other.position;
+}
+
+#endif // !TREEITERATOR_H
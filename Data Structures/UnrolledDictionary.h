@@ -0,0 +1,604 @@
+#ifndef UNROLLEDDICTIONARY_H
+#define UNROLLEDDICTIONARY_H
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "NodePool.h"
+#include "KeyTraits.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define UNROLLEDDICTIONARY_SSE2
+#endif
+
+namespace Containers
+{
+	//Node capacity giving about 128 bytes of keys, two cache lines, clamped to 4..32 entries
+	template<typename K>
+	struct UnrolledDefaultCapacity
+	{
+		static const size_t fit = 128 / sizeof(K);
+		static const size_t value = fit < 4 ? 4 : (fit > 32 ? 32 : fit);
+	};
+
+	//Dictionary utilizing an unrolled linked list: every node holds up to Capacity entries,
+	//keys in one array and items in a parallel one, so a scan touches a few cache lines per node instead of one per entry.
+	//Entries keep their insertion order like in Dictionary. Integer keys are compared a whole node at a time with SSE2.
+	//Item pointers returned by lookup() are invalidated by removals, which shift the following entries of the node.
+	template<typename K, typename I, size_t Capacity = UnrolledDefaultCapacity<K>::value, template<typename> class Allocator = NodePool>
+	class UnrolledDictionary
+	{
+	public:
+		using Key = K;
+		using Item = I;
+
+		void insert(Key, Item);
+		Item* lookup(const Key &) const;
+		void remove(const Key &);
+
+		//Heterogeneous overloads for types comparable with Key, e.g. std::string_view for std::string keys
+		template<typename KeyLike, typename = EnableIfEqualityComparableKey<K, KeyLike>>
+		Item* lookup(const KeyLike &) const;
+		template<typename KeyLike, typename = EnableIfEqualityComparableKey<K, KeyLike>>
+		void remove(const KeyLike &);
+
+		//Constructs the item from args only if the key is absent, returns the item and whether it was inserted
+		template<typename... Args>
+		std::pair<Item*, bool> try_emplace(const Key &, Args&&...);
+		template<typename... Args>
+		std::pair<Item*, bool> try_emplace(Key &&, Args&&...);
+		//Like try_emplace, the key is passed on its own and only the item is built from args
+		template<typename... Args>
+		std::pair<Item*, bool> emplace(const Key &, Args&&...);
+		template<typename... Args>
+		std::pair<Item*, bool> emplace(Key &&, Args&&...);
+
+		//Inserts, or assigns to the existing item
+		template<typename ItemArg>
+		std::pair<Item*, bool> insert_or_assign(const Key &, ItemArg &&);
+		template<typename ItemArg>
+		std::pair<Item*, bool> insert_or_assign(Key &&, ItemArg &&);
+		void printEntries() const;
+		void clear();
+		bool empty() const;
+		size_t size() const;
+		void swap(UnrolledDictionary&);
+		//Stable O(n log n) sorts, comparison(a, b) returns true when a belongs before b
+		template<typename Compare = std::less<Key>>
+		void sort(Compare comparison = Compare());
+		template<typename Compare = std::less<Item>>
+		void sortByItem(Compare comparison = Compare());
+
+		UnrolledDictionary() = default;
+		UnrolledDictionary(UnrolledDictionary &&);
+		UnrolledDictionary(const UnrolledDictionary &);
+		~UnrolledDictionary();
+
+		UnrolledDictionary &operator=(const UnrolledDictionary &);
+		UnrolledDictionary &operator=(UnrolledDictionary &&);
+
+		template<typename KT, typename IT, size_t CT, template<typename> class AT>
+		friend std::ostream& operator<<(std::ostream &, const UnrolledDictionary<KT, IT, CT, AT> &);
+
+		//Static comparison functions for sortByItem
+		static bool ascending(const Item &, const Item &);
+		static bool descending(const Item &, const Item &);
+
+	private:
+		static_assert(Capacity >= 2, "UnrolledDictionary nodes need room for at least two entries");
+
+		struct Node;
+		using NodeAllocator = Allocator<Node>;
+
+		//Integer keys of 4 or 8 bytes are scanned 16 bytes at a time
+#ifdef UNROLLEDDICTIONARY_SSE2
+		static const bool vectorScan = std::is_integral<K>::value && (sizeof(K) == 4 || sizeof(K) == 8) &&
+			(Capacity * sizeof(K)) % 16 == 0;
+#else
+		static const bool vectorScan = false;
+#endif
+
+		Node* root = nullptr;
+		size_t listSize = 0;
+		NodeAllocator nodes;
+
+		template<typename KeyLike>
+		static size_t scanNode(const Node*, const KeyLike &);
+		static size_t scanNodeVector(const Node*, const Key &);
+		template<typename KeyLike>
+		Node* findEntry(const KeyLike &, size_t &, Node** = nullptr) const;
+		template<typename KeyArg, typename... Args>
+		std::pair<Item*, bool> insertEntry(KeyArg &&, Args&&...);
+		template<typename KeyLike>
+		bool removeEntry(const KeyLike &);
+		void unlinkNode(Node*, Node*);
+		void destroyNode(Node*);
+		void deepDelete(Node*);
+		Node* deepCopy(const Node*);
+		template<typename EntryOrder>
+		void stableSort(EntryOrder);
+		static void printEntriesRec(std::ostream&, const Node*);
+	};
+
+	//Keys and items live in raw storage, only the first count slots of each array are constructed.
+	//Unused key bytes are zeroed so that the vector scan never reads indeterminate values.
+	template<typename K, typename I, size_t C, template<typename> class A>
+	struct UnrolledDictionary<K, I, C, A>::Node
+	{
+		size_t count = 0;
+		Node* nextNode = nullptr;
+
+		alignas(alignof(Key) > 16 ? alignof(Key) : 16) unsigned char keyStorage[C * sizeof(Key)] = {};
+		alignas(Item) unsigned char itemStorage[C * sizeof(Item)];
+
+		Key* keys() { return std::launder(reinterpret_cast<Key*>(keyStorage)); }
+		const Key* keys() const { return std::launder(reinterpret_cast<const Key*>(keyStorage)); }
+		Item* items() { return std::launder(reinterpret_cast<Item*>(itemStorage)); }
+		const Item* items() const { return std::launder(reinterpret_cast<const Item*>(itemStorage)); }
+	};
+
+	//Move constructor
+	template<typename K, typename I, size_t C, template<typename> class A>
+	UnrolledDictionary<K, I, C, A>::UnrolledDictionary(UnrolledDictionary &&original)
+	{
+		swap(original);
+	}
+
+	//Copy constructor
+	template<typename K, typename I, size_t C, template<typename> class A>
+	UnrolledDictionary<K, I, C, A>::UnrolledDictionary(const UnrolledDictionary &original)
+	{
+		this->root = deepCopy(original.root);
+		this->listSize = original.listSize;
+	}
+
+	//Destructor
+	template<typename K, typename I, size_t C, template<typename> class A>
+	UnrolledDictionary<K, I, C, A>::~UnrolledDictionary()
+	{
+		deepDelete(root);
+		nodes.release();
+	}
+
+	//Copy assignment operator
+	template<typename K, typename I, size_t C, template<typename> class A>
+	UnrolledDictionary<K, I, C, A> & UnrolledDictionary<K, I, C, A>::operator=(const UnrolledDictionary &original)
+	{
+		if (this == &original)
+			return *this;
+
+		clear();
+		this->root = deepCopy(original.root);
+		this->listSize = original.listSize;
+		return *this;
+	}
+
+	//Move assignment operator
+	template<typename K, typename I, size_t C, template<typename> class A>
+	UnrolledDictionary<K, I, C, A> & UnrolledDictionary<K, I, C, A>::operator=(UnrolledDictionary &&original)
+	{
+		if (this == &original)
+			return *this;
+
+		clear();
+		swap(original);
+		return *this;
+	}
+
+	//Comparison functions
+	template<typename K, typename I, size_t C, template<typename> class A>
+	bool UnrolledDictionary<K, I, C, A>::ascending(const Item &a, const Item &b)
+	{
+		return a < b;
+	}
+
+	template<typename K, typename I, size_t C, template<typename> class A>
+	bool UnrolledDictionary<K, I, C, A>::descending(const Item &a, const Item &b)
+	{
+		return a > b;
+	}
+
+	//Insert wrapper function
+	template<typename K, typename I, size_t C, template<typename> class A>
+	void UnrolledDictionary<K, I, C, A>::insert(Key _key, Item _item)
+	{
+		insert_or_assign(std::move(_key), std::move(_item));
+	}
+
+	//Emplace wrapper functions
+	template<typename K, typename I, size_t C, template<typename> class A>
+	template<typename... Args>
+	std::pair<typename UnrolledDictionary<K, I, C, A>::Item*, bool> UnrolledDictionary<K, I, C, A>::try_emplace(const Key &_key, Args&&... args)
+	{
+		return insertEntry(_key, std::forward<Args>(args)...);
+	}
+
+	template<typename K, typename I, size_t C, template<typename> class A>
+	template<typename... Args>
+	std::pair<typename UnrolledDictionary<K, I, C, A>::Item*, bool> UnrolledDictionary<K, I, C, A>::try_emplace(Key &&_key, Args&&... args)
+	{
+		return insertEntry(std::move(_key), std::forward<Args>(args)...);
+	}
+
+	template<typename K, typename I, size_t C, template<typename> class A>
+	template<typename... Args>
+	std::pair<typename UnrolledDictionary<K, I, C, A>::Item*, bool> UnrolledDictionary<K, I, C, A>::emplace(const Key &_key, Args&&... args)
+	{
+		return try_emplace(_key, std::forward<Args>(args)...);
+	}
+
+	template<typename K, typename I, size_t C, template<typename> class A>
+	template<typename... Args>
+	std::pair<typename UnrolledDictionary<K, I, C, A>::Item*, bool> UnrolledDictionary<K, I, C, A>::emplace(Key &&_key, Args&&... args)
+	{
+		return try_emplace(std::move(_key), std::forward<Args>(args)...);
+	}
+
+	//The item argument is only consumed by one of the construction or the assignment
+	template<typename K, typename I, size_t C, template<typename> class A>
+	template<typename ItemArg>
+	std::pair<typename UnrolledDictionary<K, I, C, A>::Item*, bool> UnrolledDictionary<K, I, C, A>::insert_or_assign(const Key &_key, ItemArg &&_item)
+	{
+		std::pair<Item*, bool> result = try_emplace(_key, std::forward<ItemArg>(_item));
+		if (!result.second)
+			*result.first = std::forward<ItemArg>(_item);
+		return result;
+	}
+
+	template<typename K, typename I, size_t C, template<typename> class A>
+	template<typename ItemArg>
+	std::pair<typename UnrolledDictionary<K, I, C, A>::Item*, bool> UnrolledDictionary<K, I, C, A>::insert_or_assign(Key &&_key, ItemArg &&_item)
+	{
+		std::pair<Item*, bool> result = try_emplace(std::move(_key), std::forward<ItemArg>(_item));
+		if (!result.second)
+			*result.first = std::forward<ItemArg>(_item);
+		return result;
+	}
+
+	//Lookup functions
+	template<typename K, typename I, size_t C, template<typename> class A>
+	typename UnrolledDictionary<K, I, C, A>::Item* UnrolledDictionary<K, I, C, A>::lookup(const Key &_key) const
+	{
+		size_t index;
+		Node* node = findEntry(_key, index);
+		return node != nullptr ? &node->items()[index] : nullptr;
+	}
+
+	template<typename K, typename I, size_t C, template<typename> class A>
+	template<typename KeyLike, typename>
+	typename UnrolledDictionary<K, I, C, A>::Item* UnrolledDictionary<K, I, C, A>::lookup(const KeyLike &_key) const
+	{
+		size_t index;
+		Node* node = findEntry(_key, index);
+		return node != nullptr ? &node->items()[index] : nullptr;
+	}
+
+	//Remove wrapper functions
+	template<typename K, typename I, size_t C, template<typename> class A>
+	void UnrolledDictionary<K, I, C, A>::remove(const Key &_key)
+	{
+		if (removeEntry(_key)) listSize--;
+	}
+
+	template<typename K, typename I, size_t C, template<typename> class A>
+	template<typename KeyLike, typename>
+	void UnrolledDictionary<K, I, C, A>::remove(const KeyLike &_key)
+	{
+		if (removeEntry(_key)) listSize--;
+	}
+
+	template<typename K, typename I, size_t C, template<typename> class A>
+	void UnrolledDictionary<K, I, C, A>::printEntries() const
+	{
+		printEntriesRec(std::cout, root);
+	}
+
+	//Clear the list
+	template<typename K, typename I, size_t C, template<typename> class A>
+	void UnrolledDictionary<K, I, C, A>::clear()
+	{
+		deepDelete(root);
+		nodes.release();
+		root = nullptr;
+		listSize = 0;
+	}
+
+	//Check if list is empty
+	template<typename K, typename I, size_t C, template<typename> class A>
+	bool UnrolledDictionary<K, I, C, A>::empty() const
+	{
+		return (root == nullptr);
+	}
+
+	//Return the size of the list
+	template<typename K, typename I, size_t C, template<typename> class A>
+	size_t UnrolledDictionary<K, I, C, A>::size() const
+	{
+		return listSize;
+	}
+
+	//Swapping two dictionaries
+	template<typename K, typename I, size_t C, template<typename> class A>
+	void UnrolledDictionary<K, I, C, A>::swap(UnrolledDictionary &original)
+	{
+		std::swap(this->root, original.root);
+		std::swap(this->listSize, original.listSize);
+		this->nodes.swap(original.nodes);
+	}
+
+	template<typename K, typename I, size_t C, template<typename> class A>
+	template<typename Compare>
+	void UnrolledDictionary<K, I, C, A>::sort(Compare comparison)
+	{
+		stableSort([&comparison](const std::pair<Key, Item> &a, const std::pair<Key, Item> &b) { return comparison(a.first, b.first); });
+	}
+
+	template<typename K, typename I, size_t C, template<typename> class A>
+	template<typename Compare>
+	void UnrolledDictionary<K, I, C, A>::sortByItem(Compare comparison)
+	{
+		stableSort([&comparison](const std::pair<Key, Item> &a, const std::pair<Key, Item> &b) { return comparison(a.second, b.second); });
+	}
+
+	//Entries are moved out into a vector, sorted with std::stable_sort and moved back into full nodes
+	template<typename K, typename I, size_t C, template<typename> class A>
+	template<typename EntryOrder>
+	void UnrolledDictionary<K, I, C, A>::stableSort(EntryOrder before)
+	{
+		std::vector<std::pair<Key, Item>> entries;
+		entries.reserve(listSize);
+		for (Node* current = root; current != nullptr; current = current->nextNode)
+		{
+			for (size_t i = 0; i < current->count; i++)
+				entries.emplace_back(std::move(current->keys()[i]), std::move(current->items()[i]));
+		}
+
+		clear();
+		std::stable_sort(entries.begin(), entries.end(), before);
+
+		Node** tail = &root;
+		for (size_t i = 0; i < entries.size(); i++)
+		{
+			if (i % C == 0)
+			{
+				*tail = nodes.create();
+				tail = &(*tail)->nextNode;
+			}
+		}
+
+		size_t i = 0;
+		for (Node* current = root; current != nullptr; current = current->nextNode)
+		{
+			for (; current->count < C && i < entries.size(); i++)
+			{
+				new (&current->keys()[current->count]) Key(std::move(entries[i].first));
+				new (&current->items()[current->count]) Item(std::move(entries[i].second));
+				current->count++;
+			}
+		}
+		listSize = entries.size();
+	}
+
+	//Index of the key in the node, or the node's count when it is absent
+	template<typename K, typename I, size_t C, template<typename> class A>
+	template<typename KeyLike>
+	size_t UnrolledDictionary<K, I, C, A>::scanNode(const Node* node, const KeyLike &_key)
+	{
+		if constexpr (vectorScan && std::is_same<KeyLike, Key>::value)
+			return scanNodeVector(node, _key);
+
+		const Key* keys = node->keys();
+		for (size_t i = 0; i < node->count; i++)
+		{
+			if (keys[i] == _key)
+				return i;
+		}
+		return node->count;
+	}
+
+	//Compares 16 bytes of keys per instruction and folds the whole node into one register, so a node without
+	//the key costs a single branch. Only a node that may hold it is searched again for the position.
+	//SSE2 has no 64 bit equality: 8 byte keys match when both 32 bit halves do. The fold can pair halves of
+	//different keys, which only sends the node to the exact search.
+	template<typename K, typename I, size_t C, template<typename> class A>
+	size_t UnrolledDictionary<K, I, C, A>::scanNodeVector(const Node* node, const Key &_key)
+	{
+#ifdef UNROLLEDDICTIONARY_SSE2
+		const size_t perLane = 16 / sizeof(Key);
+		const __m128i* lanes = reinterpret_cast<const __m128i*>(node->keyStorage);
+		__m128i needle = (sizeof(Key) == 4) ?
+			_mm_set1_epi32(static_cast<int>(_key)) :
+			_mm_set1_epi64x(static_cast<long long>(_key));
+
+		__m128i any = _mm_setzero_si128();
+		for (size_t lane = 0; lane < C / perLane; lane++)
+			any = _mm_or_si128(any, _mm_cmpeq_epi32(_mm_loadu_si128(lanes + lane), needle));
+		if (sizeof(Key) == 8)
+			any = _mm_and_si128(any, _mm_shuffle_epi32(any, _MM_SHUFFLE(2, 3, 0, 1)));
+
+		if (_mm_movemask_epi8(any) == 0)
+			return node->count;
+#endif
+		//Spare slots are zeroed, the exact search stops at count
+		const Key* keys = node->keys();
+		for (size_t i = 0; i < node->count; i++)
+		{
+			if (keys[i] == _key)
+				return i;
+		}
+		return node->count;
+	}
+
+	//Walks the nodes, returns the node holding the key with its index, or nullptr.
+	//When last is given it receives the last node of the list.
+	template<typename K, typename I, size_t C, template<typename> class A>
+	template<typename KeyLike>
+	typename UnrolledDictionary<K, I, C, A>::Node* UnrolledDictionary<K, I, C, A>::findEntry(const KeyLike &_key, size_t &index, Node** last) const
+	{
+		Node* previous = nullptr;
+		for (Node* current = root; current != nullptr; current = current->nextNode)
+		{
+			index = scanNode(current, _key);
+			if (index < current->count)
+				return current;
+			previous = current;
+		}
+
+		if (last != nullptr)
+			*last = previous;
+		return nullptr;
+	}
+
+	//New entries go to the end of the last node, keeping the insertion order
+	template<typename K, typename I, size_t C, template<typename> class A>
+	template<typename KeyArg, typename... Args>
+	std::pair<typename UnrolledDictionary<K, I, C, A>::Item*, bool> UnrolledDictionary<K, I, C, A>::insertEntry(KeyArg &&_key, Args&&... args)
+	{
+		size_t index;
+		Node* last = nullptr;
+		Node* node = findEntry(_key, index, &last);
+		if (node != nullptr)
+			return { &node->items()[index], false };
+
+		if (last == nullptr || last->count == C)
+		{
+			Node* fresh = nodes.create();
+			(last == nullptr ? root : last->nextNode) = fresh;
+			last = fresh;
+		}
+
+		index = last->count;
+		new (&last->items()[index]) Item(std::forward<Args>(args)...);
+		new (&last->keys()[index]) Key(std::forward<KeyArg>(_key));
+		last->count++;
+		listSize++;
+		return { &last->items()[index], true };
+	}
+
+	//Shifts the following entries of the node down by one. An emptied node is unlinked,
+	//and a node left no more than half full takes in its successor when both fit in one node.
+	template<typename K, typename I, size_t C, template<typename> class A>
+	template<typename KeyLike>
+	bool UnrolledDictionary<K, I, C, A>::removeEntry(const KeyLike &_key)
+	{
+		Node* previous = nullptr;
+		for (Node* current = root; current != nullptr; previous = current, current = current->nextNode)
+		{
+			size_t index = scanNode(current, _key);
+			if (index == current->count)
+				continue;
+
+			Key* keys = current->keys();
+			Item* items = current->items();
+			for (size_t i = index; i + 1 < current->count; i++)
+			{
+				keys[i] = std::move(keys[i + 1]);
+				items[i] = std::move(items[i + 1]);
+			}
+			current->count--;
+			keys[current->count].~Key();
+			items[current->count].~Item();
+			std::fill_n(current->keyStorage + current->count * sizeof(Key), sizeof(Key), static_cast<unsigned char>(0));
+
+			if (current->count == 0)
+				unlinkNode(previous, current);
+			else
+			{
+				Node* next = current->nextNode;
+				if (next != nullptr && current->count <= C / 2 && current->count + next->count <= C)
+				{
+					for (size_t i = 0; i < next->count; i++)
+					{
+						new (&keys[current->count]) Key(std::move(next->keys()[i]));
+						new (&items[current->count]) Item(std::move(next->items()[i]));
+						current->count++;
+					}
+					unlinkNode(current, next);
+				}
+			}
+			return true;
+		}
+		return false;
+	}
+
+	template<typename K, typename I, size_t C, template<typename> class A>
+	void UnrolledDictionary<K, I, C, A>::unlinkNode(Node* previous, Node* node)
+	{
+		(previous == nullptr ? root : previous->nextNode) = node->nextNode;
+		destroyNode(node);
+	}
+
+	template<typename K, typename I, size_t C, template<typename> class A>
+	void UnrolledDictionary<K, I, C, A>::destroyNode(Node* node)
+	{
+		for (size_t i = 0; i < node->count; i++)
+		{
+			node->keys()[i].~Key();
+			node->items()[i].~Item();
+		}
+		nodes.destroy(node);
+	}
+
+	//Deep delete function, the caller releases the allocator afterwards
+	template<typename K, typename I, size_t C, template<typename> class A>
+	void UnrolledDictionary<K, I, C, A>::deepDelete(Node* _current)
+	{
+		//A pool frees its chunks wholesale, so entries without destructors need no walk
+		if (NodeAllocator::releasesInBulk && std::is_trivially_destructible<Key>::value && std::is_trivially_destructible<Item>::value)
+			return;
+
+		while (_current != nullptr)
+		{
+			Node* next = _current->nextNode;
+			destroyNode(_current);
+			_current = next;
+		}
+	}
+
+	//Deep copy function, nodes are copied with the same fill
+	template<typename K, typename I, size_t C, template<typename> class A>
+	typename UnrolledDictionary<K, I, C, A>::Node* UnrolledDictionary<K, I, C, A>::deepCopy(const Node* original)
+	{
+		Node* copyRoot = nullptr;
+		Node** tail = &copyRoot;
+
+		for (; original != nullptr; original = original->nextNode)
+		{
+			Node* copy = nodes.create();
+			for (; copy->count < original->count; copy->count++)
+			{
+				new (&copy->keys()[copy->count]) Key(original->keys()[copy->count]);
+				new (&copy->items()[copy->count]) Item(original->items()[copy->count]);
+			}
+			*tail = copy;
+			tail = &copy->nextNode;
+		}
+		return copyRoot;
+	}
+
+	template<typename K, typename I, size_t C, template<typename> class A>
+	void UnrolledDictionary<K, I, C, A>::printEntriesRec(std::ostream &os, const Node* _current)
+	{
+		for (; _current != nullptr; _current = _current->nextNode)
+		{
+			for (size_t i = 0; i < _current->count; i++)
+				os << _current->keys()[i] << " " << _current->items()[i] << std::endl;
+		}
+	}
+
+	//operator<< overloading to transfer the entries into the stream
+	template<typename K, typename I, size_t C, template<typename> class A>
+	std::ostream& operator<< (std::ostream &os, const UnrolledDictionary<K, I, C, A> &dictionary)
+	{
+		UnrolledDictionary<K, I, C, A>::printEntriesRec(os, dictionary.root);
+		return os;
+	}
+};
+#endif // !UNROLLEDDICTIONARY_H
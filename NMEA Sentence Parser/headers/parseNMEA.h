@@ -7,6 +7,7 @@
 #define PARSENMEA_H_RBH011114
 
 #include <string>
+#include <string_view>
 #include <list>
 #include <vector>
 #include <utility>
@@ -16,6 +17,7 @@
 namespace NMEA
 {
     using std::string;
+    using std::string_view;
     using std::vector;
     using std::pair;
 
@@ -28,20 +30,46 @@ namespace NMEA
      */
     using NMEAPair = pair<string, vector<string>>;
 
+    /* The same decomposition as NMEAPair, made of views into the sentence,
+     * which must outlive the NMEAView.
+     * decomposeSentence clears and refills the fields vector, keeping its capacity,
+     * so an NMEAView reused for every sentence stops allocating once it has held
+     * the longest one.
+     */
+    struct NMEAView
+    {
+        string_view type;
+        vector<string_view> fields;
+    };
+
     /* Takes a NMEA sentence string and validates the checksum.
+     * The sentence must end with a '*' and two hexadecimal digits, in either case.
+     * Does not allocate.
+     */
+    bool isValidSentence(string_view);
+
+    /* Takes a buffer holding many NMEA sentences separated by whitespace, e.g. the
+     * contents of a whole log file, and appends the valid ones to the given vector.
+     * The views point into the buffer. Returns the number of sentences appended.
+     * Does not allocate once the vector has enough capacity.
      */
-    bool isValidSentence(const string &);
+    std::size_t validSentences(string_view buffer, vector<string_view> & sentences);
 
     /* Takes a (valid) NMEA sentence string and splits it into component parts.
      */
     NMEAPair decomposeSentence(const string &);
 
+    /* Splits a (valid) NMEA sentence into the given view without copying it.
+     */
+    void decomposeSentence(string_view, NMEAView &);
+
     /* Compute a Position from a NMEAPair.
      *
      * For ill-formed or unrecognised sentence types,
      * returns a Position of latitude 0.0 and longitude 0.0.
      */
-    Position extractPosition(NMEAPair);
+    Position extractPosition(const NMEAPair &);
+    Position extractPosition(const NMEAView &);
 
     /* Takes the name of a file containing NMEA sentences.
      * Reads the file, and returns a vector of Positions extracted from the *valid*
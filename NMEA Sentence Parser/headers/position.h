@@ -7,10 +7,12 @@
 #define POSITION_H_RBH011114
 
 #include <string>
+#include <string_view>
 
 namespace NMEA
 {
     using std::string;
+    using std::string_view;
 
     /* Modern notation for type synonyms, instead of "typedef". */
     using degrees = double;
@@ -36,9 +38,10 @@ namespace NMEA
         /* Construct a Position from strings containing a positive degrees/minutes
          * representation of latitude and longitude, along with 'N'/'S' and 'E'/'W'
          * characters to indicate positive and negative angles.
+         * Throws std::invalid_argument if an angle is not a number.
          */
-        Position(const string & NMEAlatStr, char northing,
-                 const string & NMEAlonStr, char easting);
+        Position(string_view NMEAlatStr, char northing,
+                 string_view NMEAlonStr, char easting);
 
         degrees getLatitude() const;
         degrees getLongitude() const;
@@ -54,7 +57,7 @@ namespace NMEA
         degrees latitude;
         degrees longitude;
         metres  elevation;
-        degrees fromNMEAangleString(const string &);
+        degrees fromNMEAangleString(string_view);
     };
 
     metres distanceBetween(const Position &, const Position &);
@@ -3,14 +3,74 @@
  * Modified by Bartlomiej Rembisz, 25/11/16
  */
 
-#include <sstream>
 #include <fstream>
-#include <algorithm>
+#include <iterator>
 #include <string.h>
 #include "parseNMEA.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#define NMEA_SSE2
+#endif
+
 namespace NMEA
 {
+    namespace
+    {
+            /* Byte-wise XOR reduction of a character range.
+             *
+             * Whole 32 or 16 byte blocks are XORed together as vectors, and the
+             * lanes of the result are folded into a single byte at the end.
+             * The remaining bytes are XORed one at a time.
+             */
+            unsigned char XORreduce(const char * data, std::size_t length)
+            {
+                    std::size_t i = 0;
+                    unsigned char reduction = 0;
+
+#if defined(NMEA_SSE2)
+                    __m128i lanes = _mm_setzero_si128();
+#if defined(__AVX2__)
+                    __m256i wideLanes = _mm256_setzero_si256();
+                    for (; i + 32 <= length; i += 32)
+                        wideLanes = _mm256_xor_si256(wideLanes, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i)));
+                    lanes = _mm_xor_si128(_mm256_castsi256_si128(wideLanes), _mm256_extracti128_si256(wideLanes, 1));
+#endif
+                    for (; i + 16 <= length; i += 16)
+                        lanes = _mm_xor_si128(lanes, _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i)));
+
+                    // Folding the 16 lanes in halves until the first one holds the reduction
+                    lanes = _mm_xor_si128(lanes, _mm_srli_si128(lanes, 8));
+                    lanes = _mm_xor_si128(lanes, _mm_srli_si128(lanes, 4));
+                    lanes = _mm_xor_si128(lanes, _mm_srli_si128(lanes, 2));
+                    lanes = _mm_xor_si128(lanes, _mm_srli_si128(lanes, 1));
+                    reduction = static_cast<unsigned char>(_mm_cvtsi128_si32(lanes));
+#endif
+                    for (; i < length; i++)
+                        reduction ^= static_cast<unsigned char>(data[i]);
+
+                    return reduction;
+            }
+
+            /* Returns the value of a hexadecimal digit, or -1 for any other character.
+             */
+            int hexValue(char digit)
+            {
+                    if (digit >= '0' && digit <= '9') return digit - '0';
+                    if (digit >= 'A' && digit <= 'F') return digit - 'A' + 10;
+                    if (digit >= 'a' && digit <= 'f') return digit - 'a' + 10;
+                    return -1;
+            }
+
+            /* The characters std::isspace accepts in the C locale:
+             * space, and '\t', '\n', '\v', '\f', '\r', which are consecutive.
+             */
+            bool isWhitespace(char character)
+            {
+                    return character == ' ' || (character >= '\t' && character <= '\r');
+            }
+    }
+
     /* Takes a NMEA sentence string and validates the checksum.
      *
      * The checksum value is a 2-digit hexadecimal number after the '*'
@@ -20,50 +80,57 @@ namespace NMEA
      * reduction of the characters codes of the raw sentence elements
        between '$' and '*'.
      */
-    bool isValidSentence(const string & NMEAsentence)
+    bool isValidSentence(string_view sentence)
     {
-            std::string sentence = NMEAsentence;
-            std::string checksum;
-            std::string XORstring;
+            // The leading $ is not part of the checksummed elements
+            if (!sentence.empty() && sentence[0] == '$')
+                sentence.remove_prefix(1);
 
-            for(unsigned int i = 0; i < sentence.size(); i++)
-            {
-                    if(sentence[i] == '*')
-                    {
-                            // Loop searches for the asterisk.
-                            // Checksum is equal to what comes after the asterisk
-                            // Sentence is equal to the sentence without the checksum
-                            checksum = sentence.substr(i + 1, sentence.size());
-                            sentence = sentence.substr(0, i);
-                    }
-            }
-            // Algorithm deleting the $ sign from the sentence.
-            sentence.erase(std::remove(sentence.begin(), sentence.end(), '$'), sentence.end());
+            // The asterisk must be followed by exactly two hex digits
+            std::size_t asterisk = sentence.find('*');
+            if (asterisk == string_view::npos || sentence.size() - asterisk != 3)
+                return false;
 
-            // Byte-wise XOR reduction loop
-            int XORreduction = 0;
-            for (unsigned int i = 0; i < sentence.size(); i++)
-            {
-                XORreduction = XORreduction ^ sentence[i];
-            }
+            int high = hexValue(sentence[asterisk + 1]);
+            int low = hexValue(sentence[asterisk + 2]);
+            if (high < 0 || low < 0)
+                return false;
 
-            // Converting the XORreduction into a hexadecimal value
-            // then converting it to a string
-            std::stringstream stream;
-            stream << std::hex << XORreduction;
-            XORstring = stream.str();
+            // Comparing numbers rather than formatted strings, which also keeps
+            // the leading zero of checksums below 0x10
+            return XORreduce(sentence.data(), asterisk) == high * 16 + low;
+    }
 
-            // Capitalizing both the checksum and XORstring to avoid case-sensitive errors
-            for (unsigned int i = 0; i < checksum.size(); i++)
-                checksum[i] = std::toupper(checksum[i]);
+    /* Takes a buffer of whitespace-separated NMEA sentences.
+     * Appends a view of every sentence passing the checksum to the vector,
+     * returns how many were appended.
+     */
+    std::size_t validSentences(string_view buffer, vector<string_view> & sentences)
+    {
+            std::size_t appended = 0;
+            std::size_t i = 0;
 
-            for(unsigned int i = 0; i < XORstring.size(); i++)
-                XORstring[i] = std::toupper(XORstring[i]);
+            while (i < buffer.size())
+            {
+                    // Skipping the whitespace before the next sentence
+                    while (i < buffer.size() && isWhitespace(buffer[i]))
+                        i++;
 
+                    std::size_t start = i;
+                    while (i < buffer.size() && !isWhitespace(buffer[i]))
+                        i++;
 
-            // Check if the XORstring is equal to checksum,
-            // True if yes, false if no
-			return XORstring == checksum;
+                    if (i > start)
+                    {
+                            string_view sentence = buffer.substr(start, i - start);
+                            if (isValidSentence(sentence))
+                            {
+                                    sentences.push_back(sentence);
+                                    appended++;
+                            }
+                    }
+            }
+            return appended;
     }
 
     /* Takes a (valid) NMEA sentence string and splits it into component parts.
@@ -71,36 +138,34 @@ namespace NMEA
      */
     NMEAPair decomposeSentence(const string & NMEAsentence)
     {
-            std::vector<string> sentenceVect;
-            std::vector<string> tempVect;
-
-            std::stringstream ss(NMEAsentence);
-            std::string element;
+            NMEAView view;
+            decomposeSentence(NMEAsentence, view);
 
-            // Splitting the string with a comma as the delimiter
-            while(std::getline(ss, element, ','))
-            {
-                    // Searching function looking for the asterisk
-                    for (unsigned int i = 0; i < element.size(); i++)
-                    {
-                            // If the function finds the asterisk, slices the string up to the asterisk
-                            if(element[i] == '*')
-                            {
-                                    element = element.substr(0, i);
-                            }
-                    }
-                    // Pushing the string element into a temporary vector
-                    tempVect.push_back(element);
-            }
+            // Copying the views into the strings of the pair
+            return make_pair(string(view.type), vector<string>(view.fields.begin(), view.fields.end()));
+    }
 
-            // Searching algorithm looking for the $ sign and deleting it
-            tempVect[0].erase(std::remove(tempVect[0].begin(), tempVect[0].end(), '$'), tempVect[0].end());
+    /* Takes a (valid) NMEA sentence string and splits it into views of its
+     * sentence type and fields.
+     */
+    void decomposeSentence(string_view sentence, NMEAView & view)
+    {
+            view.fields.clear();
 
-            // Loop which passes all elements from tempVect except for the sentence type to the sentenceVect
-            for (unsigned int i = 1; i < tempVect.size(); i++) sentenceVect.push_back(tempVect[i]);
+            // The $ and the checksum from the asterisk on are not part of any field
+            if (!sentence.empty() && sentence[0] == '$')
+                sentence.remove_prefix(1);
+            sentence = sentence.substr(0, sentence.find('*'));
 
-            // Returning the sentence type string and sentenceVect vector
-            return make_pair(tempVect[0], sentenceVect);
+            // Splitting with a comma as the delimiter, the first element is the sentence type
+            std::size_t comma = sentence.find(',');
+            view.type = sentence.substr(0, comma);
+            while (comma != string_view::npos)
+            {
+                    sentence.remove_prefix(comma + 1);
+                    comma = sentence.find(',');
+                    view.fields.push_back(sentence.substr(0, comma));
+            }
     }
 
     /* Takes a NMEAPair, returns a Position.
@@ -108,89 +173,57 @@ namespace NMEA
      * For ill-formed or unrecognized sentence types,
      * returns a Position of latitude 0.0 and longitude 0.0.
      */
-    Position extractPosition(NMEAPair pair)
+    Position extractPosition(const NMEAPair & pair)
     {
-            // Northing and easting variable will be equal to the first letter
-            // of the decomposed string which holds the directions for each sentence type
-            char northing;
-            char easting;
-
-            // Parsing the GPGLL sentence type
-            if((pair.first == "GPGLL") &&
-               (pair.second[1][0] == 'N' || pair.second[1][0] == 'S') &&
-               (pair.second[3][0] == 'E' || pair.second[3][0] == 'W'))
-            {
-                    try
-                    {
-                            northing = pair.second[1][0];
-                            easting = pair.second[3][0];
+            NMEAView view;
+            view.type = pair.first;
+            view.fields.assign(pair.second.begin(), pair.second.end());
+            return extractPosition(view);
+    }
 
-                            Position GPGLLPos(pair.second[0],
-                                              northing,
-                                              pair.second[2],
-                                              easting);
+    /* Takes a NMEAView, returns a Position.
+     *
+     * For ill-formed or unrecognized sentence types,
+     * returns a Position of latitude 0.0 and longitude 0.0.
+     */
+    Position extractPosition(const NMEAView & view)
+    {
+            // Index of the latitude field for each sentence type, the northing,
+            // longitude and easting fields follow it
+            std::size_t latitude;
+            if (view.type == "GPGLL")
+                latitude = 0;
+            else if (view.type == "GPGGA")
+                latitude = 1;
+            else if (view.type == "GPRMC")
+                latitude = 2;
+            // Returning Latitude = 0.0, Longitude = 0.0 and Elevation 0.0 for
+            // any unrecognized types
+            else
+                return Position(0.0, 0.0, 0.0);
 
-                            // Returning the extracted position
-                            return GPGLLPos;
-                    }
-                    // Returning Latitude = 0.0, Longitude = 0.0 and Elevation 0.0
-                    catch(...)
-                    {
-                            return Position(0.0, 0.0, 0.0);
-                    }
-            }
-            // Parsing the GPGGA sentence type
-            else if(pair.first == "GPGGA" &&
-                   (pair.second[2][0] == 'N' || pair.second[2][0] == 'S') &&
-                   (pair.second[4][0] == 'E' || pair.second[4][0] == 'W'))
-            {
-                    try
-                    {
-                            northing = pair.second[2][0];
-                            easting = pair.second[4][0];
+            if (view.fields.size() < latitude + 4)
+                return Position(0.0, 0.0, 0.0);
 
-                            Position GPGGAPos(pair.second[1],
-                                              northing,
-                                              pair.second[3],
-                                              easting);
+            // Northing and easting variable will be equal to the first letter
+            // of the fields which hold the directions
+            string_view northingField = view.fields[latitude + 1];
+            string_view eastingField = view.fields[latitude + 3];
+            char northing = northingField.empty() ? '\0' : northingField[0];
+            char easting = eastingField.empty() ? '\0' : eastingField[0];
 
-                            // Returning the extracted position
-                            return GPGGAPos;
-                    }
-                    // Returning Latitude = 0.0, Longitude = 0.0 and Elevation 0.0
-                    catch(...)
-                    {
-                            return Position(0.0, 0.0, 0.0);
-                    }
+            if ((northing != 'N' && northing != 'S') || (easting != 'E' && easting != 'W'))
+                return Position(0.0, 0.0, 0.0);
+
+            try
+            {
+                    return Position(view.fields[latitude], northing, view.fields[latitude + 2], easting);
             }
-            // Parsing the GPRMC sentence type
-            else if(pair.first == "GPRMC" &&
-                   (pair.second[3][0] == 'N' || pair.second[3][0] == 'S') &&
-                   (pair.second[5][0] == 'E' || pair.second[5][0] == 'W'))
+            // Returning Latitude = 0.0, Longitude = 0.0 and Elevation 0.0
+            catch(...)
             {
-                    try
-                    {
-                            northing = pair.second[3][0];
-                            easting = pair.second[5][0];
-
-                            Position GPRMCPos(pair.second[2],
-                                              northing,
-                                              pair.second[4],
-                                              easting);
-
-                            // Returning the extracted position
-                            return GPRMCPos;
-                    }
-                    // Returning Latitude = 0.0, Longitude = 0.0 and Elevation 0.0
-                    catch(...)
-                    {
-                        return Position(0.0, 0.0, 0.0);
-                    }
+                    return Position(0.0, 0.0, 0.0);
             }
-            // Returning Latitude = 0.0, Longitude = 0.0 and Elevation 0.0 for
-            // any unrecognized types
-            else
-                return Position(0.0, 0.0, 0.0);
     }
 
     /* Takes the name of a file containing NMEA sentences.
@@ -201,30 +234,25 @@ namespace NMEA
      */
     vector<Position> routeFromNMEALog(const string & logFileName)
     {
-            std::string line;
             std::vector<Position> temp;
             std::ifstream file(logFileName);
 
-            //Loop to load every line from the file
-            while(std::getline(file, line))
-            {
-
-                    // Loop doesn't continue if the line is empty
-                    if(line.empty()) continue;
+            // Loading the whole file, the sentences are validated in place
+            // and blank lines and other whitespace are skipped.
+            std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
 
-                    std::istringstream iss(line);
-                    std::string tempStr;
-
-                    // Passing the string from the stringstream to tempStr to avoid
-                    // symbols not related to the string which cause errors in the validation function.
-                    while((iss >> tempStr))
-                    {
-                            // Checking if the checksum of the string is correct
-                            if(isValidSentence(tempStr))
-                                temp.push_back(extractPosition(decomposeSentence(tempStr))); // Pushing the extracted position into the temp vector.
-                    }
+            std::vector<string_view> sentences;
+            validSentences(contents, sentences);
 
+            // One view is reused for every sentence, its fields vector only grows
+            NMEAView view;
+            temp.reserve(sentences.size());
+            for (string_view sentence : sentences)
+            {
+                    decomposeSentence(sentence, view);
+                    temp.push_back(extractPosition(view)); // Pushing the extracted position into the temp vector.
             }
+
             return temp;
     }
 
@@ -4,8 +4,10 @@
  */
 
 #include <cassert>
+#include <charconv>
 #include <cmath>
 #include <sstream>
+#include <stdexcept>
 
 #include "position.h"
 
@@ -27,8 +29,8 @@ namespace NMEA
         elevation = std::stod(eleStr);
     }
 
-    Position::Position(const string & NMEAlatStr, char northing,
-                       const string & NMEAlonStr, char easting)
+    Position::Position(string_view NMEAlatStr, char northing,
+                       string_view NMEAlonStr, char easting)
     {
         assert(northing == 'N' || northing == 'S');
         assert(easting  == 'E' || easting  == 'W');
@@ -82,10 +84,15 @@ namespace NMEA
 
     /* Convert a positive degrees/minutes string representation of an angle to a decimal degrees
        value.
+       Parses in place with std::from_chars, which unlike std::stod needs no null-terminated copy.
      */
-    degrees Position::fromNMEAangleString(const string & NMEAangleSt)
+    degrees Position::fromNMEAangleString(string_view NMEAangleSt)
     {
-        double angle = std::stod(NMEAangleSt);
+        double angle;
+        std::from_chars_result result = std::from_chars(NMEAangleSt.data(), NMEAangleSt.data() + NMEAangleSt.size(), angle);
+        if (result.ec != std::errc())
+            throw std::invalid_argument("not an NMEA angle");
+
         assert(angle >= 0); // all NMEA angles are positive
         double degrees = std::floor(angle / 100);
         double minutes = angle - 100 * degrees;